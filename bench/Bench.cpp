@@ -0,0 +1,388 @@
+// notepad_bench: throughput of the editor core on synthetic corpora.
+//
+// For each corpus (C++, JSON, Markdown, log) and size, writes a file and
+// measures load (FileLoader into a PieceTable and LineIndex, as the editor
+// does), save (FileSaver::write), highlight (Lexer over every line, as the
+// highlighter's workers do), search (SearchEngine over the text, and
+// QTextDocument::find as the baseline it replaced) and go to line
+// (LineIndex lookups); the JSON corpus is also validated, minified and
+// pretty printed (JsonFormatter). Prints one JSON object per measurement on
+// stdout; progress goes to stderr.
+
+#include "FileLoader.h"
+#include "FileSaver.h"
+#include "JsonFormatter.h"
+#include "Lexer.h"
+#include "LineIndex.h"
+#include "NewlineScan.h"
+#include "PieceTable.h"
+#include "SearchEngine.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTextCursor>
+#include <QTextDocument>
+
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <utility>
+
+namespace {
+constexpr qint64 kWriteBytes = 1 << 20;
+constexpr int kGoToLineLookups = 1000000;
+// A QTextDocument costs several times the text in blocks and formats, so
+// the QTextDocument::find baseline stops at this size.
+constexpr qint64 kDocumentSearchMaxBytes = 256 << 20;
+
+struct Corpus {
+  const char *name;
+  Lexer::Lang lang;
+  const char *pattern; // searched for, as a literal
+  // Appends one generated line, '\n' included.
+  std::function<void(QByteArray &, std::mt19937 &, qint64)> line;
+};
+
+const char *pick(std::mt19937 &rng, std::initializer_list<const char *> list) {
+  return list.begin()[rng() % list.size()];
+}
+
+QVector<Corpus> corpora() {
+  return {
+      {"cpp", Lexer::Lang::Cpp, "return",
+       [](QByteArray &out, std::mt19937 &rng, qint64 n) {
+         switch (rng() % 6) {
+         case 0:
+           out += "// Computes value " + QByteArray::number(n) + "\n";
+           break;
+         case 1:
+           out += "static int func_" + QByteArray::number(n) +
+                  "(int a, const std::string &s) {\n";
+           break;
+         case 2:
+           out += "  return a * " + QByteArray::number(n % 97) +
+                  " + int(s.size()); /* scaled */\n";
+           break;
+         case 3:
+           out += QByteArray("  const char *label = \"") +
+                  pick(rng, {"alpha", "beta", "gamma"}) + "\";\n";
+           break;
+         case 4:
+           out += "  for (auto &item : items) { total += item.weight; }\n";
+           break;
+         default:
+           out += "}\n\n";
+         }
+       }},
+      {"json", Lexer::Lang::Json, "\"value\"",
+       [](QByteArray &out, std::mt19937 &rng, qint64 n) {
+         out += "  {\"id\": " + QByteArray::number(n) + ", \"name\": \"item " +
+                QByteArray::number(rng() % 100000) +
+                "\", \"tags\": [\"a\", \"b\"], \"value\": " +
+                QByteArray::number(double(rng() % 10000) / 100.0) +
+                ", \"ok\": " + pick(rng, {"true", "false", "null"}) + "},\n";
+       }},
+      {"md", Lexer::Lang::Markdown, "bold",
+       [](QByteArray &out, std::mt19937 &rng, qint64 n) {
+         switch (rng() % 5) {
+         case 0:
+           out += "## Section " + QByteArray::number(n) + "\n\n";
+           break;
+         case 1:
+           out += "Some *italic* and **bold** text with `code` in it.\n";
+           break;
+         case 2:
+           out += "- a list item about " +
+                  QByteArray(pick(rng, {"parsing", "layout", "search"})) +
+                  "\n";
+           break;
+         case 3:
+           out += "A plain paragraph line that goes on for a while, like "
+                  "prose does in documentation.\n";
+           break;
+         default:
+           out += "> quoted note " + QByteArray::number(n) + "\n";
+         }
+       }},
+      {"log", Lexer::Lang::None, "ERROR",
+       [](QByteArray &out, std::mt19937 &rng, qint64 n) {
+         out += "2026-10-16T12:" + QByteArray::number(10 + n / 60 % 50) + ":" +
+                QByteArray::number(10 + n % 50) + ".123Z " +
+                pick(rng, {"INFO ", "INFO ", "INFO ", "WARN ", "DEBUG", "ERROR"}) +
+                " [worker-" + QByteArray::number(rng() % 16) + "] request " +
+                QByteArray::number(n) + " took " +
+                QByteArray::number(rng() % 500) + " ms\n";
+       }},
+  };
+}
+
+bool generate(const Corpus &corpus, const QString &path, qint64 bytes) {
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+  std::mt19937 rng(42);
+  QByteArray buf;
+  qint64 written = 0;
+  for (qint64 n = 0; written + buf.size() < bytes; ++n) {
+    corpus.line(buf, rng, n);
+    if (buf.size() >= kWriteBytes) {
+      written += file.write(buf);
+      buf.clear();
+    }
+  }
+  file.write(buf);
+  return true;
+}
+
+// Calls f(lines, base) on runs of whole lines, carrying a line that spans
+// pieces over to the next one.
+template <typename F> void forEachLines(const PieceTable &text, F &&f) {
+  QString carry;
+  qsizetype base = 0;
+  text.forEachChunk([&](QStringView chunk) {
+    const qsizetype last = chunk.lastIndexOf(u'\n');
+    if (last < 0) {
+      carry.append(chunk);
+      return;
+    }
+    qsizetype from = 0;
+    if (!carry.isEmpty()) {
+      const qsizetype first = chunk.indexOf(u'\n');
+      carry.append(chunk.left(first + 1));
+      f(QStringView(carry), base);
+      base += carry.size();
+      from = first + 1;
+    }
+    if (last >= from) {
+      f(chunk.mid(from, last + 1 - from), base);
+      base += last + 1 - from;
+    }
+    carry = chunk.mid(last + 1).toString();
+  });
+  if (!carry.isEmpty())
+    f(QStringView(carry), base);
+}
+
+void report(const char *corpus, qint64 bytes, const char *op, double secs,
+            const QJsonObject &extra = {}) {
+  QJsonObject o{{"corpus", corpus},
+                {"bytes", bytes},
+                {"op", op},
+                {"seconds", secs},
+                {"isa", NewlineScan::isa()}};
+  if (secs > 0)
+    o["mb_per_s"] = bytes / (1024.0 * 1024.0) / secs;
+  for (auto it = extra.begin(); it != extra.end(); ++it)
+    o[it.key()] = it.value();
+  std::fputs(QJsonDocument(o).toJson(QJsonDocument::Compact).constData(),
+             stdout);
+  std::fputc('\n', stdout);
+  std::fflush(stdout);
+}
+
+// Streams `path` in as the editor would, minus the QTextDocument.
+bool load(const QString &path, PieceTable &text, LineIndex &lines,
+          TextFormat &format) {
+  FileLoader loader;
+  QEventLoop loop;
+  bool ok = false;
+  QObject::connect(&loader, &FileLoader::chunkReady,
+                   [&](const QString &chunk) {
+                     text.appendOriginal(chunk);
+                     lines.append(chunk);
+                   });
+  QObject::connect(&loader, &FileLoader::restarted, [&] {
+    text.clear();
+    lines.clear();
+  });
+  QObject::connect(&loader, &FileLoader::finished, [&](bool success) {
+    ok = success;
+    loop.quit();
+  });
+  if (!loader.start(path))
+    return false;
+  loop.exec();
+  format = loader.format();
+  return ok;
+}
+
+void run(const Corpus &corpus, qint64 bytes, const QString &dir, int repeat) {
+  const QString path = dir + "/" + corpus.name + ".txt";
+  std::fprintf(stderr, "%s, %lld MB: generating\n", corpus.name,
+               bytes >> 20);
+  if (!generate(corpus, path, bytes)) {
+    std::fprintf(stderr, "cannot write %s\n", qPrintable(path));
+    return;
+  }
+  const qint64 size = QFile(path).size();
+
+  // Each measurement keeps its best of `repeat` runs.
+  auto best = [repeat](const std::function<void()> &f) {
+    double secs = -1;
+    for (int i = 0; i < repeat; ++i) {
+      QElapsedTimer clock;
+      clock.start();
+      f();
+      const double s = clock.nsecsElapsed() / 1e9;
+      if (secs < 0 || s < secs)
+        secs = s;
+    }
+    return secs;
+  };
+
+  PieceTable text;
+  LineIndex lines;
+  TextFormat format;
+  bool loaded = true;
+  const double loadSecs = best([&] {
+    text.clear();
+    lines.clear();
+    loaded = load(path, text, lines, format) && loaded;
+  });
+  if (!loaded) {
+    std::fprintf(stderr, "cannot load %s\n", qPrintable(path));
+    return;
+  }
+  report(corpus.name, size, "load", loadSecs,
+         {{"lines", lines.lineCount()}});
+
+  const QString copy = dir + "/" + corpus.name + ".saved";
+  bool saved = true;
+  const double saveSecs = best(
+      [&] { saved = FileSaver::write(copy, text, format) && saved; });
+  QFile::remove(copy);
+  if (saved)
+    report(corpus.name, size, "save", saveSecs);
+
+  qint64 tokens = 0;
+  const double highlightSecs = best([&] {
+    QVector<Token> out;
+    int state = Lexer::Normal;
+    tokens = 0;
+    forEachLines(text, [&](QStringView run, qsizetype) {
+      qsizetype from = 0;
+      while (from < run.size()) {
+        qsizetype end = run.indexOf(u'\n', from);
+        if (end < 0)
+          end = run.size();
+        out.clear();
+        state = Lexer::lex(corpus.lang, run.mid(from, end - from), state, out);
+        tokens += out.size();
+        from = end + 1;
+      }
+    });
+  });
+  report(corpus.name, size, "highlight", highlightSecs, {{"tokens", tokens}});
+
+  const SearchEngine engine(QString::fromLatin1(corpus.pattern), {});
+  qint64 matches = 0;
+  const double searchSecs = best([&] {
+    QVector<SearchMatch> found;
+    matches = 0;
+    forEachLines(text, [&](QStringView run, qsizetype base) {
+      found.clear();
+      engine.findAll(run, base, found);
+      matches += found.size();
+    });
+  });
+  report(corpus.name, size, "search", searchSecs,
+         {{"pattern", corpus.pattern}, {"matches", matches}});
+
+  if (size <= kDocumentSearchMaxBytes) {
+    // The editor's Find before SearchEngine: same default options (case
+    // insensitive), stepping from each match to the next.
+    QTextDocument doc;
+    doc.setPlainText(text.text());
+    const QString pattern = QString::fromLatin1(corpus.pattern);
+    qint64 found = 0;
+    const double documentSecs = best([&] {
+      found = 0;
+      for (QTextCursor c = doc.find(pattern, 0); !c.isNull();
+           c = doc.find(pattern, c))
+        ++found;
+    });
+    report(corpus.name, size, "search_qtextdocument", documentSecs,
+           {{"pattern", corpus.pattern}, {"matches", found}});
+  }
+
+  if (corpus.lang == Lexer::Lang::Json) {
+    // The corpus is a run of "{...},\n" lines; this makes it one array.
+    const std::pair<const char *, JsonFormatter::Mode> modes[] = {
+        {"json_validate", JsonFormatter::Mode::Validate},
+        {"json_minify", JsonFormatter::Mode::Minify},
+        {"json_pretty", JsonFormatter::Mode::Pretty}};
+    for (const auto &[op, mode] : modes) {
+      bool valid = true;
+      qint64 outChars = 0;
+      const double secs = best([&] {
+        JsonFormatter json(mode);
+        json.reserve(text.length() + 8);
+        json.feed(u"[");
+        text.forEachChunk([&json](QStringView chunk) { json.feed(chunk); });
+        json.feed(u"null]");
+        valid = json.finish() && valid;
+        outChars = json.takeOutput().size();
+      });
+      if (valid)
+        report(corpus.name, size, op, secs, {{"output_chars", outChars}});
+      else
+        std::fprintf(stderr, "%s: corpus is not valid JSON\n", op);
+    }
+  }
+
+  std::mt19937 rng(7);
+  qsizetype sum = 0;
+  const double gotoSecs = best([&] {
+    for (int i = 0; i < kGoToLineLookups; ++i)
+      sum += lines.lineStart(qsizetype(rng() % lines.lineCount()));
+  });
+  report(corpus.name, size, "goto_line", gotoSecs,
+         {{"lookups", kGoToLineLookups},
+          {"lookups_per_s", kGoToLineLookups / qMax(gotoSecs, 1e-9)},
+          {"checksum", double(sum)}});
+  report(corpus.name, size, "index_memory", 0,
+         {{"line_index_bytes", lines.memoryUsage()},
+          {"buffer_bytes", text.memoryUsage()}});
+  QFile::remove(path);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Measures load, save, highlight, search and go-to-line throughput on "
+      "synthetic corpora; prints JSON lines.");
+  parser.addHelpOption();
+  parser.addOption({"sizes", "Corpus sizes in MB, comma-separated.", "mb",
+                    "1,16,256,1024"});
+  parser.addOption({"corpus", "Corpora to run: cpp, json, md, log.", "names",
+                    "cpp,json,md,log"});
+  parser.addOption({"repeat", "Runs per measurement; the best is kept.", "n",
+                    "3"});
+  parser.addOption({"dir", "Where to write the corpora.", "path"});
+  parser.process(app);
+
+  QTemporaryDir temp;
+  const QString dir =
+      parser.isSet("dir") ? parser.value("dir") : temp.path();
+  const QStringList wanted = parser.value("corpus").split(',');
+  const int repeat = qMax(1, parser.value("repeat").toInt());
+
+  for (const QString &mb : parser.value("sizes").split(',')) {
+    const qint64 bytes = qint64(mb.toDouble() * (1 << 20));
+    if (bytes <= 0)
+      continue;
+    for (const Corpus &corpus : corpora()) {
+      if (wanted.contains(QLatin1String(corpus.name)))
+        run(corpus, bytes, dir, repeat);
+    }
+  }
+  return 0;
+}
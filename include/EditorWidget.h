@@ -1,7 +1,16 @@
 #pragma once
+#include "LineIndex.h"
+#include "PieceTable.h"
+#include "SearchEngine.h"
+#include "TextFormat.h"
+#include <QDateTime>
 #include <QPlainTextEdit>
+#include <QPointer>
 #include <QString>
 
+class SearchIndex;
+class StructureIndex;
+
 class EditorWidget : public QPlainTextEdit {
   Q_OBJECT
 public:
@@ -10,6 +19,93 @@ public:
   void setFilePath(const QString &path) { m_filePath = path; }
   const QString &filePath() const { return m_filePath; }
 
+  // Encoding and line ending of the file on disk; saves write it back.
+  void setTextFormat(const TextFormat &format) { m_format = format; }
+  const TextFormat &textFormat() const { return m_format; }
+  // Bytes of the file as last loaded or saved, where following it resumes.
+  void setFileSize(qint64 bytes) { m_fileSize = bytes; }
+  qint64 fileSize() const { return m_fileSize; }
+  // Modification time of the file then; with the size it tells our own
+  // writes from changes made by others.
+  void setFileTime(const QDateTime &time) { m_fileTime = time; }
+  const QDateTime &fileTime() const { return m_fileTime; }
+
+  // Mirror of the document text; cheap to test, stream out and snapshot.
+  const PieceTable &buffer() const { return m_buffer; }
+  // Line starts of buffer(), for Go to Line and the status bar.
+  const LineIndex &lines() const { return m_lines; }
+  // Matches of the current search term; only those on screen are painted.
+  SearchIndex *search() const { return m_search; }
+
+  // Replaces every match of `engine` in one pass over buffer() and returns
+  // how many were replaced. A single Undo reverts them all.
+  qsizetype replaceAll(const SearchEngine &engine, const QString &replacement);
+  // Applies `edits`, sorted and made against the current text, as one undo
+  // step. Text outside them keeps its blocks, layout and highlighting.
+  void applyEdits(const QVector<TextEdit> &edits);
+
+  // Appends a loaded chunk; the buffer keeps it as an original piece.
+  void appendLoadedText(const QString &text);
+
+  // Rough bytes held by this tab: the document and its layout, the buffer,
+  // the line index and search matches. The document and the buffer each
+  // hold the text, so this is at least four bytes per character. For
+  // choosing tabs to hibernate, not an exact account.
+  qint64 memoryUsage() const;
+
+  // Block numbers last reported by visibleBlocksChanged(); -1 before that.
+  int firstVisible() const { return m_firstVisible; }
+  int lastVisible() const { return m_lastVisible; }
+
+  // True while a FileLoader is still streaming into the document.
+  void setLoading(bool loading) { m_loading = loading; }
+  bool isLoading() const { return m_loading; }
+
+  // Sections for folding, from the document's Highlighter.
+  void setStructure(StructureIndex *structure) { m_structure = structure; }
+  StructureIndex *structure() const { return m_structure; }
+  // Folding hides the lines of a section after its first one; hidden blocks
+  // take no height and are skipped by layout and painting. fold() takes the
+  // innermost section holding `block`, unfold() a folded first line. Moving
+  // the cursor into a folded section opens it.
+  bool fold(const QTextBlock &block);
+  void unfold(const QTextBlock &block);
+  void foldAll();
+  void unfoldAll();
+  bool isFolded(const QTextBlock &block) const;
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+
+signals:
+  // A document change as replayed into buffer(); `text` was inserted at
+  // `pos` after `removed` characters were taken out.
+  void bufferEdited(qsizetype pos, qsizetype removed, const QString &text);
+  // buffer() was rebuilt from the document as a whole.
+  void bufferReset();
+  // Block numbers currently on screen; emitted when scrolling or resizing
+  // changes them.
+  void visibleBlocksChanged(int first, int last);
+
 private:
+  void updateVisibleBlocks();
+  void syncBuffer(int pos, int removed, int added);
+  void resyncBuffer();
+  void updateSearchSelections();
+  void setBlocksVisible(QTextBlock first, const QTextBlock &last,
+                        bool visible);
+  void revealCursor();
+
   QString m_filePath;
+  TextFormat m_format;
+  qint64 m_fileSize = 0;
+  QDateTime m_fileTime;
+  bool m_loading = false;
+  PieceTable m_buffer;
+  LineIndex m_lines;
+  SearchIndex *m_search = nullptr;
+  QPointer<StructureIndex> m_structure;
+  bool m_appendingLoaded = false;
+  int m_firstVisible = -1;
+  int m_lastVisible = -1;
 };
@@ -0,0 +1,29 @@
+#pragma once
+#include "Highlighter.h"
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+// Headless batch highlighting for `notepad --export`. Files are coloured
+// with the editor's lexers on a thread pool, one file per task, and written
+// as HTML or ANSI-coloured text: either one output file per input, written
+// by the task itself, or streamed to stdout in input order.
+class Exporter {
+public:
+  enum class Format { Html, Ansi };
+
+  struct Options {
+    Format format = Format::Html;
+    QString outputDir; // empty: stream everything to stdout
+    int jobs = 0;      // worker threads; 0 for one per core
+  };
+
+  // Directories are searched recursively for files of a known language;
+  // files named explicitly are exported whatever their language. Returns
+  // how many files could not be exported.
+  static int run(const QStringList &paths, const Options &options);
+
+  // `text` coloured for `lang`, as a fragment: a <pre> block for HTML.
+  static QByteArray render(QStringView text, Highlighter::Lang lang,
+                           Format format);
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include "TextFormat.h"
+#include <QObject>
+#include <QString>
+
+#include <memory>
+
+class QFileSystemWatcher;
+class QTimer;
+
+// Follows a growing file, like tail -F. Change notifications are coalesced
+// and only the bytes past the last offset read are fetched, on a worker,
+// one read at a time. A file that shrinks or is replaced (log rotation) is
+// read again from the start. A slow poll backs up the watcher on file
+// systems that do not report changes.
+class FileFollower : public QObject {
+  Q_OBJECT
+public:
+  // Follows `path` from byte `offset`, decoding it as `format`.
+  FileFollower(const QString &path, qint64 offset, const TextFormat &format,
+               QObject *parent = nullptr);
+  ~FileFollower() override;
+
+  void start();
+  // Bytes of the file consumed so far.
+  qint64 offset() const { return m_offset; }
+
+signals:
+  // New text, line endings already turned into '\n'.
+  void appended(const QString &text);
+  // The file was truncated or replaced; everything before is void and the
+  // file is read again from the start.
+  void restarted();
+
+private:
+  struct State;
+
+  void changed();
+  void read();
+  void readFinished(const QString &text, bool restart, bool more);
+
+  QString m_path;
+  qint64 m_offset = 0;
+  std::shared_ptr<State> m_state;
+  QFileSystemWatcher *m_watcher = nullptr;
+  QTimer *m_coalesce = nullptr;
+  QTimer *m_poll = nullptr;
+  bool m_reading = false;
+  bool m_dirty = false; // changed while a read was in flight
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include "TextFormat.h"
+#include <QObject>
+#include <QString>
+
+#include <memory>
+
+// Reads and decodes a file in fixed-size chunks on a worker thread. Chunks
+// arrive on the owner's thread through chunkReady(); at most a few are in
+// flight at once so memory stays bounded for any file size.
+class FileLoader : public QObject {
+  Q_OBJECT
+public:
+  explicit FileLoader(QObject *parent = nullptr);
+  ~FileLoader() override;
+
+  // Opens `path` and starts streaming; false (with `error` set) if the file
+  // cannot be opened.
+  bool start(const QString &path, QString *error = nullptr);
+  void cancel();
+
+  qint64 totalBytes() const { return m_total; }
+  // How the file is stored and how many bytes of it were read; valid once
+  // finished() reported success.
+  const TextFormat &format() const { return m_format; }
+  qint64 bytesRead() const { return m_bytesRead; }
+
+signals:
+  void chunkReady(const QString &text);
+  // The file is not UTF-8 after all: the chunks so far are void and it is
+  // streamed again from the start as Latin-1.
+  void restarted();
+  void progress(qint64 bytesRead, qint64 totalBytes);
+  void finished(bool ok, const QString &error);
+
+private:
+  struct Shared;
+
+  void deliver(const QString &text, qint64 bytesRead);
+  void restart();
+  void complete(const QString &error, const TextFormat &format,
+                qint64 bytesRead);
+
+  std::shared_ptr<Shared> m_shared;
+  qint64 m_total = 0;
+  TextFormat m_format;
+  qint64 m_bytesRead = 0;
+  bool m_done = false;
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include "PieceTable.h"
+#include "TextFormat.h"
+#include <QObject>
+#include <QString>
+
+#include <functional>
+#include <optional>
+
+// Writes a PieceTable snapshot to disk on a worker thread. The text goes to
+// a temporary file next to the target, which is synced and renamed over it
+// only once complete, so a failed or interrupted save never leaves a
+// half-written file behind. The buffer's '\n' line endings are written in
+// the encoding and with the line ending of `format`.
+class FileSaver : public QObject {
+  Q_OBJECT
+public:
+  explicit FileSaver(QObject *parent = nullptr);
+
+  // Starts saving `text` to `path`. While a save is running the request is
+  // queued; a newer request replaces a queued one.
+  void save(const QString &path, const PieceTable &text,
+            const TextFormat &format = {});
+  bool isBusy() const { return m_busy; }
+
+  // The same write, on the calling thread. `progress` gets characters
+  // written so far. Fails if `format` cannot encode every character.
+  static bool write(const QString &path, const PieceTable &text,
+                    const TextFormat &format = {}, QString *error = nullptr,
+                    qint64 *bytes = nullptr,
+                    const std::function<void(qint64)> &progress = {});
+
+signals:
+  void progress(qint64 charsWritten, qint64 totalChars);
+  void finished(bool ok, const QString &path, const QString &error,
+                qint64 bytes, qint64 msecs);
+
+private:
+  struct Job {
+    QString path;
+    PieceTable text;
+    TextFormat format;
+  };
+
+  void run(const Job &job);
+  void complete(const QString &path, const QString &error, qint64 bytes,
+                qint64 msecs);
+
+  std::optional<Job> m_pending;
+  bool m_busy = false;
+};
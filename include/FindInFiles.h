@@ -0,0 +1,72 @@
+#pragma once
+#include "SearchEngine.h"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <memory>
+
+class QThreadPool;
+class QTimer;
+
+// One matching line of a file.
+struct FileHit {
+  qsizetype line = 0; // 0-based
+  qsizetype column = 0;
+  qsizetype length = 0;
+  QString preview; // up to kPreviewChars of the line around the match
+};
+
+struct FileHits {
+  QString path;
+  QVector<FileHit> hits;
+};
+
+// Searches every text file under a directory on a pool of worker threads.
+//
+// One thread walks the tree and deals files out to per-worker queues; a
+// worker takes from the front of its own queue and, when that runs dry,
+// steals from the back of the others, so a few large files do not leave the
+// rest of the pool idle. Files are memory-mapped, and ones with a NUL byte
+// near the start are skipped as binary. Results arrive on the owner's thread
+// in batches through filesMatched() while the search runs.
+class FindInFiles : public QObject {
+  Q_OBJECT
+public:
+  static constexpr int kPreviewChars = 200;
+  static constexpr int kMaxHitsPerFile = 1000;
+
+  explicit FindInFiles(QObject *parent = nullptr);
+  ~FindInFiles() override;
+
+  // Cancels any search in progress and starts a new one. `nameFilters` are
+  // wildcards such as "*.cpp"; empty means every file.
+  void start(const QString &dir, const SearchEngine &engine,
+             const QStringList &nameFilters = {});
+  void cancel();
+  bool isRunning() const { return m_run != nullptr; }
+
+  // Searches one file on the calling thread. False if it was skipped
+  // (unreadable, empty or binary); `bytes` gets the size searched.
+  static bool searchFile(const QString &path, const SearchEngine &engine,
+                         QVector<FileHit> &hits, qint64 *bytes = nullptr);
+
+signals:
+  void filesMatched(const QVector<FileHits> &files);
+  void progress(qint64 filesSearched, qint64 bytesSearched);
+  void finished(qint64 filesSearched, qint64 bytesSearched, qint64 msecs,
+                bool cancelled);
+
+private:
+  struct Run;
+
+  void deliver(const std::shared_ptr<Run> &run,
+               const QVector<FileHits> &files);
+  void complete(const std::shared_ptr<Run> &run);
+  void reportProgress();
+
+  QThreadPool *m_pool = nullptr;
+  std::shared_ptr<Run> m_run;
+  QTimer *m_progress = nullptr;
+};
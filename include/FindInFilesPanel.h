@@ -0,0 +1,55 @@
+#pragma once
+#include "FindInFiles.h"
+#include <QString>
+#include <QWidget>
+
+class QLabel;
+class QLineEdit;
+class QPushButton;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+// Find in Files: a pattern, a folder and optional file name filters above a
+// result tree with one node per file and one child per matching line.
+// Results are added as they stream in; clicking a line asks for that file to
+// be opened there.
+class FindInFilesPanel : public QWidget {
+  Q_OBJECT
+public:
+  explicit FindInFilesPanel(QWidget *parent = nullptr);
+
+  void setOptions(SearchOptions options) { m_options = options; }
+  void setPattern(const QString &pattern);
+  QString directory() const;
+  void setDirectory(const QString &dir);
+  void focusPattern();
+
+public slots:
+  void start();
+  void stop();
+
+signals:
+  void openRequested(const QString &path, qsizetype line); // 0-based
+
+private:
+  static constexpr int kMaxShownHits = 10000;
+
+  void addResults(const QVector<FileHits> &files);
+  void showProgress(qint64 files, qint64 bytes);
+  void searchFinished(qint64 files, qint64 bytes, qint64 msecs,
+                      bool cancelled);
+  void activate(QTreeWidgetItem *item);
+
+  QLineEdit *m_pattern = nullptr;
+  QLineEdit *m_dir = nullptr;
+  QLineEdit *m_filters = nullptr;
+  QPushButton *m_run = nullptr;
+  QTreeWidget *m_results = nullptr;
+  QLabel *m_status = nullptr;
+
+  FindInFiles *m_finder = nullptr;
+  SearchOptions m_options;
+  QString m_root; // directory of the running search
+  qint64 m_matchedFiles = 0;
+  qint64 m_hits = 0;
+};
@@ -1,31 +1,106 @@
 #pragma once
-#include <QRegularExpression>
+#include "Lexer.h"
+#include "StructureIndex.h"
+#include <QStringList>
 #include <QSyntaxHighlighter>
 #include <QTextCharFormat>
 
+#include <optional>
+
+class QElapsedTimer;
+class QTimer;
+
+// Format spans for a run of consecutive blocks, produced off the GUI thread
+// from a snapshot of their texts. Only applied while `revision` still
+// matches the document.
+struct HighlightResult {
+  int generation = 0;
+  quint64 revision = 0;
+  int firstBlock = 0;
+  QVector<Token> tokens;  // all blocks, flattened
+  QVector<int> tokenEnd;  // per block: end index into tokens
+  QVector<int> states;    // per block: packed block state
+  QVector<BlockStructure> structure; // per block
+};
+
 class Highlighter : public QSyntaxHighlighter {
   Q_OBJECT
 public:
-  enum class Lang { None, Cpp, Json, Markdown };
+  using Lang = Lexer::Lang;
   explicit Highlighter(QTextDocument *parent = nullptr);
 
   void setLanguage(Lang lang);
+  Lang language() const { return m_lang; }
+  // The language of a file, from its extension.
+  static Lang languageFor(const QString &path);
+  // Brackets and headings of the document, kept current as blocks are
+  // lexed.
+  StructureIndex *structure() const { return m_structure; }
+  // How tokens of `kind` are drawn.
+  static const QTextCharFormat &format(TokenKind kind) {
+    return formats()[int(kind)];
+  }
+
+  // Lazy mode: setLanguage colours the visible blocks right away and leaves
+  // the rest of the document to worker threads; results are applied in short
+  // idle-time slices instead of one rehighlight().
+  void setLazy(bool on) { m_lazy = on; }
+
+public slots:
+  void setVisibleBlocks(int first, int last);
 
 protected:
   void highlightBlock(const QString &text) override;
 
+private slots:
+  void highlightSlice();
+
 private:
-  struct Rule {
-    QRegularExpression pattern;
-    QTextCharFormat format;
-  };
+  // Block state = generation << kGenShift | input state << 4 | output state.
+  // A block whose generation is not m_generation has not been coloured for
+  // m_lang yet; one whose input differs from its predecessor's output is out
+  // of date.
+  static constexpr int kGenShift = 8;
+  static constexpr int kLexMask = 0xf;
+  static constexpr int kGenMask = 0x7fffff;
+
+  // Shared by every instance; indexed by TokenKind.
+  static const QTextCharFormat *formats();
+  static HighlightResult tokenize(Lang lang, int generation,
+                                  const QStringList &texts, int in);
+
+  static int packState(int generation, int in, int out) {
+    return generation << kGenShift | in << 4 | out;
+  }
+  static int inOf(int state) { return (state >> 4) & kLexMask; }
+  static int outOf(int state) { return state & kLexMask; }
 
-  void buildRules();
+  bool isCurrent(int state) const {
+    return state >= 0 && (state >> kGenShift) == m_generation;
+  }
+  int inputFor(const QTextBlock &block) const;
+  bool isUpToDate(const QTextBlock &block) const;
+
+  void highlightRange(int first, int last);
+  void deferFrom(int block);
+  void submitJob(const QTextBlock &from);
+  void jobFinished(const HighlightResult &result);
+  bool applyReady(const QElapsedTimer &clock);
 
   Lang m_lang = Lang::None;
-  QVector<Rule> m_rules;
+  int m_generation = 0;
+  StructureIndex *m_structure = nullptr;
+  QVector<Token> m_tokens; // reused across blocks to avoid reallocating
+
+  bool m_lazy = false;
+  QTimer *m_idle = nullptr;
+  quint64 m_revision = 0;  // bumped on every contentsChange
+  int m_frontier = 0;      // blocks before this one are up to date
+  int m_visibleFirst = 0, m_visibleLast = -1;
+  int m_allowFirst = 0, m_allowLast = -1; // blocks coloured synchronously
 
-  QTextCharFormat m_keywordFmt, m_typeFmt, m_stringFmt, m_numberFmt,
-      m_commentFmt, m_funcFmt, m_headerFmt, m_mdItalicFmt, m_mdBoldFmt,
-      m_mdCodeFmt;
+  bool m_jobInFlight = false;
+  std::optional<HighlightResult> m_ready;
+  int m_readyIndex = 0;                       // next block of m_ready
+  const HighlightResult *m_applying = nullptr; // set while applying spans
 };
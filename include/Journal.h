@@ -0,0 +1,86 @@
+#pragma once
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+#include <memory>
+
+class EditorWidget;
+class QLockFile;
+class QTimer;
+
+// Write-ahead journal of one editor's unsaved changes, so that a crash
+// loses at most the last flush interval.
+//
+// A journal is a base followed by a log of edits. The base names the file
+// on disk when the editor last matched it, or holds a snapshot of the text.
+// Edits are batched on the GUI thread and appended to the log by a worker;
+// once the log outgrows the document it is compacted into a new snapshot.
+// Nothing is written while the editor is clean, and the files are removed
+// when it becomes clean again or the tab is closed.
+class Journal : public QObject {
+  Q_OBJECT
+public:
+  struct Edit {
+    qsizetype pos = 0;
+    qsizetype removed = 0;
+    QString text;
+  };
+
+  // A journal left behind by a process that is gone. It stays locked
+  // against other instances until remove() or destruction.
+  struct Recovery {
+    QString id;
+    QString filePath;
+    bool fromFile = false; // replay onto filePath as it is on disk
+    QString text;          // the base text otherwise
+    QVector<Edit> edits;
+    std::shared_ptr<QLockFile> lock;
+  };
+
+  explicit Journal(EditorWidget *editor);
+  ~Journal() override;
+
+  // Moves the journal to another editor holding the same text, e.g. when a
+  // hibernated tab is woken up; nullptr parks it, files and all.
+  void setEditor(EditorWidget *editor);
+
+  bool isClean() const { return m_clean; }
+  // The editor now matches its file on disk, or is untitled and empty.
+  void markClean();
+  // Starts the journal over from a snapshot of the current text.
+  void snapshot();
+
+  static QString directory();
+  static QVector<Recovery> recover();
+  static void remove(const Recovery &recovery);
+
+private:
+  struct Lane;
+
+  void record(qsizetype pos, qsizetype removed, const QString &text);
+  void flush();
+  void discard();
+  bool ensureLocked();
+  void enqueue(std::function<void()> task);
+  QString basePath() const;
+  QString logPath(qint64 generation) const;
+
+  EditorWidget *m_editor = nullptr;
+  QString m_id;
+  std::shared_ptr<Lane> m_lane;
+  std::shared_ptr<QLockFile> m_lock;
+  QTimer *m_flushTimer = nullptr;
+
+  bool m_clean = true;
+  qint64 m_generation = 0;
+  QByteArray m_pending; // edits not yet handed to the worker
+  qint64 m_logBytes = 0;
+
+  // The file the editor matched when it was last marked clean.
+  QString m_cleanPath;
+  qint64 m_cleanSize = -1;
+  qint64 m_cleanModified = 0;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <QByteArray>
+#include <QString>
+#include <QStringView>
+
+// Streaming JSON checker and formatter. Text is fed in pieces of any size,
+// split anywhere, e.g. the chunks of a PieceTable. Besides the output only
+// a stack of the open containers is kept, so validating takes no memory
+// that grows with the input. String bodies and runs of whitespace are
+// skipped with SSE2 where available; the rest is one pass of a small state
+// machine.
+class JsonFormatter {
+public:
+  enum class Mode { Validate, Pretty, Minify };
+
+  explicit JsonFormatter(Mode mode, int indent = 2);
+
+  // Output space for about `chars` characters, e.g. the input length.
+  void reserve(qsizetype chars);
+  // Consumes the next piece of input; does nothing after an error.
+  void feed(QStringView chunk);
+  // The input ended. False unless it held exactly one JSON value.
+  bool finish();
+
+  bool hasError() const { return m_errorPos >= 0; }
+  // Offset into the input of the first error, and what was wrong there.
+  qsizetype errorPosition() const { return m_errorPos; }
+  const QString &errorString() const { return m_error; }
+  // The formatted text; empty when validating.
+  QString takeOutput() { return std::move(m_out); }
+
+private:
+  enum class Expect : quint8 {
+    Value,
+    FirstValue, // after '[': a value or ']'
+    Key,
+    FirstKey, // after '{': a key or '}'
+    Colon,
+    CommaOrEnd,
+    Done,
+  };
+  enum class Token : quint8 { None, String, Number, Literal };
+
+  qsizetype scanString(const char16_t *s, qsizetype i, qsizetype n);
+  qsizetype scanNumber(const char16_t *s, qsizetype i, qsizetype n);
+  qsizetype scanLiteral(const char16_t *s, qsizetype i, qsizetype n);
+  bool numberStep(char16_t c);
+  bool numberComplete() const;
+  bool startValue(qsizetype i, char16_t c);
+  bool close(qsizetype i, char16_t c);
+  void beginValue(qsizetype i);
+  void valueDone();
+  void flush(qsizetype to);
+  void newline(qsizetype depth);
+  void fail(qsizetype pos, const QString &message);
+
+  Mode m_mode;
+  int m_indent;
+  QString m_out;
+  QString m_lineStart; // '\n' and spaces, cut to the indentation wanted
+  QByteArray m_stack;  // '{' and '[' of the open containers
+  Expect m_expect = Expect::Value;
+  Token m_token = Token::None;
+  bool m_key = false;         // the string being read is an object key
+  bool m_escape = false;      // after a backslash
+  int m_hex = 0;              // hex digits of a \u escape still to come
+  quint8 m_number = 0;        // state of the number being read
+  const char *m_literal = ""; // true, false or null...
+  int m_literalPos = 0;       // ...and how much of it was read
+  bool m_pendingOpen = false; // pretty: '{' or '[' written, no line break yet
+  const char16_t *m_chunk = nullptr; // the piece being read...
+  qsizetype m_run = 0;               // ...and where its uncopied output starts
+  qsizetype m_base = 0;              // input offset of the piece
+  qsizetype m_errorPos = -1;
+  QString m_error;
+};
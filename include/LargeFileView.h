@@ -0,0 +1,98 @@
+#pragma once
+#include "SearchEngine.h"
+#include "TextFormat.h"
+#include <QAbstractScrollArea>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+class QFile;
+
+// Read-only viewer for files too large for QPlainTextEdit. The file is
+// memory-mapped and only a sparse line index (one offset every kStride
+// lines) is kept; the visible lines are decoded on every paint. Text is read
+// as UTF-8, or as Latin-1 once indexing finds bytes that are not UTF-8;
+// UTF-16 files are refused, since lines are found by their '\n' bytes.
+class LargeFileView : public QAbstractScrollArea {
+  Q_OBJECT
+public:
+  explicit LargeFileView(QWidget *parent = nullptr);
+  ~LargeFileView() override;
+
+  // Maps `path` and starts indexing it in the background.
+  bool open(const QString &path, QString *error = nullptr);
+
+  const QString &filePath() const { return m_filePath; }
+  qint64 fileSize() const { return m_size; }
+  // How the text is decoded; may turn to Latin-1 while indexing.
+  const TextFormat &format() const { return m_format; }
+
+  // Lines known so far; grows until indexing is complete.
+  qint64 lineCount() const { return m_lineCount; }
+  bool isIndexed() const { return m_indexed; }
+  int indexProgress() const;
+
+  qint64 cursorLine() const { return m_cursorLine; }
+  int cursorColumn() const { return m_cursorCol; }
+
+  void goToLine(qint64 line); // 0-based
+  // Looks for matches of `engine`, with its case, whole-word and regex
+  // options, from the cursor and wrapping around. The text is decoded like
+  // the view shows it. Runs on a worker and reports through
+  // findFinished(); a hit moves the cursor. A new search cancels the one in
+  // flight.
+  void find(const SearchEngine &engine, bool backward = false);
+
+signals:
+  void cursorPositionChanged();
+  void indexChanged();
+  void findFinished(bool found);
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+  void keyPressEvent(QKeyEvent *event) override;
+  void mousePressEvent(QMouseEvent *event) override;
+
+private:
+  static constexpr qint64 kStride = 256;
+
+  void appendCheckpoints(const QVector<qint64> &offsets, qint64 lines,
+                         qint64 scanned, bool done, const TextFormat &format);
+  void findDone(qint64 line, qsizetype column, qsizetype length);
+  qint64 lineStart(qint64 line) const;
+  qint64 lineEnd(qint64 start) const;
+  qint64 lineOf(qint64 offset) const;
+  QString lineText(qint64 line) const;
+  bool isLatin1() const {
+    return m_format.encoding == TextFormat::Encoding::Latin1;
+  }
+
+  int visibleLines() const;
+  int xAt(const QString &text, int col) const;
+  int columnAt(const QString &text, int x) const;
+  void moveCursorTo(qint64 line, int col, bool center = false);
+  void updateScrollBars();
+
+  QString m_filePath;
+  std::shared_ptr<QFile> m_file; // shared with the indexer so the map lives
+  const char *m_data = nullptr;
+  qint64 m_size = 0; // after any byte order mark
+  TextFormat m_format;
+  std::shared_ptr<std::atomic<bool>> m_cancel;
+  std::shared_ptr<std::atomic<bool>> m_findCancel; // the search in flight
+
+  QVector<qint64> m_checkpoints; // start of line i * kStride
+  qint64 m_lineCount = 1;
+  qint64 m_scanned = 0;
+  bool m_indexed = false;
+
+  qint64 m_top = 0;
+  int m_maxWidth = 0;
+  qint64 m_cursorLine = 0;
+  int m_cursorCol = 0;
+  qint64 m_matchLine = -1;
+  int m_matchCol = 0, m_matchLength = 0;
+};
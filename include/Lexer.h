@@ -0,0 +1,38 @@
+#pragma once
+#include <QStringView>
+#include <QVector>
+
+enum class TokenKind : quint8 {
+  Keyword,
+  Type,
+  String,
+  Number,
+  Comment,
+  Function,
+  Header,
+  Bold,
+  Italic,
+  Code,
+  Count
+};
+
+struct Token {
+  int start;
+  int length;
+  TokenKind kind;
+};
+
+// Single-pass, table-driven scanner. Each line is walked once; tokens come
+// out in order and never overlap, so nothing inside a string or comment is
+// ever re-coloured.
+class Lexer {
+public:
+  enum class Lang { None, Cpp, Json, Markdown };
+
+  // Line-to-line carry; stored as the QSyntaxHighlighter block state.
+  enum State { Normal = 0, InBlockComment = 1 };
+
+  // Appends the tokens of one line (without its terminator) to `out` and
+  // returns the state the next line starts in.
+  static int lex(Lang lang, QStringView text, int state, QVector<Token> &out);
+};
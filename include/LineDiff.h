@@ -0,0 +1,18 @@
+#pragma once
+#include "SearchEngine.h"
+#include <QStringView>
+#include <QVector>
+
+// Line-level difference between two texts, for reloading a file that was
+// changed on disk without rebuilding the whole document. Lines are compared
+// by interned id after the common head and tail are cut off; the middle is
+// diffed with Myers' O(ND) algorithm.
+class LineDiff {
+public:
+  // Edits that turn `before` into `after`, sorted by position and each
+  // replacing whole lines of `before`. Past kMaxChangedLines differences
+  // the middle is replaced in one edit instead.
+  static QVector<TextEdit> diff(QStringView before, QStringView after);
+
+  static constexpr qsizetype kMaxChangedLines = 2048;
+};
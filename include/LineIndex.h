@@ -0,0 +1,48 @@
+#pragma once
+#include <QStringView>
+#include <QVector>
+
+// Start offset of every line of a document, kept in step with its edits.
+// Line lengths live in chunks of a few thousand lines so an edit only
+// touches its own chunk; chunk prefix sums are rebuilt lazily from the
+// first changed chunk, which makes both lookups O(log n) plus a short scan.
+// Lines end at '\n' (the editor buffer maps paragraph separators to it).
+class LineIndex {
+public:
+  LineIndex();
+
+  void clear();
+  void append(QStringView text);
+  // Mirrors a document change: `removed` characters at `pos` were replaced
+  // by `inserted`.
+  void update(qsizetype pos, qsizetype removed, QStringView inserted);
+
+  qsizetype lineCount() const { return m_lines; }
+  qsizetype length() const { return m_length; }
+  qint64 memoryUsage() const;
+
+  // Both clamp out-of-range arguments; lines are 0-based.
+  qsizetype lineStart(qsizetype line) const;
+  qsizetype lineAt(qsizetype pos) const;
+
+private:
+  static constexpr int kChunkLines = 4096;
+
+  struct Chunk {
+    QVector<int> lengths; // including the '\n', except on the last line
+    qsizetype chars = 0;
+  };
+
+  void locate(qsizetype line, int &chunk, int &index) const;
+  void replaceLines(qsizetype first, qsizetype count,
+                    const QVector<int> &lengths);
+  void ensurePrefix() const;
+
+  QVector<Chunk> m_chunks; // never empty
+  qsizetype m_lines = 1;
+  qsizetype m_length = 0;
+
+  mutable QVector<qsizetype> m_chunkStart; // offset of each chunk's 1st line
+  mutable QVector<qsizetype> m_chunkLine;  // number of each chunk's 1st line
+  mutable int m_validPrefix = 0;           // entries still correct
+};
@@ -1,11 +1,25 @@
 #pragma once
 #include "EditorWidget.h"
+#include "Journal.h"
+#include "JsonFormatter.h"
+#include "SearchEngine.h"
+#include <QByteArray>
+#include <QHash>
 #include <QMainWindow>
+#include <QSet>
 #include <QString>
 #include <QStringList>
 #include <QTabWidget>
 
 class EditorWidget;
+class FindInFilesPanel;
+class LargeFileView;
+class OutlinePanel;
+class QDockWidget;
+class QFileSystemWatcher;
+class QProgressBar;
+class QTimer;
+class QToolButton;
 
 class MainWindow : public QMainWindow {
   Q_OBJECT
@@ -14,6 +28,7 @@ public:
 
 protected:
   void closeEvent(QCloseEvent *event) override;
+  bool eventFilter(QObject *watched, QEvent *event) override;
 
 private slots:
   void newFile();
@@ -24,39 +39,110 @@ private slots:
   void find();
   void findNext();
   void findPrev();
+  void replace();
+  void replaceAll();
+  void showFindInFiles();
+  void openAtLine(const QString &path, qsizetype line);
   void openRecentFile();
   void closeCurrentTab();
   void newTab();
   void toggleDarkTheme(bool on);
+  void setFollow(bool on);
 
   void documentModified();
   void cursorPositionChanged();
   void currentTabChanged(int index);
 
 private:
+  // One tab of a saved session, or a tab put to sleep to save memory.
+  struct SessionTab {
+    QString path;
+    qint64 line = 0;
+    int column = 0;
+    int scroll = 0; // first visible line
+    int lang = 0;   // Highlighter::Lang
+    bool modified = false;
+    QByteArray snapshot; // qCompress()ed UTF-8 text when modified
+    TextFormat format;   // how the file is written back
+  };
+
   void createMenus();
+  void finishStartup();
+  EditorWidget *addEditorTab(int index = -1);
+  void saveSession();
+  bool restoreSession();
+  void materialize(QWidget *placeholder);
+  SessionTab sessionTabOf(QWidget *page) const;
+  bool canHibernate(EditorWidget *ed) const;
+  void hibernate(EditorWidget *ed);
+  void replaceWithPlaceholder(EditorWidget *ed, const SessionTab &tab);
+  void enforceMemoryBudget();
+  void showTabMemory();
   void rebuildRecentFilesMenu();
   void updateStatusBar();
-  void highlightSearch(const QString &term);
+  void updateLoadProgress();
+  void findInEditor(EditorWidget *ed, bool backward);
+  void findInViewer(LargeFileView *view, bool backward);
+  bool askReplace(const QString &title);
+  void setSearchOption(bool SearchOptions::*option, bool on,
+                       const QString &key);
   bool maybeSave(EditorWidget *ed);
-  bool saveToPath(EditorWidget *ed, const QString &path);
+  void recoverJournals();
+  void restoreJournal(const Journal::Recovery &r);
+  bool saveToPath(EditorWidget *ed, const QString &path, bool wait = false);
+  bool checkEncodable(EditorWidget *ed);
+  void waitForSave(EditorWidget *ed);
+  void fileSaved(EditorWidget *ed, const QString &path);
   bool loadFromPath(EditorWidget *ed, const QString &path);
+  void watchOpenFiles();
+  void filesChangedOnDisk();
+  void reloadFromDisk(EditorWidget *ed);
+  void runJsonTool(JsonFormatter::Mode mode);
+  bool openInViewer(EditorWidget *placeholder, const QString &path);
 
   EditorWidget *currentEditor() const;
+  LargeFileView *currentViewer() const;
   void setTabTitle(EditorWidget *ed);
 
   QTabWidget *m_tabs = nullptr;
+  QProgressBar *m_loadProgress = nullptr;
+  QToolButton *m_loadCancel = nullptr;
+  // Restored tabs that have not been opened yet, and hibernated ones.
+  QHash<QWidget *, SessionTab> m_placeholders;
+  // Least recently used editors are hibernated first.
+  QHash<EditorWidget *, quint64> m_lastActive;
+  quint64 m_activeClock = 0;
+  QSet<EditorWidget *> m_hibernating; // compressing on a worker
+  QFileSystemWatcher *m_fileWatcher = nullptr;
+  QTimer *m_changeTimer = nullptr;
+  QSet<QString> m_changedFiles;     // reported, not looked at yet
+  QSet<EditorWidget *> m_reloading; // diffing on a worker
+  QSet<EditorWidget *> m_jsonJobs;  // validating or formatting JSON
+  QTimer *m_budgetTimer = nullptr;
+  QDockWidget *m_findInFilesDock = nullptr;
+  FindInFilesPanel *m_findInFiles = nullptr;
+  QDockWidget *m_performanceDock = nullptr;
+  QDockWidget *m_outlineDock = nullptr;
+  OutlinePanel *m_outline = nullptr;
 
   QStringList m_recentFiles;
   QAction *m_recentMenuAction = nullptr;
+  QAction *m_followAction = nullptr;
   QMenu *m_recentMenu = nullptr;
 
   const int kMaxRecent = 10;
+  const int kDefaultViewerThresholdMB = 256;
+  const int kDefaultMemoryBudgetMB = 1024;
 
   QString m_currentFile;
   QString m_lastSearch;
+  QString m_lastReplace;
+  SearchOptions m_searchOptions;
 
   bool m_dirty = false;
+  // Set once the first frame is up and the deferred start-up work has run.
+  bool m_started = false;
+  qint64 m_firstPaint = -1; // StartupTrace::now() at the first paint event
 
   void applyTheme(bool dark);
   bool isDarkTheme() const;
@@ -0,0 +1,39 @@
+#pragma once
+#include <QVector>
+#include <QtGlobal>
+
+// Vectorized '\n' search over UTF-8 bytes and UTF-16 code units. Picks AVX2
+// or SSE2 at runtime where available and falls back to scalar code.
+class NewlineScan {
+public:
+  // Line terminators seen so far. `lf` and `cr` count every '\n' and '\r',
+  // `crlf` the pairs among them; `lastCR` carries a '\r' at the end of one
+  // piece over to the next.
+  struct Endings {
+    qsizetype lf = 0;
+    qsizetype cr = 0;
+    qsizetype crlf = 0;
+    bool lastCR = false;
+  };
+
+  static qsizetype count(const char *s, qsizetype n);
+  static qsizetype count(const char16_t *s, qsizetype n);
+
+  // Index just past the k-th '\n' in s[0, n). If there are fewer, returns -1
+  // and leaves in `k` how many are still to be skipped.
+  static qsizetype skip(const char *s, qsizetype n, qsizetype &k);
+
+  // Appends base + i for every s[i] == '\n'.
+  static void find(const char16_t *s, qsizetype n, qsizetype base,
+                   QVector<qsizetype> &out);
+
+  // Adds the terminators of s[0, n) to `e`, one call per piece in order.
+  static void endings(const char *s, qsizetype n, Endings &e);
+  static void endings(const char16_t *s, qsizetype n, Endings &e);
+
+  // Length of the leading run of bytes below 0x80 in s[0, n).
+  static qsizetype asciiPrefix(const char *s, qsizetype n);
+
+  // "avx2", "sse2" or "scalar".
+  static const char *isa();
+};
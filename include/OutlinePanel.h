@@ -0,0 +1,32 @@
+#pragma once
+#include <QPointer>
+#include <QWidget>
+
+class EditorWidget;
+class QLabel;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+// The Outline dock: the sections of the current editor as a tree, taken
+// from its StructureIndex. Activating one moves the cursor there, opening
+// it if it is folded. Rebuilt when the structure changes, and only while
+// the panel is shown.
+class OutlinePanel : public QWidget {
+  Q_OBJECT
+public:
+  explicit OutlinePanel(QWidget *parent = nullptr);
+
+  void setEditor(EditorWidget *editor);
+
+protected:
+  void showEvent(QShowEvent *event) override;
+
+private:
+  void refresh();
+  void activate(QTreeWidgetItem *item);
+
+  QTreeWidget *m_tree = nullptr;
+  QLabel *m_status = nullptr;
+  QPointer<EditorWidget> m_editor;
+  QMetaObject::Connection m_changed;
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <QWidget>
+
+class QLabel;
+class QTimer;
+class QTreeWidget;
+
+// The Performance dock: Telemetry totals per metric, refreshed while the
+// panel is shown, with Reset and Export Trace. Telemetry records only while
+// the panel is visible.
+class PerformancePanel : public QWidget {
+  Q_OBJECT
+public:
+  explicit PerformancePanel(QWidget *parent = nullptr);
+
+protected:
+  void showEvent(QShowEvent *event) override;
+  void hideEvent(QHideEvent *event) override;
+
+private:
+  void refresh();
+  void exportTrace();
+
+  QTreeWidget *m_table = nullptr;
+  QLabel *m_status = nullptr;
+  QTimer *m_refresh = nullptr;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+// Piece table mirroring an EditorWidget's text. Loaded text is kept as the
+// immutable chunks it arrived in and every edit goes to an append buffer, so
+// inserts and removes cost time in the size of the edit, not the document.
+// It is a second UTF-16 copy next to the QTextDocument's own, and inserted
+// text stays in the append buffer until the next resync, so an open tab
+// holds its text at least twice.
+//
+// Copies are cheap (implicitly shared) and stay valid while the original is
+// edited, which makes them safe snapshots for worker threads.
+class PieceTable {
+public:
+  void clear();
+
+  // Adds loaded text at the end as its own original buffer (no copy).
+  void appendOriginal(const QString &chunk);
+  void insert(qsizetype pos, QStringView text);
+  void remove(qsizetype pos, qsizetype length);
+
+  qsizetype length() const { return m_length; }
+  bool isEmpty() const { return m_length == 0; }
+  int pieceCount() const { return int(m_pieces.size()); }
+  // Bytes held by the buffers and the piece list, shared or not.
+  qint64 memoryUsage() const;
+
+  // Calls f(QStringView) for each piece in document order.
+  template <typename F> void forEachChunk(F &&f) const {
+    for (const Piece &p : m_pieces)
+      f(QStringView(m_buffers[p.buffer]).mid(p.start, p.length));
+  }
+  QString text() const;
+  QString mid(qsizetype pos, qsizetype length) const;
+
+private:
+  struct Piece {
+    int buffer;
+    qsizetype start;
+    qsizetype length;
+  };
+
+  int locate(qsizetype pos, qsizetype *pieceStart) const;
+  Piece appendToAddBuffer(QStringView text);
+
+  QVector<QString> m_buffers; // originals and append buffers, never rewritten
+  QVector<Piece> m_pieces;
+  int m_addBuffer = -1;
+  qsizetype m_length = 0;
+
+  // Last located piece; edits are usually close to each other.
+  mutable int m_cacheIndex = 0;
+  mutable qsizetype m_cacheStart = 0;
+};
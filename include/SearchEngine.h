@@ -0,0 +1,101 @@
+#pragma once
+#include <QRegularExpression>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+#include <array>
+#include <memory>
+
+struct SearchOptions {
+  bool caseSensitive = false;
+  bool wholeWord = false;
+  bool regex = false;
+
+  bool operator==(const SearchOptions &) const = default;
+};
+
+struct SearchMatch {
+  qsizetype start = -1;
+  qsizetype length = 0;
+};
+
+// Replaces text[start, start + removed) with `text`.
+struct TextEdit {
+  qsizetype start = 0;
+  qsizetype removed = 0;
+  QString text;
+};
+
+// A compiled search pattern; cheap to copy and safe to share between
+// threads once built.
+//
+// Literal patterns are found with an SSE2 prefilter on the pattern's first
+// and last characters (each with its case variants) and a verify of the
+// candidates; other targets use a Horspool scan. Regular expressions are
+// compiled once per pattern and matched line by line, skipping lines that
+// lack the pattern's literal prefix.
+class SearchEngine {
+public:
+  SearchEngine() = default;
+  SearchEngine(const QString &pattern, SearchOptions options);
+
+  const QString &pattern() const { return m_pattern; }
+  SearchOptions options() const { return m_options; }
+  bool isValid() const { return m_valid; }
+  QString errorString() const { return m_error; }
+  // The compiled expression in regex mode.
+  const QRegularExpression &regex() const { return m_regex; }
+
+  // `text` must start at a line start. Every position where a match starts
+  // is reported, so matches may overlap; none span lines.
+  void findAll(QStringView text, qsizetype base,
+               QVector<SearchMatch> &out) const;
+  // First match starting at or after `from`.
+  SearchMatch findFirst(QStringView text, qsizetype from = 0) const;
+
+  // What replaces `match` (found in `text`). In regex mode \0-\9 in
+  // `replacement` stand for the captured groups and \\ for a backslash;
+  // otherwise it is used as it is.
+  QString replacementFor(QStringView text, SearchMatch match,
+                         const QString &replacement) const;
+  // Replaces the non-overlapping matches of `text`, left to right, in one
+  // pass. Edits less than `mergeGap` characters apart are merged, with the
+  // text between them copied in, so many matches make a few large edits.
+  // Returns the number of matches replaced.
+  qsizetype replaceAll(QStringView text, const QString &replacement,
+                       qsizetype mergeGap, QVector<TextEdit> &edits) const;
+
+private:
+  // Code units that compare equal to one pattern character.
+  struct Probe {
+    std::array<char16_t, 4> units{};
+    int count = 0;
+    bool has(char16_t c) const;
+  };
+
+  template <typename F>
+  void forEachMatch(QStringView text, qsizetype from, F &&f) const;
+  template <typename F>
+  void forEachLiteral(QStringView text, qsizetype from, F &&f) const;
+  template <typename F>
+  void forEachRegex(QStringView text, qsizetype from, F &&f) const;
+
+  bool verify(const char16_t *s, qsizetype n, qsizetype at) const;
+  bool isWordAt(const char16_t *s, qsizetype n, qsizetype at) const;
+
+  QString m_pattern;
+  SearchOptions m_options;
+  bool m_valid = false;
+  QString m_error;
+
+  // Literal search.
+  QString m_units; // the pattern, case-folded unless case-sensitive
+  Probe m_first, m_last;
+  bool m_pairFilter = false; // both probes fit; else Horspool
+  std::array<quint8, 256> m_skip{};
+
+  // Regex search.
+  QRegularExpression m_regex;
+  std::shared_ptr<const SearchEngine> m_prefix; // literal every match has
+};
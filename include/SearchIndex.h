@@ -0,0 +1,70 @@
+#pragma once
+#include "SearchEngine.h"
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+class LineIndex;
+class PieceTable;
+
+// Sorted matches of a search pattern in an editor's text. The first scan
+// runs on a worker; after that, edits only rescan the lines they touched.
+class SearchIndex : public QObject {
+  Q_OBJECT
+public:
+  // `text` and `lines` must outlive the index and be kept current by the
+  // owner, who reports every change through textChanged()/textReset().
+  SearchIndex(const PieceTable *text, const LineIndex *lines,
+              QObject *parent = nullptr);
+  ~SearchIndex() override;
+
+  // Starts indexing `pattern`; an empty pattern clears the index.
+  void setQuery(const QString &pattern, SearchOptions options);
+  const SearchEngine &engine() const { return m_engine; }
+  const QString &pattern() const { return m_engine.pattern(); }
+  bool isScanning() const { return m_scanning; }
+
+  // Ordered by start; matches may overlap but never span lines.
+  const QVector<SearchMatch> &matches() const { return m_matches; }
+  // Index into matches() of the first match starting at or after `pos`, the
+  // last one starting before `pos`, or the one starting at `pos`; -1 if none.
+  qsizetype nextMatch(qsizetype pos) const;
+  qsizetype previousMatch(qsizetype pos) const;
+  qsizetype matchAt(qsizetype pos) const;
+  // Searches the text itself, a window of lines at a time, for when
+  // matches() is not complete yet: the first match starting at or after
+  // `pos`, or with `backward` the last one starting before it, wrapping
+  // around once. A default SearchMatch if there is none.
+  SearchMatch find(qsizetype pos, bool backward) const;
+
+  // `removed` characters at `pos` were replaced by `added` new ones.
+  void textChanged(qsizetype pos, qsizetype removed, qsizetype added);
+  // The whole text was replaced.
+  void textReset();
+
+signals:
+  void matchesChanged();
+
+private:
+  void startScan();
+  void scanFinished(quint64 generation, const QVector<SearchMatch> &matches,
+                    qsizetype length);
+  void reconcile(qsizetype oldLength, qsizetype front, qsizetype back);
+
+  const PieceTable *m_text;
+  const LineIndex *m_lines;
+  SearchEngine m_engine;
+  QVector<SearchMatch> m_matches;
+  qsizetype m_length = 0; // length of the text m_matches describe
+
+  bool m_scanning = false;
+  quint64 m_generation = 0;
+  std::shared_ptr<std::atomic<bool>> m_cancel;
+  // Edits made while scanning: the first m_front and the last m_back
+  // characters of the snapshot are still unchanged.
+  qsizetype m_front = 0;
+  qsizetype m_back = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include <QString>
+#include <QtGlobal>
+
+// Timestamps of the start-up phases, written as a Chrome trace (open it in
+// chrome://tracing or Perfetto) once the first frame is up and the work
+// deferred past it has run. Enabled by --startup-trace[=file]; otherwise
+// every call returns at once. GUI thread only.
+class StartupTrace {
+public:
+  static void enable(const QString &path);
+  static bool isEnabled();
+
+  // Microseconds since enable().
+  static qint64 now();
+  // Records [start, now()) as the phase `name`; `name` must outlive the
+  // trace, e.g. a string literal.
+  static void record(const char *name, qint64 start);
+  // Records a point in time.
+  static void mark(const char *name);
+  // Writes the file, once; later calls do nothing.
+  static void finish();
+
+  // Records its own lifetime as one phase.
+  class Scope {
+  public:
+    explicit Scope(const char *name) : m_name(name), m_start(now()) {}
+    ~Scope() { record(m_name, m_start); }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    const char *m_name;
+    qint64 m_start;
+  };
+};
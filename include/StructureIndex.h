@@ -0,0 +1,76 @@
+#pragma once
+#include "Lexer.h"
+#include <QObject>
+#include <QString>
+#include <QTextBlock>
+#include <QVector>
+
+class QTextDocument;
+class QTimer;
+
+// What one line adds to the structure of a document: the brackets it
+// leaves unmatched and, in Markdown, the level of the heading it is.
+struct BlockStructure {
+  int closes = 0;  // '}' and ']' closing earlier lines, before any opens
+  int opens = 0;   // '{' and '[' still open at the end of the line
+  int heading = 0; // 1-6 for a Markdown heading, else 0
+
+  bool isEmpty() const { return !closes && !opens && !heading; }
+  bool operator==(const BlockStructure &o) const {
+    return closes == o.closes && opens == o.opens && heading == o.heading;
+  }
+};
+
+// One entry of the outline: a block that opens a section.
+struct OutlineItem {
+  int block = 0;
+  int level = 0; // 0 for top-level sections
+  QString title;
+};
+
+// Per-document structure: bracket nesting for C++ and JSON, the heading
+// tree for Markdown. The Highlighter stores each block's BlockStructure as
+// it lexes the block, so the index follows edits at the cost of the lines
+// lexed again and nothing is scanned twice. Lines off screen or folded
+// away are summarized when the Highlighter's lazy pass reaches them, which
+// every edit restarts. Fold regions and the outline are derived from those
+// summaries when asked for.
+class StructureIndex : public QObject {
+  Q_OBJECT
+public:
+  explicit StructureIndex(QTextDocument *document, QObject *parent = nullptr);
+
+  void setLanguage(Lexer::Lang lang);
+  Lexer::Lang language() const { return m_lang; }
+
+  // The structure of a line from its tokens; brackets inside strings and
+  // comments do not count. Safe on any thread.
+  static BlockStructure summarize(Lexer::Lang lang, QStringView text,
+                                  const Token *tokens, qsizetype count);
+  static BlockStructure of(const QTextBlock &block);
+  // Records the structure of `block`; changed() follows if it differs.
+  void update(QTextBlock block, const BlockStructure &structure);
+
+  // Last block of the section `start` opens: through the matching bracket,
+  // or up to the next heading of the same or a higher level. Invalid if
+  // `start` opens nothing.
+  QTextBlock foldEnd(const QTextBlock &start) const;
+  // The block opening the innermost section that holds `block`, which may
+  // be `block` itself; invalid if there is none.
+  QTextBlock enclosing(const QTextBlock &block) const;
+  // Sections in document order, down to kOutlineDepth levels of nesting
+  // and at most kMaxOutlineItems of them.
+  QVector<OutlineItem> outline() const;
+
+  static constexpr int kOutlineDepth = 3;
+  static constexpr int kMaxOutlineItems = 20000;
+
+signals:
+  // Some block's structure changed; sent at most every few hundred ms.
+  void changed();
+
+private:
+  QTextDocument *m_document;
+  Lexer::Lang m_lang = Lexer::Lang::None;
+  QTimer *m_notify = nullptr;
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <QString>
+#include <QtGlobal>
+
+#include <array>
+#include <atomic>
+
+// Timers and counters for the hot paths, shown in the Performance dock.
+//
+// Each thread writes to its own buffer: per-metric totals and a ring of
+// recent samples for the trace export, all plain relaxed atomics with a
+// single writer, so recording never takes a lock. Readers sum the buffers
+// of every thread. While disabled, recording is one relaxed load.
+class Telemetry {
+public:
+  enum Metric {
+    HighlightBlock, // GUI thread, per block
+    HighlightJob,   // worker, amount = blocks
+    FileLoad,       // amount = bytes
+    FileSave,       // amount = bytes
+    SearchScan,     // worker, amount = matches
+    Find,           // Find Next/Previous, amount = matches
+    FindInFiles,    // amount = bytes searched
+    StatusBar,
+    MetricCount
+  };
+
+  struct Totals {
+    qint64 count = 0;
+    qint64 nsecs = 0;
+    qint64 maxNsecs = 0;
+    qint64 amount = 0;
+  };
+
+  static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+  static void setEnabled(bool on);
+
+  // Monotonic nanoseconds, comparable across threads.
+  static qint64 now();
+  // One sample of `metric` that started at `start` (from now()).
+  static void add(Metric metric, qint64 start, qint64 nsecs, qint64 amount = 0);
+
+  static const char *name(Metric metric);
+  // Summed over all threads, including ones that have exited.
+  static std::array<Totals, MetricCount> totals();
+  static void reset();
+  // Recent samples of every thread as a Chrome trace.
+  static bool exportTrace(const QString &path, QString *error = nullptr);
+
+  // Times its own lifetime; does nothing if telemetry was off when it was
+  // made.
+  class Scope {
+  public:
+    explicit Scope(Metric metric)
+        : m_metric(metric), m_start(isEnabled() ? now() : -1) {}
+    ~Scope() {
+      if (m_start >= 0)
+        add(m_metric, m_start, now() - m_start, m_amount);
+    }
+    void setAmount(qint64 amount) { m_amount = amount; }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Metric m_metric;
+    qint64 m_start;
+    qint64 m_amount = 0;
+  };
+
+private:
+  static std::atomic<bool> s_enabled;
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include "NewlineScan.h"
+#include <QByteArrayView>
+#include <QString>
+#include <QStringConverter>
+#include <QStringView>
+
+// How a file's text is stored on disk. Kept per tab from the load so that a
+// save writes back the same encoding, byte order mark and line endings.
+struct TextFormat {
+  enum class Encoding { Utf8, Utf16LE, Utf16BE, Latin1 };
+  enum class LineEnding { LF, CRLF, CR };
+
+  Encoding encoding = Encoding::Utf8;
+  bool bom = false;
+  LineEnding lineEnding = LineEnding::LF;
+
+  QStringConverter::Encoding converter() const;
+  QString encodingName() const;   // e.g. "UTF-16 LE BOM", for the status bar
+  QString lineEndingName() const; // "LF", "CRLF" or "CR"
+  QString newline() const;
+
+  // CRLF and CR -> LF in one piece of a stream, carrying a trailing CR over
+  // to the next piece.
+  static void normalizeLineEndings(QString &text, bool &pendingCR);
+};
+
+// Works out the TextFormat of a file from its bytes in the same pass that
+// loads it. The first chunk decides UTF-16 (by BOM, or by its zero bytes)
+// against UTF-8; UTF-8 is then validated chunk by chunk, skipping ASCII runs
+// with vector loads, and a file that fails is Latin-1. Line endings are
+// counted with the NewlineScan kernels along the way.
+class EncodingDetector {
+public:
+  // Looks at the start of the file and returns how many BOM bytes to skip.
+  qsizetype begin(QByteArrayView head);
+
+  // Takes the next raw chunk. Returns false as soon as a file being read as
+  // UTF-8 turns out not to be; see fallBackToLatin1().
+  bool feed(QByteArrayView bytes);
+  // Takes decoded text; UTF-16 line endings are counted here instead.
+  void feedDecoded(QStringView text);
+  // False if the file ended in the middle of a UTF-8 sequence.
+  bool finish() const { return m_need == 0; }
+
+  // Switches to Latin-1 and forgets what was counted; the caller feeds the
+  // file again from the start.
+  void fallBackToLatin1();
+
+  TextFormat format() const;
+
+  // Detects and decodes a whole file held in memory, with its line endings
+  // turned into '\n'.
+  static QString decode(QByteArrayView bytes, TextFormat *format = nullptr);
+
+private:
+  TextFormat m_format;
+  NewlineScan::Endings m_endings;
+  // UTF-8 sequence in progress: continuation bytes still due and the range
+  // the next one must fall in (narrower after E0, ED, F0 and F4).
+  int m_need = 0;
+  uchar m_low = 0x80, m_high = 0xbf;
+};
@@ -1,7 +1,309 @@
 #include "EditorWidget.h"
+#include "SearchEngine.h"
+#include "SearchIndex.h"
+#include "StructureIndex.h"
+#include <QPaintEvent>
+#include <QPainter>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextLayout>
 #include <QTextOption>
 
+namespace {
+// Bounds the selections built for one screen, e.g. on a very long line.
+constexpr int kMaxPaintedMatches = 4096;
+// Replace All merges edits closer than this, trading a little re-layout of
+// unchanged text for far fewer document changes.
+constexpr qsizetype kReplaceMergeChars = 16 << 10;
+// QTextDocument's per-block overhead: the block itself, its layout and the
+// fragment bookkeeping, measured on Qt 6 with short lines.
+constexpr qint64 kBytesPerBlock = 200;
+} // namespace
+
 EditorWidget::EditorWidget(QWidget *parent) : QPlainTextEdit(parent) {
   setWordWrapMode(QTextOption::NoWrap);
   setTabStopDistance(4 * fontMetrics().horizontalAdvance(' '));
+
+  connect(this, &QPlainTextEdit::updateRequest, this,
+          &EditorWidget::updateVisibleBlocks);
+  connect(document(), &QTextDocument::contentsChange, this,
+          &EditorWidget::syncBuffer);
+  connect(this, &QPlainTextEdit::cursorPositionChanged, this,
+          &EditorWidget::revealCursor);
+
+  m_search = new SearchIndex(&m_buffer, &m_lines, this);
+  connect(m_search, &SearchIndex::matchesChanged, this,
+          &EditorWidget::updateSearchSelections);
+}
+
+void EditorWidget::appendLoadedText(const QString &text) {
+  m_appendingLoaded = true;
+  QTextCursor cursor(document());
+  cursor.movePosition(QTextCursor::End);
+  cursor.insertText(text);
+  m_appendingLoaded = false;
+  m_buffer.appendOriginal(text);
+  m_lines.append(text);
+  m_search->textChanged(m_buffer.length() - text.size(), 0, text.size());
+}
+
+qint64 EditorWidget::memoryUsage() const {
+  const QTextDocument *doc = document();
+  return doc->characterCount() * qint64(sizeof(char16_t)) +
+         doc->blockCount() * kBytesPerBlock + m_buffer.memoryUsage() +
+         m_lines.memoryUsage() +
+         m_search->matches().capacity() * qint64(sizeof(SearchMatch));
+}
+
+// The edits are applied back to front, each as its own document change so
+// that only the blocks it touches are laid out and highlighted again, and
+// joined into one undo step.
+qsizetype EditorWidget::replaceAll(const SearchEngine &engine,
+                                   const QString &replacement) {
+  QVector<TextEdit> edits;
+  const qsizetype count = engine.replaceAll(m_buffer.text(), replacement,
+                                            kReplaceMergeChars, edits);
+  applyEdits(edits);
+  return count;
+}
+
+void EditorWidget::applyEdits(const QVector<TextEdit> &edits) {
+  QTextCursor cursor(document());
+  for (qsizetype i = edits.size() - 1; i >= 0; --i) {
+    const TextEdit &edit = edits[i];
+    if (i == edits.size() - 1)
+      cursor.beginEditBlock();
+    else
+      cursor.joinPreviousEditBlock();
+    cursor.setPosition(int(edit.start));
+    cursor.setPosition(int(edit.start + edit.removed), QTextCursor::KeepAnchor);
+    cursor.insertText(edit.text);
+    cursor.endEditBlock();
+  }
+}
+
+void EditorWidget::resyncBuffer() {
+  const QString text = toPlainText();
+  m_buffer.clear();
+  m_buffer.appendOriginal(text);
+  m_lines.clear();
+  m_lines.append(text);
+  m_search->textReset();
+  emit bufferReset();
+}
+
+// Replays a document change into the piece table, line index and search
+// index. Only the inserted range is read back, so the cost follows the size
+// of the edit.
+void EditorWidget::syncBuffer(int pos, int removed, int added) {
+  if (m_appendingLoaded)
+    return;
+
+  // contentsChange counts the document's trailing paragraph separator on
+  // whole-document changes; clamp to the plain text.
+  const qsizetype docLength = document()->characterCount() - 1;
+  if (pos > m_buffer.length() || pos > docLength) {
+    resyncBuffer();
+    return;
+  }
+  removed = int(qMin<qsizetype>(removed, m_buffer.length() - pos));
+  m_buffer.remove(pos, removed);
+
+  added = int(qMin<qsizetype>(added, docLength - pos));
+  QString text;
+  if (added > 0) {
+    QTextCursor cursor(document());
+    cursor.setPosition(pos);
+    cursor.setPosition(pos + added, QTextCursor::KeepAnchor);
+    text = cursor.selectedText();
+    // Same conversions as toPlainText().
+    for (QChar &c : text) {
+      if (c == QChar::ParagraphSeparator || c == QChar::LineSeparator)
+        c = '\n';
+      else if (c == QChar::Nbsp)
+        c = ' ';
+    }
+    m_buffer.insert(pos, text);
+  }
+  m_lines.update(pos, removed, text);
+
+  if (m_buffer.length() != docLength) {
+    resyncBuffer();
+    return;
+  }
+  m_search->textChanged(pos, removed, text.size());
+  emit bufferEdited(pos, removed, text);
+}
+
+void EditorWidget::updateVisibleBlocks() {
+  const QTextBlock top = firstVisibleBlock();
+  if (!top.isValid())
+    return;
+  // Hit-tested rather than counted, as folded blocks take no lines.
+  const int first = top.blockNumber();
+  const int last =
+      qMax(first, cursorForPosition(QPoint(0, viewport()->height() - 1))
+                      .blockNumber());
+  if (first == m_firstVisible && last == m_lastVisible)
+    return;
+  m_firstVisible = first;
+  m_lastVisible = last;
+  updateSearchSelections();
+  emit visibleBlocksChanged(first, last);
+}
+
+// Rebuilds the search decorations for the visible blocks only, so the cost
+// follows the screen rather than the number of matches.
+void EditorWidget::updateSearchSelections() {
+  QList<QTextEdit::ExtraSelection> selections;
+  const QVector<SearchMatch> &matches = m_search->matches();
+  const QTextBlock top = firstVisibleBlock();
+  if (!matches.isEmpty() && top.isValid()) {
+    // Matches never span lines, so the first visible one starts in `top`.
+    const QTextBlock bottom = document()->findBlockByNumber(m_lastVisible);
+    const qsizetype from = top.position();
+    const qsizetype to = bottom.isValid() ? bottom.position() + bottom.length()
+                                          : m_buffer.length();
+    QTextCharFormat fmt;
+    fmt.setBackground(QBrush(Qt::blue).color());
+    for (qsizetype i = m_search->nextMatch(from);
+         i >= 0 && i < matches.size() && matches[i].start < to &&
+         selections.size() < kMaxPaintedMatches;
+         ++i) {
+      QTextEdit::ExtraSelection sel;
+      sel.cursor = QTextCursor(document());
+      sel.cursor.setPosition(int(matches[i].start));
+      sel.cursor.setPosition(int(matches[i].start + matches[i].length),
+                             QTextCursor::KeepAnchor);
+      sel.format = fmt;
+      selections.append(sel);
+    }
+  }
+  setExtraSelections(selections);
+}
+
+bool EditorWidget::isFolded(const QTextBlock &block) const {
+  const QTextBlock next = block.next();
+  return block.isVisible() && next.isValid() && !next.isVisible();
+}
+
+bool EditorWidget::fold(const QTextBlock &block) {
+  if (!m_structure)
+    return false;
+  const QTextBlock start = m_structure->enclosing(block);
+  if (!start.isValid() || isFolded(start))
+    return false;
+  const QTextBlock end = m_structure->foldEnd(start);
+  if (!end.isValid() || end == start)
+    return false;
+  setBlocksVisible(start.next(), end, false);
+  if (!textCursor().block().isVisible()) {
+    QTextCursor cursor = textCursor();
+    cursor.setPosition(start.position() + start.length() - 1);
+    setTextCursor(cursor);
+  }
+  return true;
+}
+
+void EditorWidget::unfold(const QTextBlock &block) {
+  if (!isFolded(block))
+    return;
+  QTextBlock last = block.next();
+  while (last.next().isValid() && !last.next().isVisible())
+    last = last.next();
+  setBlocksVisible(block.next(), last, true);
+}
+
+// Folds the outermost sections; those inside are hidden with them.
+void EditorWidget::foldAll() {
+  if (!m_structure)
+    return;
+  for (QTextBlock b = document()->begin(); b.isValid(); b = b.next()) {
+    const QTextBlock end = m_structure->foldEnd(b);
+    if (!end.isValid() || end == b)
+      continue;
+    if (!isFolded(b))
+      setBlocksVisible(b.next(), end, false);
+    b = end;
+  }
+  revealCursor();
+}
+
+void EditorWidget::unfoldAll() {
+  QTextDocument *doc = document();
+  bool changed = false;
+  for (QTextBlock b = doc->begin(); b.isValid(); b = b.next()) {
+    if (!b.isVisible()) {
+      b.setVisible(true);
+      b.setLineCount(qMax(1, b.layout()->lineCount()));
+      changed = true;
+    }
+  }
+  if (changed) {
+    doc->markContentsDirty(0, doc->characterCount());
+    viewport()->update();
+  }
+}
+
+// Marks the change for the layout only: no contentsChange, so neither the
+// buffer, the undo stack nor the highlighter sees an edit.
+void EditorWidget::setBlocksVisible(QTextBlock first, const QTextBlock &last,
+                                   bool visible) {
+  if (!first.isValid() || !last.isValid())
+    return;
+  const int from = first.position();
+  for (QTextBlock b = first; b.isValid(); b = b.next()) {
+    b.setVisible(visible);
+    b.setLineCount(visible ? qMax(1, b.layout()->lineCount()) : 0);
+    if (b == last)
+      break;
+  }
+  document()->markContentsDirty(from,
+                                last.position() + last.length() - from);
+  viewport()->update();
+}
+
+void EditorWidget::revealCursor() {
+  QTextBlock block = textCursor().block();
+  while (block.isValid() && !block.isVisible()) {
+    QTextBlock header = block.previous();
+    while (header.isValid() && !header.isVisible())
+      header = header.previous();
+    if (!header.isValid())
+      break;
+    unfold(header);
+  }
+}
+
+// Folded sections end in a marker after their first line.
+void EditorWidget::paintEvent(QPaintEvent *event) {
+  QPlainTextEdit::paintEvent(event);
+  QPainter painter(viewport());
+  const QPointF offset = contentOffset();
+  const QFontMetrics fm = fontMetrics();
+  const QString marker = QStringLiteral("...");
+  QTextBlock next;
+  for (QTextBlock b = firstVisibleBlock(); b.isValid(); b = next) {
+    const QRectF rect = blockBoundingGeometry(b).translated(offset);
+    if (rect.top() > event->rect().bottom())
+      break;
+    next = b.next();
+    if (!isFolded(b) || b.layout()->lineCount() == 0)
+      continue;
+    // Hidden blocks hold no lines; jump over them by line number.
+    next = document()->findBlockByLineNumber(b.firstLineNumber() +
+                                             b.lineCount());
+    if (next.blockNumber() <= b.blockNumber())
+      next = QTextBlock();
+    const QTextLine line = b.layout()->lineAt(b.layout()->lineCount() - 1);
+    const QRectF box(offset.x() + line.x() + line.naturalTextWidth() +
+                         fm.horizontalAdvance(' '),
+                     rect.top() + line.y(),
+                     fm.horizontalAdvance(marker) + fm.horizontalAdvance(' '),
+                     line.height());
+    painter.setPen(palette().color(QPalette::Mid));
+    painter.drawRoundedRect(box.adjusted(0, 1, 0, -1), 3, 3);
+    painter.drawText(box, Qt::AlignCenter, marker);
+  }
 }
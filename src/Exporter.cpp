@@ -0,0 +1,262 @@
+#include "Exporter.h"
+#include "TextFormat.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+
+#include <array>
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <memory>
+
+namespace {
+// Files read or rendered ahead of the one being written, per worker, so
+// memory stays bounded when streaming to stdout.
+constexpr int kAheadPerJob = 2;
+
+struct Style {
+  QByteArray html; // opening <span ...>, empty if plain
+  QByteArray ansi; // escape sequence, empty if plain
+};
+
+// Built once from the highlighter's formats before any task runs, so the
+// workers only read it.
+const std::array<Style, int(TokenKind::Count)> &styles() {
+  static const auto table = [] {
+    std::array<Style, int(TokenKind::Count)> t;
+    for (int k = 0; k < int(TokenKind::Count); ++k) {
+      const QTextCharFormat &f = Highlighter::format(TokenKind(k));
+      QByteArray css, sgr;
+      if (f.hasProperty(QTextFormat::ForegroundBrush)) {
+        const QColor c = f.foreground().color();
+        css += "color:" + c.name().toLatin1() + ";";
+        sgr += "\x1b[38;2;" + QByteArray::number(c.red()) + ";" +
+               QByteArray::number(c.green()) + ";" +
+               QByteArray::number(c.blue()) + "m";
+      }
+      if (f.fontWeight() >= QFont::Bold) {
+        css += "font-weight:bold;";
+        sgr += "\x1b[1m";
+      }
+      if (f.fontItalic()) {
+        css += "font-style:italic;";
+        sgr += "\x1b[3m";
+      }
+      if (!css.isEmpty())
+        t[k].html = "<span style=\"" + css + "\">";
+      t[k].ansi = sgr;
+    }
+    return t;
+  }();
+  return table;
+}
+
+void appendEscaped(QByteArray &out, QStringView text, Exporter::Format format) {
+  const QByteArray utf8 = text.toUtf8();
+  if (format == Exporter::Format::Ansi) {
+    out += utf8;
+    return;
+  }
+  for (char c : utf8) {
+    switch (c) {
+    case '&':
+      out += "&amp;";
+      break;
+    case '<':
+      out += "&lt;";
+      break;
+    case '>':
+      out += "&gt;";
+      break;
+    default:
+      out += c;
+    }
+  }
+}
+
+QByteArray documentHead(const QString &title) {
+  QByteArray t;
+  appendEscaped(t, title, Exporter::Format::Html);
+  return "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>" + t +
+         "</title>\n<style>pre{font-family:monospace;}</style></head>"
+         "<body>\n";
+}
+
+const char *documentTail() { return "</body></html>\n"; }
+
+QByteArray heading(const QString &path, Exporter::Format format) {
+  QByteArray out;
+  if (format == Exporter::Format::Html) {
+    out += "<h3>";
+    appendEscaped(out, path, format);
+    out += "</h3>\n";
+  } else {
+    out += "==> " + path.toUtf8() + " <==\n";
+  }
+  return out;
+}
+
+struct Job {
+  QString path;
+  QString name; // relative output name
+};
+
+QVector<Job> expand(const QStringList &paths) {
+  QVector<Job> jobs;
+  for (const QString &path : paths) {
+    const QFileInfo info(path);
+    if (!info.isDir()) {
+      jobs.push_back({path, info.fileName()});
+      continue;
+    }
+    const QDir root(path);
+    QStringList found;
+    QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+      const QString file = it.next();
+      if (Highlighter::languageFor(file) != Highlighter::Lang::None)
+        found << file;
+    }
+    found.sort(); // stable output order
+    for (const QString &file : std::as_const(found))
+      jobs.push_back({file, root.relativeFilePath(file)});
+  }
+  return jobs;
+}
+
+struct Result {
+  QByteArray data; // when streaming
+  QString error;
+};
+
+// Runs on a worker: reads, colours and, with an output directory, writes.
+Result exportOne(const Job &job, const Exporter::Options &options) {
+  Result r;
+  QFile in(job.path);
+  if (!in.open(QIODevice::ReadOnly)) {
+    r.error = in.errorString();
+    return r;
+  }
+  const QString text = EncodingDetector::decode(in.readAll());
+  in.close();
+  QByteArray body = Exporter::render(
+      text, Highlighter::languageFor(job.path), options.format);
+
+  if (options.outputDir.isEmpty()) {
+    r.data = heading(job.path, options.format) + body;
+    return r;
+  }
+
+  const bool html = options.format == Exporter::Format::Html;
+  const QString target = QDir(options.outputDir)
+                             .filePath(job.name + (html ? ".html" : ".ansi"));
+  QDir().mkpath(QFileInfo(target).absolutePath());
+  QFile out(target);
+  if (!out.open(QIODevice::WriteOnly)) {
+    r.error = out.errorString();
+    return r;
+  }
+  if (html)
+    body = documentHead(job.name) + body + documentTail();
+  if (out.write(body) != body.size())
+    r.error = out.errorString();
+  return r;
+}
+} // namespace
+
+QByteArray Exporter::render(QStringView text, Highlighter::Lang lang,
+                            Format format) {
+  const auto &style = styles();
+  QByteArray out;
+  out.reserve(text.size() * 2);
+  if (format == Format::Html)
+    out += "<pre>";
+
+  QVector<Token> tokens;
+  int state = Lexer::Normal;
+  for (qsizetype from = 0; from <= text.size();) {
+    qsizetype end = text.indexOf(u'\n', from);
+    if (end < 0)
+      end = text.size();
+    const QStringView line = text.mid(from, end - from);
+    tokens.clear();
+    state = Lexer::lex(lang, line, state, tokens);
+
+    qsizetype at = 0;
+    for (const Token &t : std::as_const(tokens)) {
+      appendEscaped(out, line.mid(at, t.start - at), format);
+      const Style &s = style[int(t.kind)];
+      const QByteArray &open = format == Format::Html ? s.html : s.ansi;
+      out += open;
+      appendEscaped(out, line.mid(t.start, t.length), format);
+      if (!open.isEmpty())
+        out += format == Format::Html ? "</span>" : "\x1b[0m";
+      at = t.start + t.length;
+    }
+    appendEscaped(out, line.mid(at), format);
+    if (end < text.size())
+      out += '\n';
+    from = end + 1;
+  }
+
+  if (format == Format::Html)
+    out += "</pre>\n";
+  else if (!out.endsWith('\n'))
+    out += '\n';
+  return out;
+}
+
+int Exporter::run(const QStringList &paths, const Options &options) {
+  const QVector<Job> jobs = expand(paths);
+  styles(); // build before the workers need it
+
+  QThreadPool pool;
+  pool.setMaxThreadCount(options.jobs > 0 ? options.jobs
+                                          : QThread::idealThreadCount());
+  const int ahead = pool.maxThreadCount() * kAheadPerJob;
+
+  QFile out;
+  const bool streaming = options.outputDir.isEmpty();
+  if (streaming) {
+    out.open(stdout, QIODevice::WriteOnly);
+    if (options.format == Format::Html)
+      out.write(documentHead("notepad export"));
+  }
+
+  int failed = 0;
+  std::deque<std::future<Result>> pending;
+  qsizetype next = 0;
+  auto submit = [&] {
+    auto promise = std::make_shared<std::promise<Result>>();
+    pending.push_back(promise->get_future());
+    pool.start([promise, job = jobs[next], &options] {
+      promise->set_value(exportOne(job, options));
+    });
+    ++next;
+  };
+
+  // Results are taken in input order while later files are already being
+  // worked on.
+  for (qsizetype i = 0; i < jobs.size(); ++i) {
+    while (next < jobs.size() && next - i < ahead)
+      submit();
+    const Result r = pending.front().get();
+    pending.pop_front();
+    if (!r.error.isEmpty()) {
+      ++failed;
+      std::fprintf(stderr, "notepad: %s: %s\n", qPrintable(jobs[i].path),
+                   qPrintable(r.error));
+      continue;
+    }
+    if (streaming)
+      out.write(r.data);
+  }
+
+  if (streaming && options.format == Format::Html)
+    out.write(documentTail());
+  return failed;
+}
@@ -0,0 +1,151 @@
+#include "FileFollower.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QPointer>
+#include <QStringDecoder>
+#include <QThreadPool>
+#include <QTimer>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+namespace {
+// Bursts of writes become one read; at 10 MB/s that is about 1 MB a read.
+constexpr int kCoalesceMs = 100;
+constexpr int kPollMs = 1000;
+constexpr qint64 kMaxReadBytes = 4 << 20; // per read; the rest follows
+
+template <typename F> void postToGui(F &&f) {
+  if (auto *app = QCoreApplication::instance())
+    QMetaObject::invokeMethod(app, std::forward<F>(f), Qt::QueuedConnection);
+}
+
+// Tells a replaced file from the one that was followed: the inode where
+// there is one, otherwise the creation time.
+quint64 identityOf(const QString &path) {
+#ifdef Q_OS_UNIX
+  struct stat st;
+  if (::stat(QFile::encodeName(path).constData(), &st) != 0)
+    return 0;
+  return quint64(st.st_ino) ^ (quint64(st.st_dev) << 32);
+#else
+  return quint64(QFileInfo(path).birthTime().toMSecsSinceEpoch());
+#endif
+}
+} // namespace
+
+// Touched by the one read in flight, or by the GUI thread when there is
+// none.
+struct FileFollower::State {
+  TextFormat format;
+  QStringDecoder decoder;
+  bool pendingCR = false;
+  quint64 identity = 0;
+  qint64 offset = 0;
+
+  // From the top again; unlike mid-file, a BOM there is skipped.
+  void restart() {
+    decoder = QStringDecoder(format.converter());
+    pendingCR = false;
+    offset = 0;
+  }
+};
+
+FileFollower::FileFollower(const QString &path, qint64 offset,
+                           const TextFormat &format, QObject *parent)
+    : QObject(parent), m_path(path), m_offset(offset),
+      m_state(std::make_shared<State>()) {
+  m_state->format = format;
+  m_state->decoder = QStringDecoder(
+      format.converter(), QStringConverter::Flag::ConvertInitialBom);
+  m_state->identity = identityOf(path);
+  m_state->offset = offset;
+
+  m_watcher = new QFileSystemWatcher(this);
+  connect(m_watcher, &QFileSystemWatcher::fileChanged, this,
+          &FileFollower::changed);
+  // The directory reports a rotated file being created again.
+  connect(m_watcher, &QFileSystemWatcher::directoryChanged, this,
+          &FileFollower::changed);
+
+  m_coalesce = new QTimer(this);
+  m_coalesce->setSingleShot(true);
+  m_coalesce->setInterval(kCoalesceMs);
+  connect(m_coalesce, &QTimer::timeout, this, &FileFollower::read);
+
+  m_poll = new QTimer(this);
+  m_poll->setInterval(kPollMs);
+  connect(m_poll, &QTimer::timeout, this, &FileFollower::changed);
+}
+
+FileFollower::~FileFollower() = default;
+
+void FileFollower::start() {
+  m_watcher->addPath(m_path);
+  m_watcher->addPath(QFileInfo(m_path).absolutePath());
+  m_poll->start();
+  read(); // whatever was added since the file was loaded
+}
+
+void FileFollower::changed() {
+  // A replaced file drops out of the watcher; watch the new one.
+  if (!m_watcher->files().contains(m_path) && QFileInfo::exists(m_path))
+    m_watcher->addPath(m_path);
+  if (!m_coalesce->isActive())
+    m_coalesce->start();
+}
+
+void FileFollower::read() {
+  if (m_reading) {
+    m_dirty = true;
+    return;
+  }
+  m_reading = true;
+  m_dirty = false;
+
+  QPointer<FileFollower> self(this);
+  QThreadPool::globalInstance()->start(
+      [self, state = m_state, path = m_path] {
+        QFile file(path);
+        bool restart = false, more = false;
+        QString text;
+        // A file missing while it is rotated is picked up on the next
+        // change.
+        if (file.open(QIODevice::ReadOnly)) {
+          const quint64 identity = identityOf(path);
+          if (identity != state->identity || file.size() < state->offset) {
+            state->identity = identity;
+            state->restart();
+            restart = true;
+          }
+          const qint64 want =
+              qMin(file.size() - state->offset, kMaxReadBytes);
+          if (want > 0 && file.seek(state->offset)) {
+            const QByteArray bytes = file.read(want);
+            state->offset += bytes.size();
+            more = file.size() > state->offset;
+            text = state->decoder.decode(bytes);
+            TextFormat::normalizeLineEndings(text, state->pendingCR);
+          }
+        }
+        postToGui([self, text, restart, more, offset = state->offset] {
+          if (!self)
+            return;
+          self->m_offset = offset;
+          self->readFinished(text, restart, more);
+        });
+      });
+}
+
+void FileFollower::readFinished(const QString &text, bool restart, bool more) {
+  m_reading = false;
+  if (restart)
+    emit restarted();
+  if (!text.isEmpty())
+    emit appended(text);
+  if (more || m_dirty)
+    read();
+}
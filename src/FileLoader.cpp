@@ -0,0 +1,165 @@
+#include "FileLoader.h"
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QFile>
+#include <QPointer>
+#include <QSemaphore>
+#include <QStringDecoder>
+#include <QThreadPool>
+
+#include <atomic>
+
+namespace {
+constexpr qint64 kChunkBytes = 1 << 20;
+constexpr int kChunksInFlight = 8;
+
+template <typename F> void postToGui(F &&f) {
+  if (auto *app = QCoreApplication::instance())
+    QMetaObject::invokeMethod(app, std::forward<F>(f), Qt::QueuedConnection);
+}
+} // namespace
+
+struct FileLoader::Shared {
+  std::atomic<bool> cancelled{false};
+  QSemaphore credits{kChunksInFlight};
+};
+
+FileLoader::FileLoader(QObject *parent)
+    : QObject(parent), m_shared(std::make_shared<Shared>()) {}
+
+FileLoader::~FileLoader() { m_shared->cancelled = true; }
+
+bool FileLoader::start(const QString &path, QString *error) {
+  auto file = std::make_shared<QFile>(path);
+  if (!file->open(QFile::ReadOnly)) {
+    if (error)
+      *error = file->errorString();
+    return false;
+  }
+  m_total = file->size();
+
+  QPointer<FileLoader> self(this);
+  std::shared_ptr<Shared> shared = m_shared;
+  QThreadPool::globalInstance()->start([self, shared, file] {
+    EncodingDetector detector;
+    QStringDecoder decoder;
+    QByteArray buf(kChunkBytes, Qt::Uninitialized);
+    bool pendingCR = false;
+    bool atStart = true;
+    qint64 done = 0;
+
+    // Back-pressure: waits until the GUI has consumed earlier chunks.
+    auto send = [&](const QString &text) {
+      while (!shared->credits.tryAcquire(1, 50))
+        if (shared->cancelled)
+          return false;
+      postToGui([self, text, done] {
+        if (self)
+          self->deliver(text, done);
+      });
+      return true;
+    };
+
+    auto fail = [&] {
+      const QString err = file->errorString();
+      postToGui([self, err] {
+        if (self)
+          self->complete(err, TextFormat(), 0);
+      });
+    };
+
+    // Invalid UTF-8 can turn up anywhere, so rather than validating the
+    // whole file before showing any of it, the rare file that fails is read
+    // a second time.
+    auto restartAsLatin1 = [&] {
+      detector.fallBackToLatin1();
+      decoder = QStringDecoder(QStringDecoder::Latin1);
+      pendingCR = false;
+      done = 0;
+      postToGui([self] {
+        if (self)
+          self->restart();
+      });
+      return file->seek(0);
+    };
+
+    while (!shared->cancelled) {
+      const qint64 n = file->read(buf.data(), buf.size());
+      if (n < 0) {
+        fail();
+        return;
+      }
+      if (n == 0) {
+        if (detector.finish())
+          break;
+        if (!restartAsLatin1()) {
+          fail();
+          return;
+        }
+        continue;
+      }
+      done += n;
+
+      QByteArrayView bytes(buf.constData(), n);
+      if (atStart) {
+        atStart = false;
+        bytes = bytes.sliced(detector.begin(bytes));
+        // The real BOM is skipped above; a second one would be text.
+        decoder = QStringDecoder(detector.format().converter(),
+                                 QStringConverter::Flag::ConvertInitialBom);
+      }
+      if (!detector.feed(bytes)) {
+        if (!restartAsLatin1()) {
+          fail();
+          return;
+        }
+        continue;
+      }
+
+      QString text = decoder.decode(bytes);
+      detector.feedDecoded(text);
+      TextFormat::normalizeLineEndings(text, pendingCR);
+      if (!send(text))
+        return;
+    }
+    if (shared->cancelled || (pendingCR && !send(QStringLiteral("\n"))))
+      return;
+
+    postToGui([self, format = detector.format(), done] {
+      if (self)
+        self->complete(QString(), format, done);
+    });
+  });
+  return true;
+}
+
+void FileLoader::cancel() {
+  if (m_done)
+    return;
+  m_shared->cancelled = true;
+  m_done = true;
+  emit finished(false, QString());
+}
+
+void FileLoader::deliver(const QString &text, qint64 bytesRead) {
+  if (m_done)
+    return;
+  emit chunkReady(text);
+  emit progress(bytesRead, m_total);
+  m_shared->credits.release();
+}
+
+void FileLoader::restart() {
+  if (!m_done)
+    emit restarted();
+}
+
+void FileLoader::complete(const QString &error, const TextFormat &format,
+                          qint64 bytesRead) {
+  if (m_done)
+    return;
+  m_done = true;
+  m_format = format;
+  m_bytesRead = bytesRead;
+  emit finished(error.isEmpty(), error);
+}
@@ -0,0 +1,141 @@
+#include "FileSaver.h"
+#include "Telemetry.h"
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QSaveFile>
+#include <QStringEncoder>
+#include <QThreadPool>
+
+namespace {
+constexpr qsizetype kWriteBytes = 1 << 20;  // encoded bytes per write()
+constexpr qsizetype kSliceChars = 256 << 10; // characters per encode()
+constexpr qint64 kReportChars = 8 << 20;   // progress granularity
+
+template <typename F> void postToGui(F &&f) {
+  if (auto *app = QCoreApplication::instance())
+    QMetaObject::invokeMethod(app, std::forward<F>(f), Qt::QueuedConnection);
+}
+} // namespace
+
+FileSaver::FileSaver(QObject *parent) : QObject(parent) {}
+
+bool FileSaver::write(const QString &path, const PieceTable &text,
+                      const TextFormat &format, QString *error, qint64 *bytes,
+                      const std::function<void(qint64)> &progress) {
+  Telemetry::Scope timer(Telemetry::FileSave);
+  // QSaveFile writes to a temporary file, syncs it on commit() and then
+  // renames it over `path`. No QIODevice::Text: line endings are `format`'s.
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) {
+    if (error)
+      *error = file.errorString();
+    return false;
+  }
+
+  QStringEncoder encoder(format.converter(),
+                         format.bom ? QStringConverter::Flag::WriteBom
+                                    : QStringConverter::Flag::Default);
+  const QString newline = format.newline();
+  const bool translate = format.lineEnding != TextFormat::LineEnding::LF;
+  QByteArray out;
+  qint64 chars = 0, reported = 0, written = 0;
+  bool ok = true;
+  auto flush = [&] {
+    if (ok && file.write(out) != out.size())
+      ok = false;
+    written += out.size();
+    out.truncate(0);
+  };
+
+  text.forEachChunk([&](QStringView chunk) {
+    // Long pieces are encoded in slices so `out` stays near kWriteBytes.
+    for (qsizetype at = 0; ok && at < chunk.size(); at += kSliceChars) {
+      const QStringView slice = chunk.mid(at, kSliceChars);
+      if (translate && slice.contains('\n'))
+        out += QByteArray(
+            encoder.encode(slice.toString().replace('\n', newline)));
+      else
+        out += QByteArray(encoder.encode(slice));
+      chars += slice.size();
+      if (out.size() >= kWriteBytes)
+        flush();
+      if (progress && chars - reported >= kReportChars) {
+        reported = chars;
+        progress(chars);
+      }
+    }
+  });
+  flush();
+
+  // Latin-1 has no room for the rest of Unicode.
+  if (ok && encoder.hasError()) {
+    if (error)
+      *error = QStringLiteral("The text has characters that %1 cannot store.")
+                   .arg(format.encodingName());
+    file.cancelWriting();
+    return false;
+  }
+  if (!ok) {
+    if (error)
+      *error = file.errorString();
+    file.cancelWriting();
+    return false;
+  }
+  if (!file.commit()) {
+    if (error)
+      *error = file.errorString();
+    return false;
+  }
+  if (bytes)
+    *bytes = written;
+  timer.setAmount(written);
+  return true;
+}
+
+void FileSaver::save(const QString &path, const PieceTable &text,
+                     const TextFormat &format) {
+  if (m_busy) {
+    m_pending = Job{path, text, format};
+    return;
+  }
+  run(Job{path, text, format});
+}
+
+void FileSaver::run(const Job &job) {
+  m_busy = true;
+  QPointer<FileSaver> self(this);
+  QThreadPool::globalInstance()->start([self, job] {
+    QElapsedTimer clock;
+    clock.start();
+    const qint64 total = job.text.length();
+    QString error;
+    qint64 bytes = 0;
+    const bool ok = write(job.path, job.text, job.format, &error, &bytes,
+                          [self, total](qint64 n) {
+                            postToGui([self, n, total] {
+                              if (self)
+                                emit self->progress(n, total);
+                            });
+                          });
+    if (!ok && error.isEmpty())
+      error = QStringLiteral("Unknown error");
+    const qint64 msecs = clock.elapsed();
+    postToGui([self, path = job.path, error, bytes, msecs] {
+      if (self)
+        self->complete(path, error, bytes, msecs);
+    });
+  });
+}
+
+void FileSaver::complete(const QString &path, const QString &error,
+                         qint64 bytes, qint64 msecs) {
+  m_busy = false;
+  if (m_pending) {
+    const Job next = std::move(*m_pending);
+    m_pending.reset();
+    run(next);
+  }
+  emit finished(error.isEmpty(), path, error, bytes, msecs);
+}
@@ -0,0 +1,283 @@
+#include "FindInFiles.h"
+#include "NewlineScan.h"
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QPointer>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <atomic>
+#include <cstring>
+#include <deque>
+
+namespace {
+constexpr qint64 kBinaryProbe = 8 << 10;    // bytes checked for a NUL
+constexpr qint64 kMaxFileBytes = 256 << 20; // larger files are skipped
+constexpr int kBatchFiles = 64;             // results per post...
+constexpr int kBatchMs = 50;                // ...or this often
+constexpr int kProgressMs = 100;
+
+template <typename F> void postToGui(F &&f) {
+  if (auto *app = QCoreApplication::instance())
+    QMetaObject::invokeMethod(app, std::forward<F>(f), Qt::QueuedConnection);
+}
+
+// The pattern as UTF-8 when every match must contain it byte for byte, so
+// files without it are rejected before decoding.
+QByteArray rawNeedle(const SearchEngine &engine) {
+  const SearchOptions options = engine.options();
+  if (options.regex || !options.caseSensitive)
+    return {};
+  return engine.pattern().toUtf8();
+}
+} // namespace
+
+struct FindInFiles::Run {
+  struct Queue {
+    QMutex lock;
+    std::deque<QString> files;
+  };
+
+  Run(const SearchEngine &engine, int workers)
+      : engine(engine), workers(workers), queues(new Queue[workers]),
+        active(workers) {
+    clock.start();
+  }
+
+  // Deals the files under `dir` round-robin to the worker queues. Each file
+  // releases one token; the extra token per worker at the end lets every
+  // worker wake up and see that the walk is over.
+  void walk(const QString &dir, const QStringList &nameFilters) {
+    QDirIterator it(dir, nameFilters, QDir::Files | QDir::Readable,
+                    QDirIterator::Subdirectories);
+    int next = 0;
+    while (!cancelled && it.hasNext()) {
+      QString path = it.next();
+      Queue &q = queues[next];
+      next = (next + 1) % workers;
+      {
+        QMutexLocker lock(&q.lock);
+        q.files.push_back(std::move(path));
+      }
+      available.release();
+    }
+    walked = true;
+    available.release(workers);
+  }
+
+  // Own queue first, oldest file first; otherwise the newest file of
+  // another queue, which its owner would reach last.
+  bool take(int self, QString &path) {
+    for (int i = 0; i < workers; ++i) {
+      Queue &q = queues[(self + i) % workers];
+      QMutexLocker lock(&q.lock);
+      if (q.files.empty())
+        continue;
+      if (i == 0) {
+        path = std::move(q.files.front());
+        q.files.pop_front();
+      } else {
+        path = std::move(q.files.back());
+        q.files.pop_back();
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void work(int self, const std::shared_ptr<Run> &run,
+            const QPointer<FindInFiles> &owner) {
+    QVector<FileHits> batch;
+    QElapsedTimer sinceFlush;
+    sinceFlush.start();
+    auto flush = [&] {
+      if (!batch.isEmpty())
+        postToGui([owner, run, batch] {
+          if (owner)
+            owner->deliver(run, batch);
+        });
+      batch.clear();
+      sinceFlush.restart();
+    };
+
+    while (!cancelled) {
+      if (!available.tryAcquire(1, kBatchMs)) {
+        if (sinceFlush.elapsed() >= kBatchMs)
+          flush();
+        continue;
+      }
+      // A token means a file is queued or the walk is over. Before then a
+      // miss can only be a race with a thief, so look again.
+      QString path;
+      bool found = take(self, path);
+      while (!found && !walked && !cancelled) {
+        QThread::yieldCurrentThread();
+        found = take(self, path);
+      }
+      if (!found)
+        break;
+
+      QVector<FileHit> hits;
+      qint64 size = 0;
+      if (searchFile(path, engine, hits, &size)) {
+        files.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+      }
+      if (!hits.isEmpty())
+        batch.push_back({path, std::move(hits)});
+      if (batch.size() >= kBatchFiles || sinceFlush.elapsed() >= kBatchMs)
+        flush();
+    }
+    flush();
+
+    if (active.fetch_sub(1) == 1)
+      postToGui([owner, run] {
+        if (owner)
+          owner->complete(run);
+      });
+  }
+
+  const SearchEngine engine;
+  const int workers;
+  std::unique_ptr<Queue[]> queues;
+  QSemaphore available;
+  std::atomic<bool> walked{false};
+  std::atomic<bool> cancelled{false};
+  std::atomic<int> active;
+  std::atomic<qint64> files{0};
+  std::atomic<qint64> bytes{0};
+  QElapsedTimer clock;
+};
+
+FindInFiles::FindInFiles(QObject *parent)
+    : QObject(parent), m_pool(new QThreadPool(this)) {
+  // Its own pool, so a long search does not hold up loading, saving and
+  // highlighting on the global one. One extra thread walks the tree.
+  m_pool->setMaxThreadCount(qMax(1, QThread::idealThreadCount()) + 1);
+
+  m_progress = new QTimer(this);
+  m_progress->setInterval(kProgressMs);
+  connect(m_progress, &QTimer::timeout, this, &FindInFiles::reportProgress);
+}
+
+FindInFiles::~FindInFiles() {
+  if (m_run)
+    m_run->cancelled = true;
+  m_pool->clear();
+  m_pool->waitForDone();
+}
+
+void FindInFiles::start(const QString &dir, const SearchEngine &engine,
+                        const QStringList &nameFilters) {
+  cancel();
+  if (!engine.isValid() || engine.pattern().isEmpty())
+    return;
+
+  const int workers = m_pool->maxThreadCount() - 1;
+  auto run = std::make_shared<Run>(engine, workers);
+  m_run = run;
+  m_progress->start();
+
+  QPointer<FindInFiles> self(this);
+  m_pool->start([run, dir, nameFilters] { run->walk(dir, nameFilters); });
+  for (int i = 0; i < workers; ++i)
+    m_pool->start([run, i, self] { run->work(i, run, self); });
+}
+
+void FindInFiles::cancel() {
+  if (!m_run)
+    return;
+  m_run->cancelled = true;
+  complete(m_run);
+}
+
+void FindInFiles::deliver(const std::shared_ptr<Run> &run,
+                          const QVector<FileHits> &files) {
+  if (run == m_run)
+    emit filesMatched(files);
+}
+
+void FindInFiles::complete(const std::shared_ptr<Run> &run) {
+  if (run != m_run)
+    return; // cancelled or replaced earlier
+  m_run.reset();
+  m_progress->stop();
+  const qint64 files = run->files, bytes = run->bytes;
+  emit progress(files, bytes);
+  emit finished(files, bytes, run->clock.elapsed(), run->cancelled);
+}
+
+void FindInFiles::reportProgress() {
+  if (m_run)
+    emit progress(m_run->files, m_run->bytes);
+}
+
+bool FindInFiles::searchFile(const QString &path, const SearchEngine &engine,
+                             QVector<FileHit> &hits, qint64 *bytes) {
+  QFile file(path);
+  if (!file.open(QFile::ReadOnly))
+    return false;
+  qint64 size = file.size();
+  if (size <= 0 || size > kMaxFileBytes)
+    return false;
+
+  // Mapped where possible; some files (procfs, a few network shares) can
+  // only be read.
+  QByteArray buffer;
+  const char *data = reinterpret_cast<const char *>(file.map(0, size));
+  if (!data) {
+    buffer = file.readAll();
+    data = buffer.constData();
+    size = buffer.size();
+  }
+  if (std::memchr(data, 0, size_t(qMin(size, kBinaryProbe))))
+    return false;
+  if (bytes)
+    *bytes = size;
+
+  const QByteArray needle = rawNeedle(engine);
+  if (!needle.isEmpty() &&
+      QByteArray::fromRawData(data, size).indexOf(needle) < 0)
+    return true;
+
+  // Line ends as the editor will see them once the file is opened.
+  QString text = QString::fromUtf8(data, size);
+  if (text.contains(u'\r'))
+    text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+
+  QVector<SearchMatch> matches;
+  engine.findAll(text, 0, matches);
+
+  // One hit per line, at its first match.
+  const auto *s = reinterpret_cast<const char16_t *>(text.utf16());
+  qsizetype line = 0, counted = 0, lineEnd = -1;
+  for (const SearchMatch &m : matches) {
+    if (m.start <= lineEnd)
+      continue;
+    if (hits.size() >= kMaxHitsPerFile)
+      break;
+    line += NewlineScan::count(s + counted, m.start - counted);
+    counted = m.start;
+    const qsizetype lineStart =
+        m.start ? text.lastIndexOf(u'\n', m.start - 1) + 1 : 0;
+    lineEnd = text.indexOf(u'\n', m.start);
+    if (lineEnd < 0)
+      lineEnd = text.size();
+
+    // Long lines are shown from a little before the match.
+    qsizetype from = lineStart;
+    if (m.start - lineStart > kPreviewChars / 2)
+      from = m.start - kPreviewChars / 4;
+    hits.push_back({line, m.start - lineStart, m.length,
+                    text.mid(from, qMin<qsizetype>(lineEnd - from,
+                                                   kPreviewChars))});
+  }
+  return true;
+}
@@ -0,0 +1,194 @@
+#include "FindInFilesPanel.h"
+#include "Telemetry.h"
+#include <QDir>
+#include <QFileDialog>
+#include <QGridLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QRegularExpression>
+#include <QSettings>
+#include <QToolButton>
+#include <QTreeWidget>
+
+namespace {
+constexpr int kPathRole = Qt::UserRole;
+constexpr int kLineRole = Qt::UserRole + 1;
+} // namespace
+
+FindInFilesPanel::FindInFilesPanel(QWidget *parent) : QWidget(parent) {
+  QSettings s;
+  m_pattern = new QLineEdit(this);
+  m_dir = new QLineEdit(s.value("findInFiles/dir").toString(), this);
+  m_filters =
+      new QLineEdit(s.value("findInFiles/filters").toString(), this);
+  m_filters->setPlaceholderText("All files (e.g. *.cpp *.h)");
+
+  auto *browse = new QToolButton(this);
+  browse->setText("...");
+  connect(browse, &QToolButton::clicked, this, [this] {
+    const QString dir =
+        QFileDialog::getExistingDirectory(this, "Find in Folder", directory());
+    if (!dir.isEmpty())
+      setDirectory(dir);
+  });
+
+  m_run = new QPushButton("Find", this);
+  connect(m_run, &QPushButton::clicked, this, [this] {
+    if (m_finder->isRunning())
+      stop();
+    else
+      start();
+  });
+  connect(m_pattern, &QLineEdit::returnPressed, this,
+          &FindInFilesPanel::start);
+
+  m_results = new QTreeWidget(this);
+  m_results->setHeaderHidden(true);
+  m_results->setUniformRowHeights(true);
+  connect(m_results, &QTreeWidget::itemClicked, this,
+          [this](QTreeWidgetItem *item) { activate(item); });
+  connect(m_results, &QTreeWidget::itemActivated, this,
+          [this](QTreeWidgetItem *item) { activate(item); });
+
+  m_status = new QLabel(this);
+
+  auto *grid = new QGridLayout(this);
+  grid->addWidget(new QLabel("Find:", this), 0, 0);
+  grid->addWidget(m_pattern, 0, 1, 1, 2);
+  grid->addWidget(m_run, 0, 3);
+  grid->addWidget(new QLabel("In:", this), 1, 0);
+  grid->addWidget(m_dir, 1, 1);
+  grid->addWidget(browse, 1, 2);
+  grid->addWidget(new QLabel("Files:", this), 2, 0);
+  grid->addWidget(m_filters, 2, 1, 1, 2);
+  grid->addWidget(m_results, 3, 0, 1, 4);
+  grid->addWidget(m_status, 4, 0, 1, 4);
+
+  m_finder = new FindInFiles(this);
+  connect(m_finder, &FindInFiles::filesMatched, this,
+          &FindInFilesPanel::addResults);
+  connect(m_finder, &FindInFiles::progress, this,
+          &FindInFilesPanel::showProgress);
+  connect(m_finder, &FindInFiles::finished, this,
+          &FindInFilesPanel::searchFinished);
+}
+
+void FindInFilesPanel::setPattern(const QString &pattern) {
+  m_pattern->setText(pattern);
+}
+
+QString FindInFilesPanel::directory() const { return m_dir->text(); }
+
+void FindInFilesPanel::setDirectory(const QString &dir) {
+  m_dir->setText(QDir::toNativeSeparators(dir));
+}
+
+void FindInFilesPanel::focusPattern() {
+  m_pattern->setFocus();
+  m_pattern->selectAll();
+}
+
+void FindInFilesPanel::start() {
+  const QString pattern = m_pattern->text();
+  const QString dir = QDir::fromNativeSeparators(m_dir->text().trimmed());
+  if (pattern.isEmpty())
+    return;
+  if (dir.isEmpty() || !QDir(dir).exists()) {
+    m_status->setText("No such folder");
+    return;
+  }
+  const SearchEngine engine(pattern, m_options);
+  if (!engine.isValid()) {
+    m_status->setText(
+        QString("Invalid regular expression: %1").arg(engine.errorString()));
+    return;
+  }
+
+  QSettings s;
+  s.setValue("findInFiles/dir", m_dir->text());
+  s.setValue("findInFiles/filters", m_filters->text());
+  const QStringList filters = m_filters->text().split(
+      QRegularExpression("[\\s,;]+"), Qt::SkipEmptyParts);
+
+  m_results->clear();
+  m_root = dir;
+  m_matchedFiles = m_hits = 0;
+  m_finder->start(dir, engine, filters);
+  m_run->setText("Stop");
+  m_status->setText("Searching...");
+}
+
+void FindInFilesPanel::stop() { m_finder->cancel(); }
+
+void FindInFilesPanel::addResults(const QVector<FileHits> &files) {
+  const QDir root(m_root);
+  for (const FileHits &file : files) {
+    ++m_matchedFiles;
+    const qint64 shown = m_hits;
+    m_hits += file.hits.size();
+    if (shown >= kMaxShownHits)
+      continue;
+
+    auto *node = new QTreeWidgetItem(m_results);
+    node->setText(0, QString("%1 (%2)")
+                         .arg(QDir::toNativeSeparators(
+                                  root.relativeFilePath(file.path)))
+                         .arg(file.hits.size()));
+    node->setData(0, kPathRole, file.path);
+    node->setData(0, kLineRole, qlonglong(file.hits.first().line));
+    const qsizetype count =
+        qMin<qsizetype>(file.hits.size(), kMaxShownHits - shown);
+    for (qsizetype i = 0; i < count; ++i) {
+      const FileHit &hit = file.hits[i];
+      auto *child = new QTreeWidgetItem(node);
+      child->setText(0, QString("%1: %2")
+                            .arg(hit.line + 1)
+                            .arg(hit.preview.trimmed()));
+      child->setData(0, kPathRole, file.path);
+      child->setData(0, kLineRole, qlonglong(hit.line));
+    }
+    node->setExpanded(true);
+  }
+}
+
+void FindInFilesPanel::showProgress(qint64 files, qint64 bytes) {
+  if (!m_finder->isRunning())
+    return;
+  m_status->setText(QString("Searching... %1 matches in %2 files (%3 files, "
+                            "%4 MB searched)")
+                        .arg(m_hits)
+                        .arg(m_matchedFiles)
+                        .arg(files)
+                        .arg(bytes >> 20));
+}
+
+void FindInFilesPanel::searchFinished(qint64 files, qint64 bytes,
+                                      qint64 msecs, bool cancelled) {
+  m_run->setText("Find");
+  const qint64 nsecs = msecs * 1000000;
+  Telemetry::add(Telemetry::FindInFiles, Telemetry::now() - nsecs, nsecs,
+                 bytes);
+  const double mb = double(bytes) / (1 << 20);
+  const double secs = qMax<qint64>(msecs, 1) / 1000.0;
+  QString text = QString("%1 matches in %2 files; searched %3 files, %4 MB "
+                         "in %5 s (%6 MB/s)")
+                     .arg(m_hits)
+                     .arg(m_matchedFiles)
+                     .arg(files)
+                     .arg(mb, 0, 'f', 1)
+                     .arg(secs, 0, 'f', 2)
+                     .arg(mb / secs, 0, 'f', 0);
+  if (m_hits > kMaxShownHits)
+    text += QString(", first %1 shown").arg(kMaxShownHits);
+  if (cancelled)
+    text.prepend("Stopped: ");
+  m_status->setText(text);
+}
+
+void FindInFilesPanel::activate(QTreeWidgetItem *item) {
+  if (!item)
+    return;
+  emit openRequested(item->data(0, kPathRole).toString(),
+                     qsizetype(item->data(0, kLineRole).toLongLong()));
+}
@@ -1,194 +1,323 @@
 #include "Highlighter.h"
+#include "Telemetry.h"
 #include <QColor>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QPointer>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextLayout>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <array>
+
+namespace {
+constexpr int kSliceBudgetMs = 8;  // per idle slice, keeps input responsive
+constexpr int kJobBlocks = 4096;   // blocks per worker snapshot...
+constexpr int kJobChars = 1 << 20; // ...or this many characters
+} // namespace
 
 Highlighter::Highlighter(QTextDocument *parent) : QSyntaxHighlighter(parent) {
-  buildRules();
+  m_structure = new StructureIndex(parent, this);
+  m_idle = new QTimer(this);
+  m_idle->setInterval(0);
+  connect(m_idle, &QTimer::timeout, this, &Highlighter::highlightSlice);
+
+  if (parent) {
+    connect(parent, &QTextDocument::contentsChange, this,
+            [this](int pos, int, int) {
+              // Invalidates in-flight results; edits can also shift block
+              // numbers under the lazy pass. Text inserted off screen (a
+              // Replace All, a reload) is only coloured by that pass, so it
+              // is restarted from the edit.
+              ++m_revision;
+              const int block = document()->findBlock(pos).blockNumber();
+              if (block < 0)
+                return;
+              if (m_lazy && m_lang != Lang::None)
+                deferFrom(block);
+              else if (block < m_frontier)
+                m_frontier = block;
+            });
+  }
+}
+
+Highlighter::Lang Highlighter::languageFor(const QString &path) {
+  const QString ext = QFileInfo(path).suffix().toLower();
+  if (ext == "cpp" || ext == "cc" || ext == "cxx" || ext == "h" || ext == "hpp")
+    return Lang::Cpp;
+  if (ext == "json")
+    return Lang::Json;
+  if (ext == "md" || ext == "markdown")
+    return Lang::Markdown;
+  return Lang::None;
 }
 
 void Highlighter::setLanguage(Lang lang) {
   if (m_lang == lang)
     return;
   m_lang = lang;
-  rehighlight();
+  m_structure->setLanguage(lang);
+  m_generation = (m_generation + 1) & kGenMask;
+  m_frontier = 0;
+  m_ready.reset();
+
+  if (!m_lazy || m_lang == Lang::None || !document()) {
+    m_idle->stop();
+    rehighlight();
+    return;
+  }
+  highlightRange(m_visibleFirst, m_visibleLast);
+  m_idle->start();
 }
 
-void Highlighter::buildRules() {
-  // Common formats (colors adjust with theme palette; we just pick roles)
-  m_keywordFmt.setForeground(QColor(Qt::blue));
-  m_typeFmt.setForeground(QColor(0, 120, 170));
-  m_stringFmt.setForeground(QColor(0, 130, 0));
-  m_numberFmt.setForeground(QColor(160, 40, 0));
-  m_commentFmt.setForeground(QColor(120, 120, 120));
-  m_funcFmt.setForeground(QColor(150, 0, 150));
-  m_headerFmt.setForeground(QColor(150, 0, 0));
-  m_mdItalicFmt.setFontItalic(true);
-  m_mdBoldFmt.setFontWeight(QFont::Bold);
-  m_mdCodeFmt.setForeground(QColor(120, 80, 0));
+void Highlighter::setVisibleBlocks(int first, int last) {
+  m_visibleFirst = first;
+  m_visibleLast = last;
+  if (m_lazy)
+    highlightRange(first, last);
 }
 
-void Highlighter::highlightBlock(const QString &text) {
-  m_rules.clear();
-
-  if (m_lang == Lang::Cpp) {
-    static const char *kw[] = {"alignas",
-                               "alignof",
-                               "and",
-                               "and_eq",
-                               "asm",
-                               "auto",
-                               "bitand",
-                               "bitor",
-                               "break",
-                               "case",
-                               "catch",
-                               "class",
-                               "compl",
-                               "const",
-                               "constexpr",
-                               "const_cast",
-                               "continue",
-                               "decltype",
-                               "default",
-                               "delete",
-                               "do",
-                               "dynamic_cast",
-                               "else",
-                               "enum",
-                               "explicit",
-                               "export",
-                               "extern",
-                               "false",
-                               "final",
-                               "for",
-                               "friend",
-                               "goto",
-                               "if",
-                               "inline",
-                               "mutable",
-                               "namespace",
-                               "new",
-                               "noexcept",
-                               "not",
-                               "not_eq",
-                               "nullptr",
-                               "operator",
-                               "or",
-                               "or_eq",
-                               "override",
-                               "private",
-                               "protected",
-                               "public",
-                               "register",
-                               "reinterpret_cast",
-                               "return",
-                               "signed",
-                               "sizeof",
-                               "static",
-                               "static_assert",
-                               "static_cast",
-                               "struct",
-                               "switch",
-                               "template",
-                               "this",
-                               "thread_local",
-                               "throw",
-                               "true",
-                               "try",
-                               "typedef",
-                               "typeid",
-                               "typename",
-                               "union",
-                               "unsigned",
-                               "using",
-                               "virtual",
-                               "void",
-                               "volatile",
-                               "while",
-                               "xor",
-                               "xor_eq"};
-    QStringList kwList;
-    for (auto word : kw)
-      kwList << word;
-    QString joined = QString("(?:%1)\\b").arg(kwList.join('|'));
-
-    m_rules.push_back({QRegularExpression(joined), m_keywordFmt});
-    m_rules.push_back({QRegularExpression("\\b(?:int|long|short|char|float|"
-                                          "double|bool|size_t|std::\\w+)\\b"),
-                       m_typeFmt});
-    m_rules.push_back({QRegularExpression(R"("([^"\\]|\\.)*")"), m_stringFmt});
-    m_rules.push_back({QRegularExpression(R"('(?:\\.|[^\\'])')"), m_stringFmt});
-    m_rules.push_back(
-        {QRegularExpression("\\b\\d+(?:\\.\\d+)?\\b"), m_numberFmt});
-    m_rules.push_back({QRegularExpression("//.*$"), m_commentFmt});
-    m_rules.push_back(
-        {QRegularExpression("\\b([A-Za-z_][A-Za-z0-9_]*)\\s*(?=\\()"),
-         m_funcFmt});
-
-    for (const auto &r : m_rules) {
-      auto it = r.pattern.globalMatch(text);
-      while (it.hasNext()) {
-        auto m = it.next();
-        setFormat(m.capturedStart(), m.capturedLength(), r.format);
-      }
+int Highlighter::inputFor(const QTextBlock &block) const {
+  const QTextBlock prev = block.previous();
+  const int state = prev.isValid() ? prev.userState() : -1;
+  return isCurrent(state) ? outOf(state) : Lexer::Normal;
+}
+
+bool Highlighter::isUpToDate(const QTextBlock &block) const {
+  const int state = block.userState();
+  return isCurrent(state) && inOf(state) == inputFor(block);
+}
+
+// Colours the out-of-date blocks in [first, last] on the GUI thread. Each
+// rehighlightBlock() call cascades forward while block states change, which
+// carries the /* */ state through the range.
+void Highlighter::highlightRange(int first, int last) {
+  QTextDocument *doc = document();
+  if (!doc || m_lang == Lang::None || last < first)
+    return;
+
+  m_allowFirst = first;
+  m_allowLast = last;
+  for (QTextBlock b = doc->findBlockByNumber(first);
+       b.isValid() && b.blockNumber() <= last; b = b.next()) {
+    // Folded blocks wait for the lazy pass.
+    if (b.isVisible() && !isUpToDate(b))
+      rehighlightBlock(b);
+  }
+  m_allowFirst = 0;
+  m_allowLast = -1;
+}
+
+void Highlighter::deferFrom(int block) {
+  if (block < m_frontier)
+    m_frontier = block;
+  if (!m_idle->isActive())
+    m_idle->start();
+}
+
+void Highlighter::highlightSlice() {
+  QTextDocument *doc = document();
+  if (!doc || m_lang == Lang::None) {
+    m_idle->stop();
+    return;
+  }
+
+  QElapsedTimer clock;
+  clock.start();
+  if (m_ready && !applyReady(clock))
+    return; // budget spent, continue next slice
+
+  if (m_jobInFlight) {
+    m_idle->stop(); // resumed by jobFinished()
+    return;
+  }
+
+  // Skip what is already coloured, then hand the next run to a worker.
+  int n = m_frontier;
+  QTextBlock b = doc->findBlockByNumber(n);
+  for (; b.isValid() && isUpToDate(b); b = b.next(), ++n) {
+    if ((n & 255) == 0 && clock.elapsed() >= kSliceBudgetMs) {
+      m_frontier = n;
+      return;
     }
-    // Multi-line /* */ comments
-    static QRegularExpression startExp("/\\*");
-    static QRegularExpression endExp("\\*/");
-    int start = 0;
-    if (previousBlockState() != 1)
-      start = text.indexOf(startExp);
-    else
-      start = 0;
-
-    while (start >= 0) {
-      int end = text.indexOf(endExp, start);
-      int len = (end < 0) ? (text.length() - start) : (end - start + 2);
-      setFormat(start, len, m_commentFmt);
-      if (end < 0) {
-        setCurrentBlockState(1);
-        break;
-      } else {
-        setCurrentBlockState(0);
-      }
-      start = text.indexOf(startExp, start + len);
+  }
+  m_frontier = n;
+  m_idle->stop();
+  if (b.isValid())
+    submitJob(b);
+}
+
+// Applies the spans of m_ready until the slice budget runs out. Returns true
+// once the result is used up or turned out to be stale.
+bool Highlighter::applyReady(const QElapsedTimer &clock) {
+  const HighlightResult &r = *m_ready;
+  if (r.generation != m_generation || r.revision != m_revision) {
+    m_ready.reset(); // edited since the snapshot; redo from m_frontier
+    m_readyIndex = 0;
+    return true;
+  }
+
+  const int count = int(r.states.size());
+  QTextBlock b = document()->findBlockByNumber(r.firstBlock + m_readyIndex);
+  m_applying = &r;
+  while (m_readyIndex < count && b.isValid()) {
+    if (b.userState() != r.states[m_readyIndex])
+      rehighlightBlock(b);
+    ++m_readyIndex;
+    b = b.next();
+    if (clock.elapsed() >= kSliceBudgetMs)
+      break;
+  }
+  m_applying = nullptr;
+  m_frontier = r.firstBlock + m_readyIndex;
+
+  if (m_readyIndex < count && b.isValid())
+    return false;
+  m_ready.reset();
+  m_readyIndex = 0;
+  return true;
+}
+
+void Highlighter::submitJob(const QTextBlock &from) {
+  QStringList texts;
+  int chars = 0;
+  for (QTextBlock b = from;
+       b.isValid() && texts.size() < kJobBlocks && chars < kJobChars;
+       b = b.next()) {
+    texts << b.text();
+    chars += b.length();
+  }
+
+  m_jobInFlight = true;
+  const Lang lang = m_lang;
+  const int generation = m_generation;
+  const quint64 revision = m_revision;
+  const int firstBlock = from.blockNumber();
+  const int in = inputFor(from);
+  QPointer<Highlighter> self(this);
+  QThreadPool::globalInstance()->start([=] {
+    HighlightResult r = tokenize(lang, generation, texts, in);
+    r.revision = revision;
+    r.firstBlock = firstBlock;
+    if (auto *app = QCoreApplication::instance()) {
+      QMetaObject::invokeMethod(
+          app,
+          [self, r] {
+            if (self)
+              self->jobFinished(r);
+          },
+          Qt::QueuedConnection);
     }
-    if (start < 0 && previousBlockState() == 1)
-      setCurrentBlockState(1);
-
-  } else if (m_lang == Lang::Json) {
-    m_rules.push_back(
-        {QRegularExpression(R"("([^"\\]|\\.)*"\s*:)"), m_headerFmt}); // keys
-    m_rules.push_back({QRegularExpression(R"("([^"\\]|\\.)*")"), m_stringFmt});
-    m_rules.push_back(
-        {QRegularExpression("\\b\\d+(?:\\.\\d+)?\\b"), m_numberFmt});
-    m_rules.push_back(
-        {QRegularExpression("\\b(true|false|null)\\b"), m_keywordFmt});
-
-    for (const auto &r : m_rules) {
-      auto it = r.pattern.globalMatch(text);
-      while (it.hasNext()) {
-        auto m = it.next();
-        int start = m.capturedStart();
-        int len = m.capturedLength();
-        setFormat(start, len, r.format);
+  });
+}
+
+void Highlighter::jobFinished(const HighlightResult &result) {
+  m_jobInFlight = false;
+  if (result.generation == m_generation && result.revision == m_revision) {
+    m_ready = result;
+    m_readyIndex = 0;
+  }
+  m_idle->start();
+}
+
+// Runs on a worker thread: touches nothing but its arguments.
+HighlightResult Highlighter::tokenize(Lang lang, int generation,
+                                      const QStringList &texts, int in) {
+  Telemetry::Scope timer(Telemetry::HighlightJob);
+  timer.setAmount(texts.size());
+  HighlightResult r;
+  r.generation = generation;
+  r.tokenEnd.reserve(texts.size());
+  r.states.reserve(texts.size());
+  r.structure.reserve(texts.size());
+  for (const QString &text : texts) {
+    const qsizetype begin = r.tokens.size();
+    const int out = Lexer::lex(lang, text, in, r.tokens);
+    r.structure.push_back(StructureIndex::summarize(
+        lang, text, r.tokens.constData() + begin, r.tokens.size() - begin));
+    r.tokenEnd.push_back(int(r.tokens.size()));
+    r.states.push_back(packState(generation, in, out));
+    in = out;
+  }
+  return r;
+}
+
+const QTextCharFormat *Highlighter::formats() {
+  static const auto table = [] {
+    std::array<QTextCharFormat, int(TokenKind::Count)> f;
+    // Common formats (colors adjust with theme palette; we just pick roles)
+    f[int(TokenKind::Keyword)].setForeground(QColor(Qt::blue));
+    f[int(TokenKind::Type)].setForeground(QColor(0, 120, 170));
+    f[int(TokenKind::String)].setForeground(QColor(0, 130, 0));
+    f[int(TokenKind::Number)].setForeground(QColor(160, 40, 0));
+    f[int(TokenKind::Comment)].setForeground(QColor(120, 120, 120));
+    f[int(TokenKind::Function)].setForeground(QColor(150, 0, 150));
+    f[int(TokenKind::Header)].setForeground(QColor(150, 0, 0));
+    f[int(TokenKind::Italic)].setFontItalic(true);
+    f[int(TokenKind::Bold)].setFontWeight(QFont::Bold);
+    f[int(TokenKind::Code)].setForeground(QColor(120, 80, 0));
+    return f;
+  }();
+  return table.data();
+}
+
+void Highlighter::highlightBlock(const QString &text) {
+  if (m_lang == Lang::None) {
+    m_structure->update(currentBlock(), {});
+    return;
+  }
+
+  Telemetry::Scope timer(Telemetry::HighlightBlock);
+  const QTextCharFormat *fmt = formats();
+  const QTextBlock block = currentBlock();
+
+  if (m_applying) {
+    const int i = block.blockNumber() - m_applying->firstBlock;
+    if (i >= 0 && i < m_applying->states.size()) {
+      const int begin = i ? m_applying->tokenEnd[i - 1] : 0;
+      for (int k = begin; k < m_applying->tokenEnd[i]; ++k) {
+        const Token &t = m_applying->tokens[k];
+        setFormat(t.start, t.length, fmt[int(t.kind)]);
       }
+      setCurrentBlockState(m_applying->states[i]);
+      m_structure->update(block, m_applying->structure[i]);
+      return;
     }
+  }
 
-  } else if (m_lang == Lang::Markdown) {
-    m_rules.push_back({QRegularExpression(R"(^\s{0,3}(#{1,6})\s.+)"),
-                       m_headerFmt}); // headers
-    m_rules.push_back({QRegularExpression(R"(\*\*[^*]+\*\*)"), m_mdBoldFmt});
-    m_rules.push_back({QRegularExpression(R"(_[^_]+_)"), m_mdItalicFmt});
-    m_rules.push_back({QRegularExpression(R"(`[^`]+`)"), m_mdCodeFmt});
-
-    for (const auto &r : m_rules) {
-      auto it = r.pattern.globalMatch(text);
-      while (it.hasNext()) {
-        auto m = it.next();
-        setFormat(m.capturedStart(), m.capturedLength(), r.format);
-      }
+  const int prev = previousBlockState();
+  const int in = isCurrent(prev) ? outOf(prev) : Lexer::Normal;
+
+  if (m_lazy) {
+    const int n = block.blockNumber();
+    const bool onScreen = (n >= m_visibleFirst && n <= m_visibleLast) ||
+                          (n >= m_allowFirst && n <= m_allowLast);
+    const int stored = currentBlockState();
+    // Not reached by the lazy pass yet: leaving the state untouched stops
+    // QSyntaxHighlighter's cascade here, so the pass has to get this far.
+    if (!onScreen && !isCurrent(stored)) {
+      deferFrom(n);
+      return;
+    }
+    if (!onScreen && inOf(stored) != in) {
+      // Off-screen tail of a state cascade (e.g. a new "/*"): keep the old
+      // spans for now and let the workers redo the rest of the document.
+      for (const auto &r : block.layout()->formats())
+        setFormat(r.start, r.length, r.format);
+      deferFrom(n);
+      return;
     }
-  } else {
-    // Lang::None -> no highlighting
   }
+
+  m_tokens.clear();
+  const int out = Lexer::lex(m_lang, text, in, m_tokens);
+  for (const Token &t : m_tokens)
+    setFormat(t.start, t.length, fmt[int(t.kind)]);
+  setCurrentBlockState(packState(m_generation, in, out));
+  m_structure->update(block, StructureIndex::summarize(m_lang, text,
+                                                       m_tokens.constData(),
+                                                       m_tokens.size()));
 }
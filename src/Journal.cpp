@@ -0,0 +1,324 @@
+#include "Journal.h"
+#include "EditorWidget.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTextDocument>
+#include <QThreadPool>
+#include <QTimer>
+#include <QUuid>
+
+namespace {
+constexpr quint32 kMagic = 0x4e504a31; // "NPJ1"
+constexpr auto kStreamVersion = QDataStream::Qt_6_0;
+constexpr int kFlushMs = 1000;
+constexpr qsizetype kFlushBytes = 1 << 20;
+constexpr qint64 kMinCompactBytes = 4 << 20;
+
+struct FileStamp {
+  qint64 size = -1;
+  qint64 modified = 0;
+};
+
+FileStamp stampOf(const QString &path) {
+  const QFileInfo info(path);
+  if (path.isEmpty() || !info.isFile())
+    return {};
+  return {info.size(), info.lastModified().toMSecsSinceEpoch()};
+}
+
+// Base layout: magic, generation, file path, whether the base is that file,
+// its size and mtime, then (for a snapshot) the text as raw UTF-16.
+bool writeBase(const QString &path, qint64 generation,
+               const QString &filePath, const FileStamp *file,
+               const PieceTable *text) {
+  QSaveFile out(path);
+  if (!out.open(QIODevice::WriteOnly))
+    return false;
+  QDataStream s(&out);
+  s.setVersion(kStreamVersion);
+  s << kMagic << generation << filePath << bool(file)
+    << (file ? file->size : qint64(-1)) << (file ? file->modified : qint64(0));
+  if (text) {
+    s << qint64(text->length());
+    text->forEachChunk([&](QStringView chunk) {
+      s.writeRawData(reinterpret_cast<const char *>(chunk.utf16()),
+                     int(chunk.size() * sizeof(char16_t)));
+    });
+  }
+  return s.status() == QDataStream::Ok && out.commit();
+}
+
+bool readJournal(const QString &base, const QString &logPattern,
+                 Journal::Recovery &r) {
+  QFile in(base);
+  if (!in.open(QIODevice::ReadOnly))
+    return false;
+  QDataStream s(&in);
+  s.setVersion(kStreamVersion);
+  quint32 magic = 0;
+  qint64 generation = 0, size = 0, modified = 0;
+  s >> magic >> generation >> r.filePath >> r.fromFile >> size >> modified;
+  if (s.status() != QDataStream::Ok || magic != kMagic)
+    return false;
+  if (r.fromFile) {
+    // The log only applies to the file exactly as it was.
+    const FileStamp now = stampOf(r.filePath);
+    if (now.size != size || now.modified != modified)
+      return false;
+  } else {
+    qint64 length = 0;
+    s >> length;
+    if (s.status() != QDataStream::Ok || length < 0 ||
+        length * qint64(sizeof(char16_t)) > in.size())
+      return false;
+    r.text.resize(length);
+    if (s.readRawData(reinterpret_cast<char *>(r.text.data()),
+                      int(length * sizeof(char16_t))) !=
+        length * qint64(sizeof(char16_t)))
+      return false;
+  }
+
+  // A crash can cut the last batch short; everything before it is kept.
+  QFile log(logPattern.arg(generation));
+  if (!log.open(QIODevice::ReadOnly))
+    return true;
+  QDataStream l(&log);
+  l.setVersion(kStreamVersion);
+  while (!l.atEnd()) {
+    Journal::Edit e;
+    qint64 pos = 0, removed = 0;
+    l >> pos >> removed >> e.text;
+    if (l.status() != QDataStream::Ok)
+      break;
+    e.pos = pos;
+    e.removed = removed;
+    r.edits.push_back(std::move(e));
+  }
+  return true;
+}
+
+void removeFiles(const QString &id) {
+  QDir dir(Journal::directory());
+  dir.remove(id + ".base");
+  for (const QString &log : dir.entryList({id + ".*.log"}, QDir::Files))
+    dir.remove(log);
+}
+} // namespace
+
+// Runs one journal's file operations in order on the global pool.
+struct Journal::Lane {
+  QMutex mutex;
+  QVector<std::function<void()>> tasks;
+  bool running = false;
+};
+
+Journal::Journal(EditorWidget *editor)
+    : QObject(editor),
+      m_id(QUuid::createUuid().toString(QUuid::WithoutBraces)),
+      m_lane(std::make_shared<Lane>()) {
+  m_flushTimer = new QTimer(this);
+  m_flushTimer->setSingleShot(true);
+  m_flushTimer->setInterval(kFlushMs);
+  connect(m_flushTimer, &QTimer::timeout, this, &Journal::flush);
+  setEditor(editor);
+}
+
+void Journal::setEditor(EditorWidget *editor) {
+  if (m_editor) {
+    flush();
+    disconnect(m_editor, nullptr, this, nullptr);
+  }
+  m_editor = editor;
+  setParent(editor);
+  if (!editor)
+    return;
+  connect(editor, &EditorWidget::bufferEdited, this, &Journal::record);
+  connect(editor, &EditorWidget::bufferReset, this, [this] {
+    if (!m_clean && !m_editor->isLoading())
+      snapshot();
+  });
+}
+
+Journal::~Journal() { discard(); }
+
+QString Journal::directory() {
+  return QStandardPaths::writableLocation(
+             QStandardPaths::AppLocalDataLocation) +
+         "/recovery";
+}
+
+QString Journal::basePath() const {
+  return directory() + '/' + m_id + ".base";
+}
+
+QString Journal::logPath(qint64 generation) const {
+  return directory() + '/' + m_id + '.' + QString::number(generation) +
+         ".log";
+}
+
+void Journal::enqueue(std::function<void()> task) {
+  std::shared_ptr<Lane> lane = m_lane;
+  QMutexLocker lock(&lane->mutex);
+  lane->tasks.push_back(std::move(task));
+  if (lane->running)
+    return;
+  lane->running = true;
+  QThreadPool::globalInstance()->start([lane] {
+    for (;;) {
+      QVector<std::function<void()>> tasks;
+      {
+        QMutexLocker lock(&lane->mutex);
+        tasks.swap(lane->tasks);
+        if (tasks.isEmpty()) {
+          lane->running = false;
+          return;
+        }
+      }
+      for (const auto &task : tasks)
+        task();
+    }
+  });
+}
+
+// Marks the journal as this process's, so other instances leave it alone.
+bool Journal::ensureLocked() {
+  if (m_lock)
+    return true;
+  QDir().mkpath(directory());
+  auto lock =
+      std::make_shared<QLockFile>(directory() + '/' + m_id + ".lock");
+  if (!lock->tryLock(0))
+    return false;
+  m_lock = lock;
+  return true;
+}
+
+void Journal::record(qsizetype pos, qsizetype removed, const QString &text) {
+  if (m_editor->isLoading())
+    return;
+
+  if (m_clean) {
+    // First edit since the editor matched its file: the file is the base.
+    // Otherwise the snapshot already holds this edit.
+    const FileStamp now = stampOf(m_cleanPath);
+    if (m_cleanSize < 0 || now.size != m_cleanSize ||
+        now.modified != m_cleanModified) {
+      snapshot();
+      return;
+    }
+    if (!ensureLocked())
+      return;
+    m_clean = false;
+    const qint64 generation = ++m_generation;
+    const QString base = basePath(), filePath = m_cleanPath;
+    const FileStamp file{m_cleanSize, m_cleanModified};
+    m_logBytes = 0;
+    enqueue([base, generation, filePath, file] {
+      writeBase(base, generation, filePath, &file, nullptr);
+    });
+  }
+
+  QDataStream out(&m_pending, QIODevice::Append);
+  out.setVersion(kStreamVersion);
+  out << qint64(pos) << qint64(removed) << text;
+  if (m_pending.size() >= kFlushBytes)
+    flush();
+  else if (!m_flushTimer->isActive())
+    m_flushTimer->start();
+}
+
+void Journal::flush() {
+  m_flushTimer->stop();
+  if (m_clean || m_pending.isEmpty())
+    return;
+  m_logBytes += m_pending.size();
+  const QByteArray bytes = std::exchange(m_pending, QByteArray());
+  const QString log = logPath(m_generation);
+  enqueue([log, bytes] {
+    QFile f(log);
+    if (f.open(QIODevice::WriteOnly | QIODevice::Append))
+      f.write(bytes);
+  });
+
+  // Compact once replaying the log would cost more than the text itself.
+  if (!m_editor)
+    return;
+  const qint64 textBytes =
+      m_editor->buffer().length() * qint64(sizeof(char16_t));
+  if (m_logBytes > qMax(kMinCompactBytes, textBytes))
+    snapshot();
+}
+
+// The new base is written under the next generation before the old log is
+// deleted, so a crash in between still leaves a consistent pair.
+void Journal::snapshot() {
+  if (!m_editor || !ensureLocked())
+    return;
+  m_clean = false;
+  m_flushTimer->stop();
+  m_pending.clear();
+  m_logBytes = 0;
+
+  const qint64 generation = ++m_generation;
+  const QString base = basePath(), oldLog = logPath(generation - 1);
+  const QString filePath = m_editor->filePath();
+  const PieceTable text = m_editor->buffer(); // shared, not copied
+  enqueue([base, generation, filePath, text, oldLog] {
+    if (writeBase(base, generation, filePath, nullptr, &text))
+      QFile::remove(oldLog);
+  });
+}
+
+void Journal::markClean() {
+  if (!m_editor)
+    return;
+  if (m_editor->document()->isModified()) {
+    snapshot(); // edited again while the save was running
+    return;
+  }
+  discard();
+  m_cleanPath = m_editor->filePath();
+  const FileStamp file = stampOf(m_cleanPath);
+  m_cleanSize = file.size;
+  m_cleanModified = file.modified;
+}
+
+void Journal::discard() {
+  m_flushTimer->stop();
+  m_pending.clear();
+  m_clean = true;
+  if (!m_lock)
+    return;
+  // The lock goes with the files, after any writes still queued.
+  const QString id = m_id;
+  std::shared_ptr<QLockFile> lock = std::move(m_lock);
+  enqueue([id, lock] { removeFiles(id); });
+}
+
+QVector<Journal::Recovery> Journal::recover() {
+  QVector<Recovery> found;
+  QDir dir(directory());
+  for (const QString &name : dir.entryList({"*.base"}, QDir::Files)) {
+    Recovery r;
+    r.id = QFileInfo(name).completeBaseName();
+    r.lock = std::make_shared<QLockFile>(dir.filePath(r.id + ".lock"));
+    // Only a lock whose process is gone counts as stale, however old.
+    r.lock->setStaleLockTime(0);
+    if (!r.lock->tryLock(0))
+      continue; // another instance's live journal
+    if (readJournal(dir.filePath(name), dir.filePath(r.id + ".%1.log"), r))
+      found.push_back(std::move(r));
+    else
+      removeFiles(r.id);
+  }
+  return found;
+}
+
+void Journal::remove(const Recovery &recovery) { removeFiles(recovery.id); }
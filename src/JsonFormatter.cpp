@@ -0,0 +1,433 @@
+#include "JsonFormatter.h"
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define NOTEPAD_X86_64 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+// Number states; the complete ones are Zero, Int, Frac and Exp.
+enum Number : quint8 { Start, Minus, Zero, Int, Dot, Frac, E, ESign, Exp };
+
+bool isSpace(char16_t c) {
+  return c == u' ' || c == u'\n' || c == u'\r' || c == u'\t';
+}
+
+bool isDigit(char16_t c) { return c >= u'0' && c <= u'9'; }
+
+bool isHex(char16_t c) {
+  return isDigit(c) || (c >= u'a' && c <= u'f') || (c >= u'A' && c <= u'F');
+}
+
+bool isNumberChar(char16_t c) {
+  return isDigit(c) || c == u'-' || c == u'+' || c == u'.' || c == u'e' ||
+         c == u'E';
+}
+
+// Index of the first character at or after i that is not JSON whitespace,
+// or n.
+qsizetype skipSpace(const char16_t *s, qsizetype i, qsizetype n) {
+  // Mostly a single space or a line break and indentation.
+  if (i < n && !isSpace(s[i]))
+    return i;
+#ifdef NOTEPAD_X86_64
+  const __m128i space = _mm_set1_epi16(' '), lf = _mm_set1_epi16('\n'),
+                cr = _mm_set1_epi16('\r'), tab = _mm_set1_epi16('\t');
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    const __m128i hit =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, space),
+                                  _mm_cmpeq_epi16(v, lf)),
+                     _mm_or_si128(_mm_cmpeq_epi16(v, cr),
+                                  _mm_cmpeq_epi16(v, tab)));
+    const std::uint32_t other = std::uint32_t(_mm_movemask_epi8(hit)) ^ 0xffff;
+    if (other)
+      return i + std::countr_zero(other) / 2;
+  }
+#endif
+  while (i < n && isSpace(s[i]))
+    ++i;
+  return i;
+}
+
+// Index of the first '"', '\\' or control character at or after i, or n:
+// everything else in a string is copied through as it is.
+qsizetype findSpecial(const char16_t *s, qsizetype i, qsizetype n) {
+#ifdef NOTEPAD_X86_64
+  const __m128i quote = _mm_set1_epi16('"'), backslash = _mm_set1_epi16('\\'),
+                control = _mm_set1_epi16(0x1f);
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    // Unsigned v <= 0x1f: the saturating difference is zero.
+    const __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi16(v, quote), _mm_cmpeq_epi16(v, backslash)),
+        _mm_cmpeq_epi16(_mm_subs_epu16(v, control), _mm_setzero_si128()));
+    const std::uint32_t mask = std::uint32_t(_mm_movemask_epi8(hit));
+    if (mask)
+      return i + std::countr_zero(mask) / 2;
+  }
+#endif
+  while (i < n && s[i] != u'"' && s[i] != u'\\' && s[i] >= 0x20)
+    ++i;
+  return i;
+}
+} // namespace
+
+JsonFormatter::JsonFormatter(Mode mode, int indent)
+    : m_mode(mode), m_indent(indent) {}
+
+void JsonFormatter::reserve(qsizetype chars) {
+  if (m_mode != Mode::Validate)
+    m_out.reserve(chars);
+}
+
+void JsonFormatter::fail(qsizetype pos, const QString &message) {
+  m_errorPos = pos;
+  m_error = message;
+  m_out.clear();
+}
+
+// A line break and the indentation for `depth`, appended in one piece.
+void JsonFormatter::newline(qsizetype depth) {
+  const qsizetype width = 1 + depth * m_indent;
+  if (m_lineStart.size() < width) {
+    m_lineStart = QString(qMax<qsizetype>(width, 256), u' ');
+    m_lineStart[0] = u'\n';
+  }
+  m_out.append(QStringView(m_lineStart).left(width));
+}
+
+// A value or key starts at i; in pretty mode, the first one of a container
+// goes on a line of its own.
+void JsonFormatter::beginValue(qsizetype i) {
+  if (m_pendingOpen) {
+    flush(i);
+    newline(m_stack.size());
+    m_pendingOpen = false;
+  }
+}
+
+void JsonFormatter::valueDone() {
+  m_expect = m_stack.isEmpty() ? Expect::Done : Expect::CommaOrEnd;
+}
+
+bool JsonFormatter::numberStep(char16_t c) {
+  const bool digit = isDigit(c);
+  switch (m_number) {
+  case Start:
+    m_number = c == u'-' ? Minus : c == u'0' ? Zero : digit ? Int : 0xff;
+    break;
+  case Minus:
+    m_number = c == u'0' ? Zero : digit ? Int : 0xff;
+    break;
+  case Zero:
+  case Int:
+  case Frac:
+    if (digit && m_number != Zero)
+      break;
+    m_number = c == u'.' && m_number != Frac ? Dot
+               : c == u'e' || c == u'E'      ? E
+                                             : 0xff;
+    break;
+  case Dot:
+    m_number = digit ? Frac : 0xff;
+    break;
+  case E:
+    m_number = c == u'+' || c == u'-' ? ESign : digit ? Exp : 0xff;
+    break;
+  case ESign:
+  case Exp:
+    m_number = digit ? Exp : 0xff;
+    break;
+  default:
+    return false;
+  }
+  return m_number != 0xff;
+}
+
+bool JsonFormatter::numberComplete() const {
+  return m_number == Zero || m_number == Int || m_number == Frac ||
+         m_number == Exp;
+}
+
+// Consumed input is copied to the output in runs: everything but the
+// whitespace between tokens goes through unchanged, and pretty printing
+// only adds line breaks and spaces between runs.
+void JsonFormatter::flush(qsizetype to) {
+  if (m_mode != Mode::Validate && to > m_run)
+    m_out.append(QStringView(m_chunk + m_run, to - m_run));
+  m_run = to;
+}
+
+// Reads string characters from i; returns where the string or the piece
+// ended.
+qsizetype JsonFormatter::scanString(const char16_t *s, qsizetype i,
+                                    qsizetype n) {
+  while (i < n) {
+    if (m_hex) {
+      if (!isHex(s[i])) {
+        fail(m_base + i, "Invalid \\u escape");
+        return n;
+      }
+      --m_hex;
+      ++i;
+      continue;
+    }
+    if (m_escape) {
+      const char16_t c = s[i];
+      if (c == u'u')
+        m_hex = 4;
+      else if (!QStringView(u"\"\\/bfnrt").contains(QChar(c))) {
+        fail(m_base + i, "Invalid escape sequence");
+        return n;
+      }
+      m_escape = false;
+      ++i;
+      continue;
+    }
+    i = findSpecial(s, i, n);
+    if (i == n)
+      break;
+    if (s[i] == u'\\') {
+      m_escape = true;
+      ++i;
+      continue;
+    }
+    if (s[i] != u'"') {
+      fail(m_base + i, "Control character in string");
+      return n;
+    }
+    m_token = Token::None;
+    if (m_key)
+      m_expect = Expect::Colon;
+    else
+      valueDone();
+    return i + 1;
+  }
+  return i;
+}
+
+qsizetype JsonFormatter::scanNumber(const char16_t *s, qsizetype i,
+                                    qsizetype n) {
+  for (; i < n; ++i) {
+    const char16_t c = s[i];
+    if (isDigit(c) && (m_number == Int || m_number == Frac || m_number == Exp))
+      continue;
+    if (!isNumberChar(c))
+      break;
+    if (!numberStep(c)) {
+      fail(m_base + i, "Invalid number");
+      return n;
+    }
+  }
+  if (i < n) {
+    if (!numberComplete()) {
+      fail(m_base + i, "Invalid number");
+      return n;
+    }
+    m_token = Token::None;
+    valueDone();
+  }
+  return i;
+}
+
+qsizetype JsonFormatter::scanLiteral(const char16_t *s, qsizetype i,
+                                     qsizetype n) {
+  for (; i < n && m_literal[m_literalPos]; ++i, ++m_literalPos) {
+    if (s[i] != char16_t(m_literal[m_literalPos])) {
+      fail(m_base + i, "Invalid literal");
+      return n;
+    }
+  }
+  if (!m_literal[m_literalPos]) {
+    m_token = Token::None;
+    valueDone();
+  }
+  return i;
+}
+
+// '}' or ']' at i closes the innermost container.
+bool JsonFormatter::close(qsizetype i, char16_t c) {
+  if (m_stack.back() != (c == u'}' ? '{' : '[')) {
+    fail(m_base + i, QString("Expected '%1'")
+                         .arg(QChar(m_stack.back() == '{' ? u'}' : u']')));
+    return false;
+  }
+  m_stack.chop(1);
+  if (m_mode == Mode::Pretty && !m_pendingOpen) {
+    flush(i);
+    newline(m_stack.size());
+  }
+  m_pendingOpen = false;
+  valueDone();
+  return true;
+}
+
+// A value starts with c at i.
+bool JsonFormatter::startValue(qsizetype i, char16_t c) {
+  switch (c) {
+  case u'{':
+  case u'[':
+    beginValue(i);
+    m_stack.append(char(c));
+    m_expect = c == u'{' ? Expect::FirstKey : Expect::FirstValue;
+    m_pendingOpen = m_mode == Mode::Pretty;
+    return true;
+  case u'"':
+    beginValue(i);
+    m_key = false;
+    m_token = Token::String;
+    return true;
+  case u't':
+  case u'f':
+  case u'n':
+    beginValue(i);
+    m_literal = c == u't' ? "true" : c == u'f' ? "false" : "null";
+    m_literalPos = 1;
+    m_token = Token::Literal;
+    return true;
+  default:
+    m_number = Start;
+    if (!numberStep(c)) {
+      fail(m_base + i, "Expected a value");
+      return false;
+    }
+    beginValue(i);
+    m_token = Token::Number;
+    return true;
+  }
+}
+
+// Dispatches on what the grammar expects next rather than on the
+// character, which keeps the branches predictable.
+void JsonFormatter::feed(QStringView chunk) {
+  if (hasError())
+    return;
+  const auto *s = reinterpret_cast<const char16_t *>(chunk.utf16());
+  const qsizetype n = chunk.size();
+  const bool pretty = m_mode == Mode::Pretty;
+  m_chunk = s;
+  m_run = 0;
+  qsizetype i = 0;
+  while (i < n) {
+    // A token carries on from the previous piece, or was just started.
+    if (m_token != Token::None) {
+      if (m_token == Token::String)
+        i = scanString(s, i, n);
+      else if (m_token == Token::Number)
+        i = scanNumber(s, i, n);
+      else
+        i = scanLiteral(s, i, n);
+      if (hasError())
+        return;
+      if (i == n)
+        break;
+    }
+
+    const char16_t c = s[i];
+    if (isSpace(c)) {
+      flush(i);
+      i = skipSpace(s, i + 1, n);
+      m_run = i;
+      continue;
+    }
+    bool ok = true;
+    switch (m_expect) {
+    case Expect::Colon:
+      if (c != u':') {
+        fail(m_base + i, "Expected ':'");
+        return;
+      }
+      if (pretty) {
+        flush(i + 1);
+        m_out.append(u' ');
+      }
+      m_expect = Expect::Value;
+      break;
+    case Expect::CommaOrEnd:
+      if (c == u',') {
+        if (pretty) {
+          flush(i + 1);
+          newline(m_stack.size());
+        }
+        m_expect = m_stack.back() == '{' ? Expect::Key : Expect::Value;
+      } else if (c == u'}' || c == u']') {
+        ok = close(i, c);
+      } else {
+        fail(m_base + i, QString("Expected ',' or '%1'")
+                             .arg(QChar(m_stack.back() == '{' ? u'}' : u']')));
+        return;
+      }
+      break;
+    case Expect::FirstKey:
+    case Expect::Key:
+      if (c == u'}' && m_expect == Expect::FirstKey) {
+        ok = close(i, c);
+      } else if (c == u'"') {
+        beginValue(i);
+        m_key = true;
+        m_token = Token::String;
+      } else {
+        fail(m_base + i, "Expected a string key");
+        return;
+      }
+      break;
+    case Expect::FirstValue:
+    case Expect::Value:
+      if (c == u']' && m_expect == Expect::FirstValue)
+        ok = close(i, c);
+      else
+        ok = startValue(i, c);
+      break;
+    case Expect::Done:
+      fail(m_base + i, "Text after the JSON value");
+      return;
+    }
+    if (!ok)
+      return;
+    ++i;
+    // Mostly ", " or ": ": one space needs no trip round the loop.
+    if (m_token == Token::None && i + 1 < n && s[i] == u' ' &&
+        !isSpace(s[i + 1])) {
+      flush(i);
+      m_run = ++i;
+    }
+  }
+  flush(n);
+  m_base += n;
+}
+
+bool JsonFormatter::finish() {
+  if (hasError())
+    return false;
+  switch (m_token) {
+  case Token::String:
+    fail(m_base, "Unterminated string");
+    return false;
+  case Token::Literal:
+    fail(m_base, "Invalid literal");
+    return false;
+  case Token::Number:
+    if (!numberComplete()) {
+      fail(m_base, "Invalid number");
+      return false;
+    }
+    m_token = Token::None;
+    valueDone();
+    break;
+  case Token::None:
+    break;
+  }
+  if (m_expect != Expect::Done) {
+    fail(m_base, m_stack.isEmpty()
+                     ? QString("Expected a JSON value")
+                     : QString("Unclosed '%1'").arg(QChar(m_stack.back())));
+    return false;
+  }
+  if (m_mode == Mode::Pretty)
+    m_out.append(u'\n');
+  return true;
+}
@@ -0,0 +1,617 @@
+#include "LargeFileView.h"
+#include "NewlineScan.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPointer>
+#include <QScrollBar>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <limits>
+
+namespace {
+constexpr int kMargin = 4;
+constexpr qint64 kMaxLineBytes = 16 * 1024; // longer lines are cut on screen
+constexpr qint64 kReportBytes = 64 << 20;   // index batch posted to the GUI
+constexpr qint64 kHeadBytes = 4096; // what EncodingDetector::begin() looks at
+constexpr qint64 kFindWindowBytes = 4 << 20; // searched between cancel checks
+// Text a window borrows from each side where it cuts a line, so matches
+// across the cut are still found whole; longer matches are not.
+constexpr qint64 kFindContextBytes = 64 << 10;
+
+const char *findByte(const char *p, char c, qint64 n) {
+  return static_cast<const char *>(std::memchr(p, c, size_t(n)));
+}
+
+// Start of the line holding `pos`, looking back no further than `from`.
+qint64 lineBeginAt(const char *data, qint64 pos, qint64 from = 0) {
+  while (pos > from && data[pos - 1] != '\n')
+    --pos;
+  return pos;
+}
+
+bool isLineStart(const char *data, qint64 pos) {
+  return pos == 0 || data[pos - 1] == '\n';
+}
+
+// Just past the first '\n' in [pos, stop), or stop.
+qint64 lineEndAt(const char *data, qint64 stop, qint64 pos) {
+  const char *hit = findByte(data + pos, '\n', stop - pos);
+  return hit ? hit - data + 1 : stop;
+}
+
+// Start of the UTF-8 sequence holding data[pos].
+qint64 charStart(const char *data, qint64 pos) {
+  for (int i = 0; i < 3 && pos > 0 && (uchar(data[pos]) & 0xC0) == 0x80; ++i)
+    --pos;
+  return pos;
+}
+
+QString decode(const char *s, qint64 n, bool latin1) {
+  return latin1 ? QString::fromLatin1(s, n) : QString::fromUtf8(s, n);
+}
+
+// UTF-16 length of s[0, n) as decode() turns it out for Latin-1 or valid
+// UTF-8, without decoding it.
+qsizetype utf16Length(const char *s, qint64 n, bool latin1) {
+  if (latin1)
+    return n;
+  qsizetype units = 0;
+  for (qint64 i = 0; i < n; ++i) {
+    const uchar c = uchar(s[i]);
+    units += (c & 0xC0) != 0x80;
+    units += c >= 0xF0; // surrogate pair
+  }
+  return units;
+}
+
+// End of the window from `pos`: whole lines up to kFindWindowBytes or, when
+// a line runs on past another window, a character boundary inside it.
+qint64 windowEnd(const char *data, qint64 pos, qint64 stop) {
+  if (stop - pos <= kFindWindowBytes)
+    return stop;
+  const qint64 at = pos + kFindWindowBytes;
+  const qint64 to =
+      lineEndAt(data, qMin(at + kFindWindowBytes, stop), at - 1);
+  return to == stop || isLineStart(data, to) ? to : charStart(data, at);
+}
+
+// Start of the window ending at `pos`; the mirror of windowEnd().
+qint64 windowBegin(const char *data, qint64 begin, qint64 pos) {
+  if (pos - begin <= kFindWindowBytes)
+    return begin;
+  const qint64 at = pos - kFindWindowBytes;
+  const qint64 from =
+      lineBeginAt(data, at, qMax(begin, at - kFindWindowBytes));
+  return isLineStart(data, from) ? from : charStart(data, at);
+}
+
+// The bytes [from, ...) decoded around one segment of a search. Matches
+// count only if they start in the segment, characters [first, last) of
+// `text`; the rest is context taken where the segment cuts a line.
+struct Window {
+  qint64 from = 0;
+  QString text;
+  qsizetype first = 0;
+  qsizetype last = 0;
+};
+
+Window decodeWindow(const char *data, bool latin1, qint64 begin, qint64 stop,
+                    qint64 segment, qint64 segmentEnd) {
+  Window w;
+  w.from = segment;
+  if (!isLineStart(data, segment))
+    w.from = charStart(data, qMax(begin, segment - kFindContextBytes));
+  qint64 to = segmentEnd;
+  if (segmentEnd < stop && !isLineStart(data, segmentEnd))
+    to = segmentEnd + kFindContextBytes < stop
+             ? charStart(data, segmentEnd + kFindContextBytes)
+             : stop;
+  w.text = decode(data + w.from, to - w.from, latin1);
+  w.first = utf16Length(data + w.from, segment - w.from, latin1);
+  w.last = w.text.size() -
+           utf16Length(data + segmentEnd, to - segmentEnd, latin1);
+  return w;
+}
+
+// A match as the view shows it: the byte offset of its line, and its column
+// and length in characters of that line.
+struct ViewerMatch {
+  qint64 line = -1;
+  qsizetype column = 0;
+  qsizetype length = 0;
+};
+
+// `m` was found in `w`. Decoding keeps every '\n', so lines correspond one
+// to one; a match on a line the window starts inside of counts its column
+// from where that line begins.
+ViewerMatch locate(const char *data, qint64 end, bool latin1, const Window &w,
+                   SearchMatch m) {
+  const qsizetype lineChars =
+      m.start ? w.text.lastIndexOf(u'\n', m.start - 1) + 1 : 0;
+  qsizetype k = w.text.first(lineChars).count(u'\n');
+  if (k) {
+    return {w.from + NewlineScan::skip(data + w.from, end - w.from, k),
+            m.start - lineChars, m.length};
+  }
+  const qint64 line = lineBeginAt(data, w.from);
+  return {line, utf16Length(data + line, w.from - line, latin1) + m.start,
+          m.length};
+}
+
+// First match in the lines of [begin, stop) that starts at or after
+// character `skip` of the first line; `begin` is a line start. The range is
+// decoded and searched a window at a time.
+ViewerMatch findNext(const char *data, qint64 end, bool latin1, qint64 begin,
+                     qint64 stop, qsizetype skip, const SearchEngine &engine,
+                     const std::atomic<bool> &cancel) {
+  for (qint64 segment = begin; segment < stop && !cancel;) {
+    const qint64 segmentEnd = windowEnd(data, segment, stop);
+    const Window w =
+        decodeWindow(data, latin1, begin, stop, segment, segmentEnd);
+    const SearchMatch m = engine.findFirst(w.text, w.first + skip);
+    if (m.start >= 0 && m.start < w.last)
+      return locate(data, end, latin1, w, m);
+    // `skip` only applies to the first line, which may take many windows.
+    if (findByte(data + segment, '\n', segmentEnd - segment))
+      skip = 0;
+    else
+      skip = qMax<qsizetype>(0, skip - (w.last - w.first));
+    segment = segmentEnd;
+  }
+  return {};
+}
+
+// Last match in the lines of [begin, stop) that starts before character
+// `before` counted from `begin`; `begin` and `stop` are line boundaries.
+// Windows are taken from the back.
+ViewerMatch findPrevious(const char *data, qint64 end, bool latin1,
+                         qint64 begin, qint64 stop, qsizetype before,
+                         const SearchEngine &engine,
+                         const std::atomic<bool> &cancel) {
+  constexpr qsizetype any = std::numeric_limits<qsizetype>::max();
+  // Characters of [begin, segment), to place `before` in later windows;
+  // counted once, and only if the range takes more than one.
+  qsizetype head = before == any || stop - begin <= kFindWindowBytes
+                       ? 0
+                       : utf16Length(data + begin, stop - begin, latin1);
+  QVector<SearchMatch> found;
+  for (qint64 segmentEnd = stop; segmentEnd > begin && !cancel;) {
+    const qint64 segment = windowBegin(data, begin, segmentEnd);
+    const Window w =
+        decodeWindow(data, latin1, begin, stop, segment, segmentEnd);
+    qsizetype limit = w.last;
+    if (before != any) {
+      head = segment > begin ? head - utf16Length(data + segment,
+                                                  segmentEnd - segment, latin1)
+                             : 0;
+      limit = qMin(limit, w.first + before - head);
+    }
+    found.clear();
+    engine.findAll(w.text, 0, found);
+    for (qsizetype i = found.size() - 1; i >= 0 && found[i].start >= w.first;
+         --i) {
+      if (found[i].start < limit)
+        return locate(data, end, latin1, w, found[i]);
+    }
+    segmentEnd = segment;
+  }
+  return {};
+}
+} // namespace
+
+LargeFileView::LargeFileView(QWidget *parent)
+    : QAbstractScrollArea(parent),
+      m_cancel(std::make_shared<std::atomic<bool>>(false)) {
+  setFocusPolicy(Qt::StrongFocus);
+  viewport()->setCursor(Qt::IBeamCursor);
+  connect(verticalScrollBar(), &QScrollBar::valueChanged, this, [this](int v) {
+    m_top = v;
+    viewport()->update();
+  });
+  connect(horizontalScrollBar(), &QScrollBar::valueChanged, viewport(),
+          qOverload<>(&QWidget::update));
+}
+
+LargeFileView::~LargeFileView() {
+  *m_cancel = true;
+  if (m_findCancel)
+    *m_findCancel = true;
+}
+
+bool LargeFileView::open(const QString &path, QString *error) {
+  auto file = std::make_shared<QFile>(path);
+  if (!file->open(QFile::ReadOnly)) {
+    if (error)
+      *error = file->errorString();
+    return false;
+  }
+  const qint64 size = file->size();
+  const uchar *map = size > 0 ? file->map(0, size) : nullptr;
+  if (size > 0 && !map) {
+    if (error)
+      *error = file->errorString();
+    return false;
+  }
+
+  // Lines are found by their '\n' bytes, which UTF-16 does not allow.
+  EncodingDetector detector;
+  const qsizetype bom = detector.begin(QByteArrayView(
+      reinterpret_cast<const char *>(map), qMin(size, kHeadBytes)));
+  if (detector.format().encoding != TextFormat::Encoding::Utf8) {
+    if (error)
+      *error = QString("%1 text is not supported by the read-only viewer")
+                   .arg(detector.format().encodingName());
+    return false;
+  }
+
+  m_filePath = path;
+  m_file = file;
+  m_data = reinterpret_cast<const char *>(map) + bom;
+  m_size = size - bom;
+  m_format = detector.format();
+  m_checkpoints = {0};
+  m_lineCount = 1;
+  m_scanned = 0;
+  m_indexed = m_size == 0;
+  updateScrollBars();
+  if (m_indexed)
+    return true;
+
+  // Count lines on a worker; the map stays valid as long as it holds `file`.
+  // The same pass checks the UTF-8, and falls back to Latin-1 as the loader
+  // does.
+  QPointer<LargeFileView> self(this);
+  std::shared_ptr<std::atomic<bool>> cancel = m_cancel;
+  const char *data = m_data;
+  QThreadPool::globalInstance()->start([self, cancel, file, data,
+                                        size = m_size, detector]() mutable {
+    qint64 pos = 0, newlines = 0;
+    while (pos < size) {
+      QVector<qint64> batch;
+      const qint64 stop = qMin(size, pos + kReportBytes);
+      if (!detector.feed(QByteArrayView(data + pos, stop - pos)))
+        detector.fallBackToLatin1();
+      while (pos < stop) {
+        const qsizetype want = kStride - newlines % kStride;
+        qsizetype k = want;
+        const qsizetype at = NewlineScan::skip(data + pos, stop - pos, k);
+        newlines += want - k;
+        if (at < 0) {
+          pos = stop;
+          break;
+        }
+        pos += at;
+        batch.push_back(pos);
+      }
+      if (*cancel)
+        return;
+      const qint64 lines = newlines + 1, scanned = pos;
+      const bool done = pos >= size;
+      if (done && !detector.finish())
+        detector.fallBackToLatin1();
+      const TextFormat format = detector.format();
+      if (auto *app = QCoreApplication::instance()) {
+        QMetaObject::invokeMethod(
+            app,
+            [self, batch, lines, scanned, done, format] {
+              if (self)
+                self->appendCheckpoints(batch, lines, scanned, done, format);
+            },
+            Qt::QueuedConnection);
+      }
+    }
+  });
+  return true;
+}
+
+void LargeFileView::appendCheckpoints(const QVector<qint64> &offsets,
+                                      qint64 lines, qint64 scanned, bool done,
+                                      const TextFormat &format) {
+  m_format = format;
+  m_checkpoints += offsets;
+  m_lineCount = lines;
+  m_scanned = scanned;
+  m_indexed = done;
+  updateScrollBars();
+  viewport()->update();
+  emit indexChanged();
+}
+
+int LargeFileView::indexProgress() const {
+  return m_size > 0 ? int(m_scanned * 100 / m_size) : 100;
+}
+
+qint64 LargeFileView::lineStart(qint64 line) const {
+  if (line <= 0 || !m_data)
+    return 0;
+  const qint64 c =
+      qMin<qint64>(line / kStride, qint64(m_checkpoints.size()) - 1);
+  const qint64 off = m_checkpoints[c];
+  qsizetype k = line - c * kStride;
+  const qsizetype at = NewlineScan::skip(m_data + off, m_size - off, k);
+  return at < 0 ? m_size : off + at;
+}
+
+qint64 LargeFileView::lineEnd(qint64 start) const {
+  const char *hit = findByte(m_data + start, '\n', m_size - start);
+  return hit ? hit - m_data : m_size;
+}
+
+qint64 LargeFileView::lineOf(qint64 offset) const {
+  const auto it =
+      std::upper_bound(m_checkpoints.cbegin(), m_checkpoints.cend(), offset);
+  const qint64 c = (it - m_checkpoints.cbegin()) - 1;
+  const qint64 from = m_checkpoints[c];
+  return c * kStride + NewlineScan::count(m_data + from, offset - from);
+}
+
+QString LargeFileView::lineText(qint64 line) const {
+  if (!m_data)
+    return QString();
+  const qint64 start = lineStart(line);
+  qint64 len = qMin(lineEnd(start) - start, kMaxLineBytes);
+  if (len > 0 && m_data[start + len - 1] == '\r')
+    --len;
+  return decode(m_data + start, len, isLatin1());
+}
+
+int LargeFileView::visibleLines() const {
+  return qMax(1, viewport()->height() / fontMetrics().lineSpacing());
+}
+
+int LargeFileView::xAt(const QString &text, int col) const {
+  const QFontMetrics fm = fontMetrics();
+  const int tab = 4 * fm.horizontalAdvance(' ');
+  int x = 0;
+  for (int i = 0; i < qMin(col, int(text.size())); ++i)
+    x = text[i] == '\t' ? (x / tab + 1) * tab
+                        : x + fm.horizontalAdvance(text[i]);
+  return x;
+}
+
+int LargeFileView::columnAt(const QString &text, int x) const {
+  const QFontMetrics fm = fontMetrics();
+  const int tab = 4 * fm.horizontalAdvance(' ');
+  int left = 0;
+  for (int i = 0; i < text.size(); ++i) {
+    const int right = text[i] == '\t' ? (left / tab + 1) * tab
+                                      : left + fm.horizontalAdvance(text[i]);
+    if (x < (left + right) / 2)
+      return i;
+    left = right;
+  }
+  return int(text.size());
+}
+
+void LargeFileView::updateScrollBars() {
+  const qint64 maxTop = qMax<qint64>(0, m_lineCount - visibleLines());
+  verticalScrollBar()->setRange(0, int(qMin<qint64>(maxTop, INT_MAX)));
+  verticalScrollBar()->setPageStep(visibleLines());
+  const int width = viewport()->width();
+  horizontalScrollBar()->setPageStep(width);
+  horizontalScrollBar()->setRange(0, qMax(0, m_maxWidth + 2 * kMargin - width));
+}
+
+void LargeFileView::moveCursorTo(qint64 line, int col, bool center) {
+  line = qBound<qint64>(0, line, m_lineCount - 1);
+  m_cursorLine = line;
+  m_cursorCol = qBound(0, col, int(lineText(line).size()));
+
+  const int rows = visibleLines();
+  qint64 top = m_top;
+  if (center)
+    top = line - rows / 2;
+  else if (line < top)
+    top = line;
+  else if (line >= top + rows)
+    top = line - rows + 1;
+  verticalScrollBar()->setValue(int(qBound<qint64>(0, top, INT_MAX)));
+
+  viewport()->update();
+  emit cursorPositionChanged();
+}
+
+void LargeFileView::goToLine(qint64 line) {
+  m_matchLine = -1;
+  moveCursorTo(line, 0, true);
+}
+
+void LargeFileView::find(const SearchEngine &engine, bool backward) {
+  if (m_findCancel)
+    *m_findCancel = true;
+  if (!m_data || !engine.isValid() || engine.pattern().isEmpty()) {
+    emit findFinished(false);
+    return;
+  }
+
+  // Only search what has been indexed so the hit has a line number.
+  const qint64 end = m_indexed ? m_size : lineBeginAt(m_data, m_scanned);
+  const qint64 line = qMin(lineStart(m_cursorLine), end);
+  const qint64 lineStop = qMin(lineEnd(line) + 1, end);
+  // On the current match the cursor sits at its end, or at the end of what
+  // is shown of a longer line; backward steps over it.
+  const qsizetype matchEnd = qsizetype(m_matchCol) + m_matchLength;
+  const bool onMatch =
+      m_matchLine == m_cursorLine &&
+      qMin(matchEnd, lineText(m_cursorLine).size()) == m_cursorCol;
+  const qsizetype column =
+      !onMatch ? m_cursorCol : backward ? m_matchCol : matchEnd;
+
+  m_findCancel = std::make_shared<std::atomic<bool>>(false);
+  QPointer<LargeFileView> self(this);
+  std::shared_ptr<std::atomic<bool>> cancel = m_findCancel;
+  QThreadPool::globalInstance()->start([self, cancel, file = m_file,
+                                        data = m_data, latin1 = isLatin1(),
+                                        end, line, lineStop, column, engine,
+                                        backward] {
+    constexpr qsizetype any = std::numeric_limits<qsizetype>::max();
+    // Each range is searched once: up to the cursor, then the wrap.
+    ViewerMatch m;
+    if (backward) {
+      m = findPrevious(data, end, latin1, line, lineStop, column, engine,
+                       *cancel);
+      if (m.line < 0)
+        m = findPrevious(data, end, latin1, 0, line, any, engine, *cancel);
+      if (m.line < 0)
+        m = findPrevious(data, end, latin1, line, end, any, engine, *cancel);
+    } else {
+      m = findNext(data, end, latin1, line, end, column, engine, *cancel);
+      if (m.line < 0)
+        m = findNext(data, end, latin1, 0, lineStop, 0, engine, *cancel);
+    }
+    if (*cancel)
+      return;
+    if (auto *app = QCoreApplication::instance()) {
+      QMetaObject::invokeMethod(
+          app,
+          [self, cancel, m] {
+            if (self && !*cancel)
+              self->findDone(m.line, m.column, m.length);
+          },
+          Qt::QueuedConnection);
+    }
+  });
+}
+
+void LargeFileView::findDone(qint64 line, qsizetype column,
+                             qsizetype length) {
+  m_findCancel.reset();
+  if (line < 0) {
+    emit findFinished(false);
+    return;
+  }
+  m_matchLine = lineOf(line);
+  m_matchCol = int(column);
+  m_matchLength = int(length);
+  moveCursorTo(m_matchLine, m_matchCol + m_matchLength, true);
+  emit findFinished(true);
+}
+
+void LargeFileView::paintEvent(QPaintEvent *) {
+  QPainter p(viewport());
+  p.fillRect(viewport()->rect(), palette().base());
+  if (!m_data)
+    return;
+
+  const QFontMetrics fm = fontMetrics();
+  const int lh = fm.lineSpacing();
+  const int tab = 4 * fm.horizontalAdvance(' ');
+  const int x0 = kMargin - horizontalScrollBar()->value();
+  const int height = viewport()->height();
+
+  qint64 start = lineStart(m_top);
+  int y = 0, widest = 0;
+  for (qint64 line = m_top; line < m_lineCount && y < height;
+       ++line, y += lh) {
+    const qint64 end = lineEnd(start);
+    qint64 len = qMin(end - start, kMaxLineBytes);
+    if (len > 0 && m_data[start + len - 1] == '\r')
+      --len;
+    const QString text = decode(m_data + start, len, isLatin1());
+
+    if (line == m_cursorLine)
+      p.fillRect(QRect(0, y, viewport()->width(), lh),
+                 palette().alternateBase());
+    if (line == m_matchLine) {
+      const int mx = xAt(text, m_matchCol);
+      p.fillRect(QRect(x0 + mx, y, xAt(text, m_matchCol + m_matchLength) - mx,
+                       lh),
+                 palette().highlight());
+    }
+
+    p.setPen(palette().text().color());
+    int x = x0, segment = 0;
+    for (int i = 0; i <= text.size(); ++i) {
+      if (i < text.size() && text[i] != '\t')
+        continue;
+      const QString run = text.mid(segment, i - segment);
+      p.drawText(x, y + fm.ascent(), run);
+      x += fm.horizontalAdvance(run);
+      if (i < text.size())
+        x = x0 + ((x - x0) / tab + 1) * tab;
+      segment = i + 1;
+    }
+    widest = qMax(widest, x - x0);
+
+    if (line == m_cursorLine && hasFocus())
+      p.fillRect(QRect(x0 + xAt(text, m_cursorCol), y, 1, lh),
+                 palette().text());
+
+    if (end >= m_size)
+      break;
+    start = end + 1;
+  }
+
+  if (widest > m_maxWidth) {
+    m_maxWidth = widest; // widest line seen so far sets the scroll range
+    updateScrollBars();
+  }
+}
+
+void LargeFileView::resizeEvent(QResizeEvent *event) {
+  QAbstractScrollArea::resizeEvent(event);
+  updateScrollBars();
+}
+
+void LargeFileView::keyPressEvent(QKeyEvent *event) {
+  const bool ctrl = event->modifiers() & Qt::ControlModifier;
+  qint64 line = m_cursorLine;
+  int col = m_cursorCol;
+  switch (event->key()) {
+  case Qt::Key_Up:
+    --line;
+    break;
+  case Qt::Key_Down:
+    ++line;
+    break;
+  case Qt::Key_PageUp:
+    line -= visibleLines();
+    break;
+  case Qt::Key_PageDown:
+    line += visibleLines();
+    break;
+  case Qt::Key_Home:
+    if (ctrl)
+      line = 0;
+    col = 0;
+    break;
+  case Qt::Key_End:
+    if (ctrl)
+      line = m_lineCount - 1;
+    col = INT_MAX;
+    break;
+  case Qt::Key_Left:
+    if (col > 0) {
+      --col;
+    } else if (line > 0) {
+      --line;
+      col = INT_MAX;
+    }
+    break;
+  case Qt::Key_Right:
+    if (col < lineText(line).size()) {
+      ++col;
+    } else if (line + 1 < m_lineCount) {
+      ++line;
+      col = 0;
+    }
+    break;
+  default:
+    QAbstractScrollArea::keyPressEvent(event);
+    return;
+  }
+  moveCursorTo(line, col);
+}
+
+void LargeFileView::mousePressEvent(QMouseEvent *event) {
+  const QPoint pos = event->position().toPoint();
+  const qint64 line = m_top + pos.y() / fontMetrics().lineSpacing();
+  const int x = pos.x() - kMargin + horizontalScrollBar()->value();
+  moveCursorTo(line, columnAt(lineText(qMin(line, m_lineCount - 1)), x));
+}
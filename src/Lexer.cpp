@@ -0,0 +1,416 @@
+#include "Lexer.h"
+
+#include <array>
+#include <cstring>
+
+namespace {
+
+enum CharClass : quint8 {
+  kIdentStart = 1 << 0,
+  kIdent = 1 << 1,
+  kDigit = 1 << 2,
+  kSpace = 1 << 3,
+};
+
+constexpr std::array<quint8, 128> makeClassTable() {
+  std::array<quint8, 128> t{};
+  for (int c = 'a'; c <= 'z'; ++c)
+    t[c] = kIdentStart | kIdent;
+  for (int c = 'A'; c <= 'Z'; ++c)
+    t[c] = kIdentStart | kIdent;
+  t['_'] = kIdentStart | kIdent;
+  for (int c = '0'; c <= '9'; ++c)
+    t[c] = kIdent | kDigit;
+  t[' '] = t['\t'] = t['\f'] = t['\v'] = kSpace;
+  return t;
+}
+
+constexpr std::array<quint8, 128> kClass = makeClassTable();
+
+inline bool is(char16_t c, quint8 cls) { return c < 128 && (kClass[c] & cls); }
+
+// Perfect hash over the C++ keyword and builtin type names. The seed is
+// searched once at startup until every word lands in its own slot, so a
+// lookup is one hash plus one compare.
+class KeywordTable {
+public:
+  struct Entry {
+    const char *word = nullptr;
+    int length = 0;
+    TokenKind kind = TokenKind::Keyword;
+  };
+
+  KeywordTable() {
+    static const char *kw[] = {"alignas",
+                               "alignof",
+                               "and",
+                               "and_eq",
+                               "asm",
+                               "auto",
+                               "bitand",
+                               "bitor",
+                               "break",
+                               "case",
+                               "catch",
+                               "class",
+                               "compl",
+                               "const",
+                               "constexpr",
+                               "const_cast",
+                               "continue",
+                               "decltype",
+                               "default",
+                               "delete",
+                               "do",
+                               "dynamic_cast",
+                               "else",
+                               "enum",
+                               "explicit",
+                               "export",
+                               "extern",
+                               "false",
+                               "final",
+                               "for",
+                               "friend",
+                               "goto",
+                               "if",
+                               "inline",
+                               "mutable",
+                               "namespace",
+                               "new",
+                               "noexcept",
+                               "not",
+                               "not_eq",
+                               "nullptr",
+                               "operator",
+                               "or",
+                               "or_eq",
+                               "override",
+                               "private",
+                               "protected",
+                               "public",
+                               "register",
+                               "reinterpret_cast",
+                               "return",
+                               "signed",
+                               "sizeof",
+                               "static",
+                               "static_assert",
+                               "static_cast",
+                               "struct",
+                               "switch",
+                               "template",
+                               "this",
+                               "thread_local",
+                               "throw",
+                               "true",
+                               "try",
+                               "typedef",
+                               "typeid",
+                               "typename",
+                               "union",
+                               "unsigned",
+                               "using",
+                               "virtual",
+                               "void",
+                               "volatile",
+                               "while",
+                               "xor",
+                               "xor_eq"};
+    static const char *types[] = {"int",   "long",   "short", "char",
+                                  "float", "double", "bool",  "size_t"};
+
+    for (m_seed = 2166136261u;; ++m_seed) {
+      m_slots.fill(Entry{});
+      bool collided = false;
+      auto place = [&](const char *w, TokenKind kind) {
+        const int len = int(std::strlen(w));
+        Entry &e = m_slots[slot(w, len)];
+        if (e.word)
+          collided = true;
+        e = {w, len, kind};
+      };
+      for (auto w : kw)
+        place(w, TokenKind::Keyword);
+      for (auto w : types)
+        place(w, TokenKind::Type);
+      if (!collided)
+        break;
+    }
+  }
+
+  // Returns nullptr when `word` is not a keyword or builtin type.
+  const Entry *find(const char16_t *word, int len) const {
+    if (len < 2 || len > kMaxLength)
+      return nullptr;
+    char ascii[kMaxLength];
+    for (int i = 0; i < len; ++i) {
+      if (word[i] >= 128)
+        return nullptr;
+      ascii[i] = char(word[i]);
+    }
+    const Entry &e = m_slots[slot(ascii, len)];
+    if (e.length != len || std::memcmp(e.word, ascii, len) != 0)
+      return nullptr;
+    return &e;
+  }
+
+private:
+  static constexpr int kSlots = 1024;
+  static constexpr int kMaxLength = 16; // "reinterpret_cast"
+
+  quint32 slot(const char *w, int len) const {
+    quint32 h = m_seed;
+    for (int i = 0; i < len; ++i)
+      h = (h ^ quint8(w[i])) * 16777619u;
+    return (h ^ (h >> 15)) & (kSlots - 1);
+  }
+
+  quint32 m_seed = 0;
+  std::array<Entry, kSlots> m_slots;
+};
+
+const KeywordTable &keywords() {
+  static const KeywordTable table;
+  return table;
+}
+
+inline bool startsWith(const char16_t *s, int i, int n, const char *lit) {
+  for (; *lit; ++lit, ++i)
+    if (i >= n || s[i] != char16_t(*lit))
+      return false;
+  return true;
+}
+
+// Returns the index one past the closing `quote`, or -1 if unterminated.
+inline int scanQuoted(const char16_t *s, int i, int n, char16_t quote) {
+  for (++i; i < n; ++i) {
+    if (s[i] == u'\\')
+      ++i;
+    else if (s[i] == quote)
+      return i + 1;
+  }
+  return -1;
+}
+
+inline int indexOfCommentEnd(const char16_t *s, int i, int n) {
+  for (; i + 1 < n; ++i)
+    if (s[i] == u'*' && s[i + 1] == u'/')
+      return i;
+  return -1;
+}
+
+int lexCpp(const char16_t *s, int n, int state, QVector<Token> &out) {
+  int i = 0;
+  if (state == Lexer::InBlockComment) {
+    const int end = indexOfCommentEnd(s, 0, n);
+    if (end < 0) {
+      if (n)
+        out.push_back({0, n, TokenKind::Comment});
+      return Lexer::InBlockComment;
+    }
+    i = end + 2;
+    out.push_back({0, i, TokenKind::Comment});
+  }
+
+  const KeywordTable &kw = keywords();
+  while (i < n) {
+    const char16_t c = s[i];
+
+    if (is(c, kIdentStart)) {
+      int j = i + 1;
+      while (j < n && is(s[j], kIdent))
+        ++j;
+
+      if (j - i == 3 && startsWith(s, i, n, "std") &&
+          startsWith(s, j, n, "::") && j + 2 < n &&
+          is(s[j + 2], kIdentStart)) {
+        int k = j + 3;
+        while (k < n && is(s[k], kIdent))
+          ++k;
+        out.push_back({i, k - i, TokenKind::Type});
+        i = k;
+        continue;
+      }
+
+      if (const auto *e = kw.find(s + i, j - i)) {
+        out.push_back({i, j - i, e->kind});
+      } else {
+        int k = j;
+        while (k < n && is(s[k], kSpace))
+          ++k;
+        if (k < n && s[k] == u'(')
+          out.push_back({i, j - i, TokenKind::Function});
+      }
+      i = j;
+      continue;
+    }
+
+    if (is(c, kDigit)) {
+      // Digits, a fraction, suffixes, hex digits and ' separators.
+      int j = i + 1;
+      while (j < n && (is(s[j], kIdent) || s[j] == u'.' ||
+                       (s[j] == u'\'' && j + 1 < n && is(s[j + 1], kIdent))))
+        ++j;
+      out.push_back({i, j - i, TokenKind::Number});
+      i = j;
+      continue;
+    }
+
+    switch (c) {
+    case u'"': {
+      int j = scanQuoted(s, i, n, u'"');
+      if (j < 0)
+        j = n;
+      out.push_back({i, j - i, TokenKind::String});
+      i = j;
+      continue;
+    }
+    case u'\'': {
+      const int j = scanQuoted(s, i, n, u'\'');
+      if (j > 0) {
+        out.push_back({i, j - i, TokenKind::String});
+        i = j;
+      } else {
+        ++i; // stray quote
+      }
+      continue;
+    }
+    case u'/':
+      if (i + 1 < n && s[i + 1] == u'/') {
+        out.push_back({i, n - i, TokenKind::Comment});
+        return Lexer::Normal;
+      }
+      if (i + 1 < n && s[i + 1] == u'*') {
+        const int end = indexOfCommentEnd(s, i + 2, n);
+        if (end < 0) {
+          out.push_back({i, n - i, TokenKind::Comment});
+          return Lexer::InBlockComment;
+        }
+        out.push_back({i, end + 2 - i, TokenKind::Comment});
+        i = end + 2;
+        continue;
+      }
+      break;
+    default:
+      break;
+    }
+    ++i;
+  }
+  return Lexer::Normal;
+}
+
+int lexJson(const char16_t *s, int n, QVector<Token> &out) {
+  int i = 0;
+  while (i < n) {
+    const char16_t c = s[i];
+
+    if (c == u'"') {
+      int j = scanQuoted(s, i, n, u'"');
+      if (j < 0)
+        j = n;
+      int k = j;
+      while (k < n && is(s[k], kSpace))
+        ++k;
+      const bool key = k < n && s[k] == u':';
+      out.push_back({i, j - i, key ? TokenKind::Header : TokenKind::String});
+      i = j;
+      continue;
+    }
+
+    if (is(c, kDigit) || (c == u'-' && i + 1 < n && is(s[i + 1], kDigit))) {
+      int j = i + 1;
+      while (j < n && (is(s[j], kDigit) || s[j] == u'.' || s[j] == u'e' ||
+                       s[j] == u'E' ||
+                       ((s[j] == u'+' || s[j] == u'-') &&
+                        (s[j - 1] == u'e' || s[j - 1] == u'E'))))
+        ++j;
+      out.push_back({i, j - i, TokenKind::Number});
+      i = j;
+      continue;
+    }
+
+    if (is(c, kIdentStart)) {
+      int j = i + 1;
+      while (j < n && is(s[j], kIdent))
+        ++j;
+      const int len = j - i;
+      if ((len == 4 && (startsWith(s, i, n, "true") ||
+                        startsWith(s, i, n, "null"))) ||
+          (len == 5 && startsWith(s, i, n, "false")))
+        out.push_back({i, len, TokenKind::Keyword});
+      i = j;
+      continue;
+    }
+    ++i;
+  }
+  return Lexer::Normal;
+}
+
+int lexMarkdown(const char16_t *s, int n, QVector<Token> &out) {
+  // ATX header: up to three spaces, 1-6 '#', whitespace, then text.
+  int i = 0;
+  while (i < n && i < 3 && is(s[i], kSpace))
+    ++i;
+  int hashes = 0;
+  while (i + hashes < n && s[i + hashes] == u'#')
+    ++hashes;
+  if (hashes >= 1 && hashes <= 6 && i + hashes + 1 < n &&
+      is(s[i + hashes], kSpace)) {
+    out.push_back({0, n, TokenKind::Header});
+    return Lexer::Normal;
+  }
+
+  i = 0;
+  while (i < n) {
+    const char16_t c = s[i];
+    if (c == u'`') {
+      int j = i + 1;
+      while (j < n && s[j] != u'`')
+        ++j;
+      if (j < n && j > i + 1) {
+        out.push_back({i, j + 1 - i, TokenKind::Code});
+        i = j + 1;
+        continue;
+      }
+    } else if (c == u'*' && i + 1 < n && s[i + 1] == u'*') {
+      int j = i + 2;
+      while (j < n && s[j] != u'*')
+        ++j;
+      if (j + 1 < n && j > i + 2 && s[j + 1] == u'*') {
+        out.push_back({i, j + 2 - i, TokenKind::Bold});
+        i = j + 2;
+        continue;
+      }
+    } else if (c == u'_') {
+      int j = i + 1;
+      while (j < n && s[j] != u'_')
+        ++j;
+      if (j < n && j > i + 1) {
+        out.push_back({i, j + 1 - i, TokenKind::Italic});
+        i = j + 1;
+        continue;
+      }
+    }
+    ++i;
+  }
+  return Lexer::Normal;
+}
+
+} // namespace
+
+int Lexer::lex(Lang lang, QStringView text, int state, QVector<Token> &out) {
+  const auto *s = reinterpret_cast<const char16_t *>(text.data());
+  const int n = int(text.size());
+  switch (lang) {
+  case Lang::Cpp:
+    return lexCpp(s, n, state, out);
+  case Lang::Json:
+    return lexJson(s, n, out);
+  case Lang::Markdown:
+    return lexMarkdown(s, n, out);
+  case Lang::None:
+    break;
+  }
+  return Normal;
+}
@@ -0,0 +1,148 @@
+#include "LineDiff.h"
+#include "NewlineScan.h"
+#include <QHash>
+
+#include <limits>
+#include <vector>
+
+namespace {
+// Start of every line of `text`, plus its length at the end. A last line
+// without '\n' counts as a line.
+QVector<qsizetype> lineStarts(QStringView text) {
+  QVector<qsizetype> breaks;
+  NewlineScan::find(text.utf16(), text.size(), 0, breaks);
+  QVector<qsizetype> starts;
+  starts.reserve(breaks.size() + 2);
+  starts.append(0);
+  for (qsizetype nl : breaks)
+    starts.append(nl + 1);
+  if (starts.last() != text.size())
+    starts.append(text.size());
+  return starts;
+}
+
+QStringView lineOf(QStringView text, const QVector<qsizetype> &starts,
+                   qsizetype i) {
+  return text.mid(starts[i], starts[i + 1] - starts[i]);
+}
+
+// A run of lines [oldFrom, oldTo) replaced by [newFrom, newTo).
+struct Hunk {
+  qsizetype oldFrom, oldTo, newFrom, newTo;
+};
+
+// Shortest edit script between a and b as hunks, or false if it takes
+// more than `maxD` insertions and deletions.
+bool myers(const std::vector<int> &a, const std::vector<int> &b, int maxD,
+           QVector<Hunk> &hunks) {
+  const int n = int(a.size()), m = int(b.size());
+  maxD = qMin(maxD, n + m);
+  const int offset = maxD + 1;
+  std::vector<int> v(2 * maxD + 3, 0);
+  // trace[d] holds v[k] for k in [-d, d] after round d, for the way back.
+  std::vector<std::vector<int>> trace;
+  int found = -1;
+  for (int d = 0; d <= maxD && found < 0; ++d) {
+    for (int k = -d; k <= d; k += 2) {
+      int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+                  ? v[offset + k + 1]
+                  : v[offset + k - 1] + 1;
+      int y = x - k;
+      while (x < n && y < m && a[x] == b[y])
+        ++x, ++y;
+      v[offset + k] = x;
+      if (x >= n && y >= m) {
+        found = d;
+        break;
+      }
+    }
+    trace.emplace_back(v.begin() + offset - d, v.begin() + offset + d + 1);
+  }
+  if (found < 0)
+    return false;
+
+  // Walk back from the end, one insertion or deletion per round, growing
+  // hunks towards the start.
+  QVector<Hunk> reversed;
+  int x = n, y = m;
+  for (int d = found; d > 0; --d) {
+    const std::vector<int> &prev = trace[d - 1];
+    const int k = x - y;
+    const auto at = [&prev, d](int kk) { return prev[kk + d - 1]; };
+    const bool down = k == -d || (k != d && at(k - 1) < at(k + 1));
+    const int prevK = down ? k + 1 : k - 1;
+    const int px = at(prevK), py = px - prevK;
+    // (px, py) -> one step -> snake to (x, y)
+    const int sx = down ? px : px + 1, sy = down ? py + 1 : py;
+    const bool snake = sx != x || sy != y;
+    if (reversed.isEmpty() || snake)
+      reversed.append({sx, sx, sy, sy});
+    Hunk &h = reversed.last();
+    h.oldFrom = px;
+    h.newFrom = py;
+    x = px;
+    y = py;
+  }
+  hunks.reserve(reversed.size());
+  for (qsizetype i = reversed.size() - 1; i >= 0; --i)
+    hunks.append(reversed[i]);
+  return true;
+}
+} // namespace
+
+QVector<TextEdit> LineDiff::diff(QStringView before, QStringView after) {
+  const QVector<qsizetype> oldStarts = lineStarts(before);
+  const QVector<qsizetype> newStarts = lineStarts(after);
+  const qsizetype oldLines = oldStarts.size() - 1;
+  const qsizetype newLines = newStarts.size() - 1;
+
+  qsizetype head = 0;
+  while (head < oldLines && head < newLines &&
+         lineOf(before, oldStarts, head) == lineOf(after, newStarts, head))
+    ++head;
+  qsizetype tail = 0;
+  while (tail < oldLines - head && tail < newLines - head &&
+         lineOf(before, oldStarts, oldLines - 1 - tail) ==
+             lineOf(after, newStarts, newLines - 1 - tail))
+    ++tail;
+
+  QVector<Hunk> hunks;
+  const qsizetype oldCount = oldLines - head - tail;
+  const qsizetype newCount = newLines - head - tail;
+  if (oldCount == 0 && newCount == 0)
+    return {};
+  bool diffed = false;
+  if (oldCount > 0 && newCount > 0 &&
+      oldCount + newCount <= std::numeric_limits<int>::max() / 2) {
+    // Equal lines share an id, so the diff compares ints.
+    QHash<QStringView, int> ids;
+    ids.reserve(oldCount + newCount);
+    const auto id = [&ids](QStringView line) {
+      auto it = ids.find(line);
+      if (it == ids.end())
+        it = ids.insert(line, int(ids.size()));
+      return *it;
+    };
+    std::vector<int> a, b;
+    a.reserve(oldCount);
+    b.reserve(newCount);
+    for (qsizetype i = 0; i < oldCount; ++i)
+      a.push_back(id(lineOf(before, oldStarts, head + i)));
+    for (qsizetype i = 0; i < newCount; ++i)
+      b.push_back(id(lineOf(after, newStarts, head + i)));
+    diffed = myers(a, b, int(kMaxChangedLines), hunks);
+  }
+  if (!diffed)
+    hunks = {{0, oldCount, 0, newCount}};
+
+  QVector<TextEdit> edits;
+  edits.reserve(hunks.size());
+  for (const Hunk &h : hunks) {
+    const qsizetype from = oldStarts[head + h.oldFrom];
+    const qsizetype newFrom = newStarts[head + h.newFrom];
+    edits.append({from, oldStarts[head + h.oldTo] - from,
+                  after.mid(newFrom, newStarts[head + h.newTo] - newFrom)
+                      .toString()});
+  }
+  return edits;
+}
@@ -0,0 +1,144 @@
+#include "LineIndex.h"
+#include "NewlineScan.h"
+
+#include <algorithm>
+
+LineIndex::LineIndex() { clear(); }
+
+void LineIndex::clear() {
+  m_chunks = {Chunk{{0}, 0}};
+  m_lines = 1;
+  m_length = 0;
+  m_validPrefix = 0;
+}
+
+void LineIndex::append(QStringView text) { update(m_length, 0, text); }
+
+void LineIndex::ensurePrefix() const {
+  const int n = int(m_chunks.size());
+  m_chunkStart.resize(n);
+  m_chunkLine.resize(n);
+  if (m_validPrefix == 0) {
+    m_chunkStart[0] = 0;
+    m_chunkLine[0] = 0;
+    m_validPrefix = 1;
+  }
+  for (int c = m_validPrefix; c < n; ++c) {
+    m_chunkStart[c] = m_chunkStart[c - 1] + m_chunks[c - 1].chars;
+    m_chunkLine[c] = m_chunkLine[c - 1] + m_chunks[c - 1].lengths.size();
+  }
+  m_validPrefix = n;
+}
+
+void LineIndex::locate(qsizetype line, int &chunk, int &index) const {
+  ensurePrefix();
+  const auto it =
+      std::upper_bound(m_chunkLine.cbegin(), m_chunkLine.cend(), line);
+  chunk = int(it - m_chunkLine.cbegin()) - 1;
+  index = int(line - m_chunkLine[chunk]);
+}
+
+qint64 LineIndex::memoryUsage() const {
+  qint64 bytes = (m_chunkStart.capacity() + m_chunkLine.capacity()) *
+                 qint64(sizeof(qsizetype));
+  for (const Chunk &chunk : m_chunks)
+    bytes += sizeof(Chunk) + chunk.lengths.capacity() * qint64(sizeof(int));
+  return bytes;
+}
+
+qsizetype LineIndex::lineStart(qsizetype line) const {
+  line = std::clamp<qsizetype>(line, 0, m_lines - 1);
+  int c, i;
+  locate(line, c, i);
+  qsizetype pos = m_chunkStart[c];
+  const int *len = m_chunks[c].lengths.constData();
+  for (int k = 0; k < i; ++k)
+    pos += len[k];
+  return pos;
+}
+
+qsizetype LineIndex::lineAt(qsizetype pos) const {
+  pos = std::clamp<qsizetype>(pos, 0, m_length);
+  ensurePrefix();
+  const auto it =
+      std::upper_bound(m_chunkStart.cbegin(), m_chunkStart.cend(), pos);
+  const int c = int(it - m_chunkStart.cbegin()) - 1;
+  const QVector<int> &lengths = m_chunks[c].lengths;
+  qsizetype start = m_chunkStart[c];
+  int i = 0;
+  // The last line has no '\n', so the document end still lands on it.
+  for (; i + 1 < lengths.size() && pos >= start + lengths[i]; ++i)
+    start += lengths[i];
+  return m_chunkLine[c] + i;
+}
+
+void LineIndex::update(qsizetype pos, qsizetype removed,
+                       QStringView inserted) {
+  pos = std::clamp<qsizetype>(pos, 0, m_length);
+  removed = std::clamp<qsizetype>(removed, 0, m_length - pos);
+
+  // The edit rewrites lines first..last: what is left of them around the
+  // change is glued to the new text and split again at its newlines.
+  const qsizetype first = lineAt(pos);
+  const qsizetype last = lineAt(pos + removed);
+  const qsizetype head = pos - lineStart(first);
+  const qsizetype tail = (last + 1 < m_lines ? lineStart(last + 1) : m_length) -
+                         (pos + removed);
+
+  QVector<qsizetype> breaks;
+  NewlineScan::find(reinterpret_cast<const char16_t *>(inserted.data()),
+                    inserted.size(), 0, breaks);
+  QVector<int> lengths;
+  lengths.reserve(breaks.size() + 1);
+  qsizetype from = -head;
+  for (qsizetype b : breaks) {
+    lengths.push_back(int(b + 1 - from));
+    from = b + 1;
+  }
+  lengths.push_back(int(inserted.size() - from + tail));
+
+  replaceLines(first, last - first + 1, lengths);
+  m_length += inserted.size() - removed;
+}
+
+void LineIndex::replaceLines(qsizetype first, qsizetype count,
+                             const QVector<int> &lengths) {
+  int c, i;
+  locate(first, c, i);
+  m_validPrefix = std::min(m_validPrefix, c + 1);
+
+  // Drop the old lines, which may run over into later chunks.
+  for (int k = c; count > 0; ++k) {
+    Chunk &chunk = m_chunks[k];
+    const int at = k == c ? i : 0;
+    const int n = int(std::min<qsizetype>(count, chunk.lengths.size() - at));
+    for (int j = at; j < at + n; ++j)
+      chunk.chars -= chunk.lengths[j];
+    chunk.lengths.remove(at, n);
+    count -= n;
+    m_lines -= n;
+  }
+  int empty = c + 1;
+  while (empty < m_chunks.size() && m_chunks[empty].lengths.isEmpty())
+    ++empty;
+  m_chunks.remove(c + 1, empty - c - 1);
+
+  Chunk &chunk = m_chunks[c];
+  chunk.lengths = chunk.lengths.first(i) + lengths + chunk.lengths.sliced(i);
+  for (int len : lengths)
+    chunk.chars += len;
+  m_lines += lengths.size();
+
+  // Oversized chunks are cut back into kChunkLines pieces.
+  if (chunk.lengths.size() > 2 * kChunkLines) {
+    QVector<Chunk> pieces;
+    for (qsizetype at = 0; at < chunk.lengths.size(); at += kChunkLines) {
+      Chunk piece;
+      piece.lengths = chunk.lengths.mid(at, kChunkLines);
+      for (int len : piece.lengths)
+        piece.chars += len;
+      pieces.push_back(std::move(piece));
+    }
+    m_chunks = m_chunks.first(c) + pieces + m_chunks.sliced(c + 1);
+  }
+}
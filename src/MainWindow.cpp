@@ -1,25 +1,99 @@
 #include "MainWindow.h"
 #include "EditorWidget.h"
+#include "FileFollower.h"
+#include "FileLoader.h"
+#include "FileSaver.h"
+#include "FindInFilesPanel.h"
 #include "Highlighter.h"
+#include "Journal.h"
+#include "JsonFormatter.h"
+#include "LargeFileView.h"
+#include "LineDiff.h"
+#include "OutlinePanel.h"
+#include "SearchIndex.h"
+#include "PerformancePanel.h"
+#include "StartupTrace.h"
+#include "Telemetry.h"
 
 #include <QApplication>
 #include <QCloseEvent>
+#include <QDir>
+#include <QDockWidget>
+#include <QElapsedTimer>
+#include <QEventLoop>
 #include <QFile>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QInputDialog>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QPointer>
+#include <QProgressBar>
+#include <QScrollBar>
 #include <QSettings>
+#include <QSignalBlocker>
 #include <QStatusBar>
 #include <QStyle>
 #include <QTabWidget>
 #include <QTextBlock>
-#include <QTextStream>
+#include <QThreadPool>
+#include <QTimer>
+#include <QToolButton>
 
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+namespace {
+// How long tab switching settles before the memory budget is checked.
+constexpr int kBudgetCheckMs = 500;
+// Changes to open files on disk are looked at once they settle this long.
+constexpr int kFileChangeDelayMs = 200;
+// Deferred start-up work runs after the first paint, or after this long if
+// the window is never painted (e.g. started minimized).
+constexpr int kStartupFallbackMs = 1000;
+
+template <typename F> void postToGui(F &&f) {
+  if (auto *app = QCoreApplication::instance())
+    QMetaObject::invokeMethod(app, std::forward<F>(f), Qt::QueuedConnection);
+}
+
+// Resident set size of the whole process, or -1 where it is not known.
+qint64 residentBytes() {
+#ifdef Q_OS_LINUX
+  QFile statm("/proc/self/statm");
+  if (!statm.open(QIODevice::ReadOnly))
+    return -1;
+  const QList<QByteArray> fields = statm.readAll().split(' ');
+  if (fields.size() < 2)
+    return -1;
+  return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+  return -1;
+#endif
+}
+} // namespace
+
+// Only what the first frame needs happens here; the recent files menu,
+// highlighters and journal recovery wait for finishStartup().
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
   setWindowTitle("Notepad");
   resize(900, 600);
 
+  {
+    // Before any child widget exists, so there is nothing to propagate the
+    // palette to.
+    StartupTrace::Scope trace("applyTheme");
+    applyTheme(isDarkTheme());
+  }
+
   m_tabs = new QTabWidget(this);
   m_tabs->setDocumentMode(true);
   m_tabs->setTabsClosable(true);
@@ -28,32 +102,204 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
   connect(m_tabs, &QTabWidget::currentChanged, this,
           &MainWindow::currentTabChanged);
   connect(m_tabs, &QTabWidget::tabCloseRequested, this, [this](int idx) {
+    // A placeholder has nothing to save and is not worth loading first,
+    // unless it is a hibernated tab with unsaved changes.
+    if (QWidget *page = m_tabs->widget(idx);
+        m_placeholders.contains(page) && !m_placeholders[page].modified) {
+      m_placeholders.remove(page);
+      m_tabs->removeTab(idx);
+      page->deleteLater();
+      return;
+    }
     m_tabs->setCurrentIndex(idx);
     closeCurrentTab();
   });
 
-  createMenus();
+  {
+    StartupTrace::Scope trace("settings");
+    QSettings s;
+    m_searchOptions.caseSensitive =
+        s.value("search/caseSensitive", false).toBool();
+    m_searchOptions.wholeWord = s.value("search/wholeWord", false).toBool();
+    m_searchOptions.regex = s.value("search/regex", false).toBool();
+  }
 
-  applyTheme(isDarkTheme());
+  m_findInFiles = new FindInFilesPanel(this);
+  m_findInFiles->setOptions(m_searchOptions);
+  connect(m_findInFiles, &FindInFilesPanel::openRequested, this,
+          &MainWindow::openAtLine);
+  m_findInFilesDock = new QDockWidget("Find in Files", this);
+  m_findInFilesDock->setObjectName("findInFilesDock");
+  m_findInFilesDock->setWidget(m_findInFiles);
+  addDockWidget(Qt::BottomDockWidgetArea, m_findInFilesDock);
+  m_findInFilesDock->hide();
 
-  QSettings s;
-  m_recentFiles = s.value("recentFiles").toStringList();
-  rebuildRecentFilesMenu();
+  m_performanceDock = new QDockWidget("Performance", this);
+  m_performanceDock->setObjectName("performanceDock");
+  m_performanceDock->setWidget(new PerformancePanel(this));
+  addDockWidget(Qt::BottomDockWidgetArea, m_performanceDock);
+  m_performanceDock->hide();
 
-  newTab();
+  m_outline = new OutlinePanel(this);
+  m_outlineDock = new QDockWidget("Outline", this);
+  m_outlineDock->setObjectName("outlineDock");
+  m_outlineDock->setWidget(m_outline);
+  addDockWidget(Qt::LeftDockWidgetArea, m_outlineDock);
+  m_outlineDock->hide();
+
+  m_budgetTimer = new QTimer(this);
+  m_budgetTimer->setSingleShot(true);
+  m_budgetTimer->setInterval(kBudgetCheckMs);
+  connect(m_budgetTimer, &QTimer::timeout, this,
+          &MainWindow::enforceMemoryBudget);
+
+  // Editors catch up with changes made to their files by other programs.
+  // A burst of notifications, e.g. a build rewriting many files, is looked
+  // at once.
+  m_fileWatcher = new QFileSystemWatcher(this);
+  m_changeTimer = new QTimer(this);
+  m_changeTimer->setSingleShot(true);
+  m_changeTimer->setInterval(kFileChangeDelayMs);
+  connect(m_fileWatcher, &QFileSystemWatcher::fileChanged, this,
+          [this](const QString &path) {
+            m_changedFiles.insert(path);
+            m_changeTimer->start();
+          });
+  connect(m_changeTimer, &QTimer::timeout, this,
+          &MainWindow::filesChangedOnDisk);
+
+  {
+    StartupTrace::Scope trace("createMenus");
+    createMenus();
+  }
+
+  m_loadProgress = new QProgressBar(this);
+  m_loadProgress->setRange(0, 1000);
+  m_loadProgress->setMaximumWidth(160);
+  m_loadProgress->setTextVisible(false);
+  m_loadCancel = new QToolButton(this);
+  m_loadCancel->setText("Cancel");
+  connect(m_loadCancel, &QToolButton::clicked, this, [this] {
+    if (auto *ed = currentEditor())
+      if (auto *loader = ed->findChild<FileLoader *>())
+        loader->cancel();
+  });
+  statusBar()->addPermanentWidget(m_loadProgress);
+  statusBar()->addPermanentWidget(m_loadCancel);
+  m_loadProgress->hide();
+  m_loadCancel->hide();
+
+  {
+    StartupTrace::Scope trace("restoreSession");
+    if (!restoreSession())
+      newTab();
+  }
   statusBar()->showMessage("Ready");
   updateStatusBar();
+
+  qApp->installEventFilter(this);
+  QTimer::singleShot(kStartupFallbackMs, this, &MainWindow::finishStartup);
+}
+
+// Waits for the first paint event of any widget in this window. Paint
+// events are delivered while the frame is composed, so a zero timer from
+// here fires once it is on screen.
+bool MainWindow::eventFilter(QObject *watched, QEvent *event) {
+  if (event->type() == QEvent::Paint && m_firstPaint < 0) {
+    if (auto *w = qobject_cast<QWidget *>(watched); w && w->window() == this) {
+      m_firstPaint = StartupTrace::now();
+      qApp->removeEventFilter(this);
+      QTimer::singleShot(0, this, &MainWindow::finishStartup);
+    }
+  }
+  return QMainWindow::eventFilter(watched, event);
+}
+
+static Highlighter *highlighterOf(EditorWidget *ed) {
+  return ed->document()->findChild<Highlighter *>(QString(),
+                                                  Qt::FindDirectChildrenOnly);
+}
+
+static void attachHighlighter(EditorWidget *ed, Highlighter::Lang lang) {
+  auto *hl = new Highlighter(ed->document());
+  hl->setLazy(true);
+  QObject::connect(ed, &EditorWidget::visibleBlocksChanged, hl,
+                   &Highlighter::setVisibleBlocks);
+  hl->setVisibleBlocks(ed->firstVisible(), ed->lastVisible());
+  hl->setLanguage(lang);
+  ed->setStructure(hl->structure());
+}
+
+// The rest of start-up, once the first frame is on screen. Editors made
+// before this get their highlighter here, for the language of their path.
+void MainWindow::finishStartup() {
+  if (m_started)
+    return;
+  m_started = true;
+  qApp->removeEventFilter(this);
+  if (m_firstPaint >= 0)
+    StartupTrace::record("first frame", m_firstPaint);
+  StartupTrace::mark("first paint");
+
+  {
+    StartupTrace::Scope trace("deferred");
+    m_recentFiles = QSettings().value("recentFiles").toStringList();
+    rebuildRecentFilesMenu();
+    for (int i = 0; i < m_tabs->count(); ++i) {
+      auto *ed = qobject_cast<EditorWidget *>(m_tabs->widget(i));
+      if (ed && !highlighterOf(ed))
+        attachHighlighter(ed, Highlighter::languageFor(ed->filePath()));
+    }
+    m_outline->setEditor(currentEditor());
+  }
+  StartupTrace::finish();
+
+  recoverJournals();
+}
+
+static void moveToLine(EditorWidget *ed, qsizetype line,
+                       qsizetype column = 0) {
+  const LineIndex &lines = ed->lines();
+  line = qBound<qsizetype>(0, line, lines.lineCount() - 1);
+  const qsizetype start = lines.lineStart(line);
+  const qsizetype end = line + 1 < lines.lineCount()
+                            ? lines.lineStart(line + 1) - 1
+                            : lines.length();
+  QTextCursor cursor(ed->document());
+  cursor.setPosition(int(qMin(start + qMax<qsizetype>(0, column), end)));
+  ed->setTextCursor(cursor);
+  ed->centerCursor();
+}
+
+// Runs `f` once `ed` has loaded successfully; right away if it is not
+// loading.
+static void whenLoaded(EditorWidget *ed, const std::function<void()> &f) {
+  auto *loader = ed->findChild<FileLoader *>();
+  if (!loader) {
+    f();
+    return;
+  }
+  QObject::connect(loader, &FileLoader::finished, ed, [f](bool ok) {
+    if (ok)
+      f();
+  });
 }
 
-static Highlighter::Lang langForPath(const QString &path) {
-  const QString ext = QFileInfo(path).suffix().toLower();
-  if (ext == "cpp" || ext == "cc" || ext == "cxx" || ext == "h" || ext == "hpp")
-    return Highlighter::Lang::Cpp;
-  if (ext == "json")
-    return Highlighter::Lang::Json;
-  if (ext == "md" || ext == "markdown")
-    return Highlighter::Lang::Markdown;
-  return Highlighter::Lang::None;
+// Moves the viewer to `line` as soon as its indexer has reached it.
+static void viewerGoToLine(LargeFileView *view, qint64 line) {
+  if (view->isIndexed() || line < view->lineCount()) {
+    view->goToLine(line);
+    return;
+  }
+  auto conn = std::make_shared<QMetaObject::Connection>();
+  *conn = QObject::connect(view, &LargeFileView::indexChanged, view,
+                           [view, line, conn] {
+                             if (!view->isIndexed() &&
+                                 line >= view->lineCount())
+                               return;
+                             QObject::disconnect(*conn);
+                             view->goToLine(line);
+                           });
 }
 
 void MainWindow::createMenus() {
@@ -66,6 +312,16 @@ void MainWindow::createMenus() {
   fileMenu->addAction("Save", this, &MainWindow::saveFile, QKeySequence::Save);
   fileMenu->addAction("Save As...", this, &MainWindow::saveFileAs,
                       QKeySequence::SaveAs);
+  // Patches in what changed on disk; the old text is one Undo away.
+  fileMenu->addAction(
+      "Reload", this,
+      [this] {
+        auto *ed = currentEditor();
+        if (ed && !ed->filePath().isEmpty() && !ed->isLoading() &&
+            !m_reloading.contains(ed) && !ed->findChild<FileFollower *>())
+          reloadFromDisk(ed);
+      },
+      QKeySequence::Refresh);
 
   m_recentMenu = fileMenu->addMenu("Recent Files");
   m_recentMenuAction = m_recentMenu->menuAction();
@@ -129,6 +385,36 @@ void MainWindow::createMenus() {
                       QKeySequence::FindNext);
   editMenu->addAction("Find Previous", this, &MainWindow::findPrev,
                       QKeySequence::FindPrevious);
+  editMenu->addAction("Replace...", this, &MainWindow::replace,
+                      QKeySequence::Replace);
+  editMenu->addAction("Replace All...", this, &MainWindow::replaceAll,
+                      QKeySequence("Ctrl+Shift+H"));
+  editMenu->addAction("Find in Files...", this, &MainWindow::showFindInFiles,
+                      QKeySequence("Ctrl+Shift+F"));
+  QMenu *optionsMenu = editMenu->addMenu("Find Options");
+  auto addOption = [&](const QString &text, bool SearchOptions::*option,
+                       const QString &key) {
+    QAction *act = optionsMenu->addAction(text);
+    act->setCheckable(true);
+    act->setChecked(m_searchOptions.*option);
+    connect(act, &QAction::toggled, this, [this, option, key](bool on) {
+      setSearchOption(option, on, key);
+    });
+  };
+  addOption("Match Case", &SearchOptions::caseSensitive,
+            "search/caseSensitive");
+  addOption("Whole Word", &SearchOptions::wholeWord, "search/wholeWord");
+  addOption("Regular Expression", &SearchOptions::regex, "search/regex");
+  QMenu *jsonMenu = editMenu->addMenu("JSON");
+  jsonMenu->addAction(
+      "Validate", [this] { runJsonTool(JsonFormatter::Mode::Validate); },
+      QKeySequence("Ctrl+Alt+V"));
+  jsonMenu->addAction(
+      "Pretty Print", [this] { runJsonTool(JsonFormatter::Mode::Pretty); },
+      QKeySequence("Ctrl+Alt+P"));
+  jsonMenu->addAction(
+      "Minify", [this] { runJsonTool(JsonFormatter::Mode::Minify); },
+      QKeySequence("Ctrl+Alt+M"));
 
   // View
   QMenu *viewMenu = menuBar()->addMenu("&View");
@@ -144,6 +430,69 @@ void MainWindow::createMenus() {
   wrap->setCheckable(true);
   wrap->setChecked(false);
 
+  m_followAction = viewMenu->addAction("Follow File", this,
+                                       &MainWindow::setFollow,
+                                       QKeySequence("Ctrl+Shift+L"));
+  m_followAction->setCheckable(true);
+
+  viewMenu->addAction("Large File Threshold...", [this] {
+    QSettings s;
+    bool ok;
+    int mb = QInputDialog::getInt(
+        this, "Large File Threshold",
+        "Open files at least this large (MB) in the read-only viewer:",
+        s.value("viewer/thresholdMB", kDefaultViewerThresholdMB).toInt(), 1,
+        1024 * 1024, 1, &ok);
+    if (ok)
+      s.setValue("viewer/thresholdMB", mb);
+  });
+
+  viewMenu->addAction("Memory Budget...", [this] {
+    QSettings s;
+    bool ok;
+    int mb = QInputDialog::getInt(
+        this, "Memory Budget",
+        "Hibernate the least recently used tabs above this many MB.\n"
+        "An open tab takes about four bytes per character of text:\n"
+        "the editor and its search buffer each keep a copy.",
+        s.value("memory/budgetMB", kDefaultMemoryBudgetMB).toInt(), 16,
+        1024 * 1024, 16, &ok);
+    if (!ok)
+      return;
+    s.setValue("memory/budgetMB", mb);
+    enforceMemoryBudget();
+  });
+  viewMenu->addAction("Tab Memory...", this, &MainWindow::showTabMemory);
+
+  viewMenu->addSeparator();
+  viewMenu->addAction(
+      "Fold",
+      [this] {
+        if (auto *ed = currentEditor())
+          ed->fold(ed->textCursor().block());
+      },
+      QKeySequence("Ctrl+Shift+["));
+  viewMenu->addAction(
+      "Unfold",
+      [this] {
+        if (auto *ed = currentEditor())
+          ed->unfold(ed->textCursor().block());
+      },
+      QKeySequence("Ctrl+Shift+]"));
+  viewMenu->addAction("Fold All", [this] {
+    if (auto *ed = currentEditor())
+      ed->foldAll();
+  });
+  viewMenu->addAction("Unfold All", [this] {
+    if (auto *ed = currentEditor())
+      ed->unfoldAll();
+  });
+
+  viewMenu->addSeparator();
+  viewMenu->addAction(m_findInFilesDock->toggleViewAction());
+  viewMenu->addAction(m_performanceDock->toggleViewAction());
+  viewMenu->addAction(m_outlineDock->toggleViewAction());
+
   viewMenu->addSeparator();
   auto *darkAct =
       viewMenu->addAction("Dark Theme", this, &MainWindow::toggleDarkTheme);
@@ -162,6 +511,10 @@ EditorWidget *MainWindow::currentEditor() const {
   return qobject_cast<EditorWidget *>(m_tabs->currentWidget());
 }
 
+LargeFileView *MainWindow::currentViewer() const {
+  return qobject_cast<LargeFileView *>(m_tabs->currentWidget());
+}
+
 void MainWindow::setTabTitle(EditorWidget *ed) {
   const bool modified = ed->document()->isModified();
   QString name = ed->filePath().isEmpty()
@@ -175,47 +528,78 @@ void MainWindow::setTabTitle(EditorWidget *ed) {
   setWindowTitle(QString("NotepadX - %1").arg(name));
 }
 
-void MainWindow::newTab() {
+void MainWindow::newTab() { addEditorTab(); }
+
+EditorWidget *MainWindow::addEditorTab(int index) {
   auto *ed = new EditorWidget(this);
   ed->setFilePath(QString());
   ed->document()->setModified(false);
 
-  auto *hl = new Highlighter(ed->document());
-  hl->setLanguage(Highlighter::Lang::None);
+  new Journal(ed);
+  if (m_started)
+    attachHighlighter(ed, Highlighter::Lang::None);
 
   connect(ed, &QPlainTextEdit::modificationChanged, this,
           &MainWindow::documentModified);
   connect(ed, &QPlainTextEdit::cursorPositionChanged, this,
           &MainWindow::cursorPositionChanged);
+  connect(ed->search(), &SearchIndex::matchesChanged, this, [this, ed] {
+    if (ed == currentEditor())
+      updateStatusBar();
+  });
+  connect(ed, &QObject::destroyed, this, [this, ed] {
+    m_lastActive.remove(ed);
+    m_hibernating.remove(ed);
+    m_reloading.remove(ed);
+    m_jsonJobs.remove(ed);
+  });
 
-  int idx = m_tabs->addTab(ed, "Untitled");
+  int idx = m_tabs->insertTab(index < 0 ? m_tabs->count() : index, ed,
+                              "Untitled");
   m_tabs->setCurrentIndex(idx);
   setTabTitle(ed);
+  return ed;
 }
 
 void MainWindow::closeCurrentTab() {
-  auto *ed = currentEditor();
-  if (!ed)
+  QWidget *page = m_tabs->currentWidget();
+  if (!page)
     return;
-  if (!maybeSave(ed))
+  if (auto *ed = qobject_cast<EditorWidget *>(page); ed && !maybeSave(ed))
     return;
 
-  int idx = m_tabs->indexOf(ed);
+  int idx = m_tabs->indexOf(page);
   m_tabs->removeTab(idx);
-  ed->deleteLater();
+  page->deleteLater();
+  watchOpenFiles();
 
   if (m_tabs->count() == 0) {
     newTab();
   }
 }
 
-void MainWindow::currentTabChanged(int) {
+void MainWindow::currentTabChanged(int index) {
+  if (QWidget *page = m_tabs->widget(index); m_placeholders.contains(page)) {
+    materialize(page);
+    return;
+  }
+  m_outline->setEditor(currentEditor());
   // Update title and status when switching
+  if (currentViewer()) {
+    setWindowTitle(QString("NotepadX - %1").arg(m_tabs->tabText(index)));
+    updateStatusBar();
+    updateLoadProgress();
+    return;
+  }
   auto *ed = currentEditor();
+  m_followAction->setChecked(ed && ed->findChild<FileFollower *>());
   if (!ed)
     return;
+  m_lastActive[ed] = ++m_activeClock;
+  m_budgetTimer->start();
   setTabTitle(ed);
   updateStatusBar();
+  updateLoadProgress();
 }
 
 void MainWindow::newFile() { newTab(); }
@@ -226,7 +610,7 @@ void MainWindow::openFile() {
     return;
 
   auto *ed = currentEditor();
-  if (!ed || !ed->toPlainText().isEmpty() || !ed->filePath().isEmpty()) {
+  if (!ed || !ed->buffer().isEmpty() || !ed->filePath().isEmpty()) {
     newTab();
     ed = currentEditor();
   }
@@ -263,30 +647,129 @@ bool MainWindow::saveFileAs() {
   return saveToPath(ed, path);
 }
 
-bool MainWindow::saveToPath(EditorWidget *ed, const QString &path) {
-  QFile file(path);
-  if (!file.open(QFile::WriteOnly | QFile::Text)) {
-    QMessageBox::warning(this, "Error", "Cannot save file.");
+// Saves on a worker by default; `wait` writes on the GUI thread instead, for
+// callers that are about to close the tab.
+bool MainWindow::saveToPath(EditorWidget *ed, const QString &path, bool wait) {
+  if (path.isEmpty())
+    return false;
+  if (ed->isLoading()) {
+    statusBar()->showMessage("Still loading; save when it has finished", 3000);
     return false;
   }
-  QTextStream out(&file);
-  out << ed->toPlainText();
-  ed->document()->setModified(false);
-  ed->setFilePath(path);
-  setTabTitle(ed);
-  statusBar()->showMessage("Saved", 2000);
+  if (!checkEncodable(ed))
+    return false;
 
-  if (auto *hl = qobject_cast<Highlighter *>(
-          ed->document()->documentLayout()->parent())) {
-    // Not reliable; better: find child of document
+  if (wait) {
+    waitForSave(ed);
+    QString error;
+    qint64 bytes = 0;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const bool ok = FileSaver::write(path, ed->buffer(), ed->textFormat(),
+                                     &error, &bytes);
+    QApplication::restoreOverrideCursor();
+    if (!ok) {
+      QMessageBox::warning(this, "Error",
+                           QString("Cannot save file.\n%1").arg(error));
+      return false;
+    }
+    ed->document()->setModified(false);
+    ed->setFileSize(bytes);
+    fileSaved(ed, path);
+    statusBar()->showMessage("Saved", 2000);
+    return true;
   }
 
-  for (QObject *child : ed->document()->children()) {
-    if (auto *hl = qobject_cast<Highlighter *>(child)) {
-      hl->setLanguage(langForPath(path));
-      break;
-    }
+  auto *saver = ed->findChild<FileSaver *>();
+  if (!saver) {
+    saver = new FileSaver(ed);
+    connect(saver, &FileSaver::progress, this, [this](qint64 n, qint64 total) {
+      statusBar()->showMessage(
+          QString("Saving... %1%").arg(total ? n * 100 / total : 100));
+    });
+    connect(saver, &FileSaver::finished, this,
+            [this, ed, saver](bool ok, const QString &path,
+                              const QString &error, qint64 bytes,
+                              qint64 msecs) {
+              if (!ok) {
+                // A queued save will decide the state once it is done.
+                if (!saver->isBusy())
+                  ed->document()->setModified(true);
+                QMessageBox::warning(
+                    this, "Error",
+                    QString("Cannot save %1.\n%2").arg(path, error));
+                return;
+              }
+              ed->setFileSize(bytes);
+              fileSaved(ed, path);
+              const double mb = bytes / (1024.0 * 1024.0);
+              statusBar()->showMessage(
+                  QString("Saved %1 MB in %2 s (%3 MB/s)")
+                      .arg(mb, 0, 'f', 1)
+                      .arg(msecs / 1000.0, 0, 'f', 2)
+                      .arg(mb * 1000.0 / qMax<qint64>(msecs, 1), 0, 'f', 0),
+                  4000);
+            });
+  }
+  // The tab stays editable; edits made from here on mark it modified again.
+  ed->document()->setModified(false);
+  saver->save(path, ed->buffer(), ed->textFormat());
+  statusBar()->showMessage("Saving...");
+  return true;
+}
+
+// A Latin-1 file that has gained characters beyond U+00FF would lose them;
+// offers to switch the tab to UTF-8 instead. Only Latin-1 tabs are scanned.
+bool MainWindow::checkEncodable(EditorWidget *ed) {
+  TextFormat format = ed->textFormat();
+  if (format.encoding != TextFormat::Encoding::Latin1)
+    return true;
+  bool fits = true;
+  ed->buffer().forEachChunk([&fits](QStringView chunk) {
+    for (qsizetype i = 0; fits && i < chunk.size(); ++i)
+      fits = chunk[i].unicode() <= 0xff;
+  });
+  if (fits)
+    return true;
+  const auto ret = QMessageBox::question(
+      this, "Save",
+      "The document has characters that ISO-8859-1 cannot store.\n"
+      "Save it as UTF-8 instead?");
+  if (ret != QMessageBox::Yes)
+    return false;
+  format.encoding = TextFormat::Encoding::Utf8;
+  ed->setTextFormat(format);
+  updateStatusBar();
+  return true;
+}
+
+// Blocks until a background save of `ed` has finished, so a tab is never
+// closed or rewritten while its save is still being written.
+void MainWindow::waitForSave(EditorWidget *ed) {
+  auto *saver = ed ? ed->findChild<FileSaver *>() : nullptr;
+  if (!saver || !saver->isBusy())
+    return;
+  QEventLoop loop;
+  connect(saver, &FileSaver::finished, &loop, [&loop, saver] {
+    if (!saver->isBusy())
+      loop.quit();
+  });
+  loop.exec(QEventLoop::ExcludeUserInputEvents);
+}
+
+void MainWindow::fileSaved(EditorWidget *ed, const QString &path) {
+  if (ed->filePath() != path) {
+    ed->setFilePath(path);
+    if (auto *hl = highlighterOf(ed))
+      hl->setLanguage(Highlighter::languageFor(path));
   }
+  ed->setFileTime(QFileInfo(path).lastModified());
+  setTabTitle(ed);
+  watchOpenFiles();
+  // With another save queued the file is not the latest text yet.
+  auto *saver = ed->findChild<FileSaver *>();
+  if (auto *journal = ed->findChild<Journal *>();
+      journal && !(saver && saver->isBusy()))
+    journal->markClean();
 
   m_recentFiles.removeAll(path);
   m_recentFiles.prepend(path);
@@ -295,39 +778,256 @@ bool MainWindow::saveToPath(EditorWidget *ed, const QString &path) {
   rebuildRecentFilesMenu();
   QSettings s;
   s.setValue("recentFiles", m_recentFiles);
+}
 
-  return true;
+// Watches the file of every open editor, and only those. A file replaced
+// by an atomic save drops out of the watcher and is added back here.
+void MainWindow::watchOpenFiles() {
+  QSet<QString> wanted;
+  for (int i = 0; i < m_tabs->count(); ++i) {
+    auto *ed = qobject_cast<EditorWidget *>(m_tabs->widget(i));
+    if (ed && !ed->filePath().isEmpty())
+      wanted.insert(ed->filePath());
+  }
+  for (const QString &path : m_fileWatcher->files()) {
+    if (!wanted.remove(path))
+      m_fileWatcher->removePath(path);
+  }
+  for (const QString &path : std::as_const(wanted)) {
+    if (QFileInfo::exists(path))
+      m_fileWatcher->addPath(path);
+  }
+}
+
+void MainWindow::filesChangedOnDisk() {
+  const QSet<QString> paths = std::exchange(m_changedFiles, {});
+  QVector<QPointer<EditorWidget>> changed;
+  for (int i = 0; i < m_tabs->count(); ++i) {
+    auto *ed = qobject_cast<EditorWidget *>(m_tabs->widget(i));
+    if (ed && paths.contains(ed->filePath()))
+      changed.append(ed);
+  }
+  for (const QPointer<EditorWidget> &target : std::as_const(changed)) {
+    EditorWidget *ed = target;
+    // Closed while a question was up, or busy with the file itself.
+    if (!ed || ed->isLoading() || m_reloading.contains(ed) ||
+        ed->findChild<FileFollower *>())
+      continue;
+    if (auto *saver = ed->findChild<FileSaver *>(); saver && saver->isBusy())
+      continue;
+    const QFileInfo info(ed->filePath());
+    // Gone (kept as it is), or our own save.
+    if (!info.exists() || (info.size() == ed->fileSize() &&
+                           info.lastModified() == ed->fileTime()))
+      continue;
+    if (ed->document()->isModified()) {
+      m_tabs->setCurrentWidget(ed);
+      const auto answer = QMessageBox::question(
+          this, "File Changed",
+          QString("%1 has changed on disk.\nReload it? Your unsaved changes "
+                  "can still be undone.")
+              .arg(ed->filePath()));
+      if (!target)
+        continue;
+      if (answer != QMessageBox::Yes) {
+        // Not asked again until the file changes once more.
+        ed->setFileSize(info.size());
+        ed->setFileTime(info.lastModified());
+        continue;
+      }
+    }
+    reloadFromDisk(ed);
+  }
+  watchOpenFiles();
+}
+
+// Reads the file again on a worker and diffs its lines against a snapshot
+// of the buffer. Only the lines that differ are replaced, in one undo step,
+// so the cursor, scroll position and highlighting of the rest stay put.
+void MainWindow::reloadFromDisk(EditorWidget *ed) {
+  m_reloading.insert(ed);
+  const PieceTable text = ed->buffer(); // shared, not copied
+  const int revision = ed->document()->revision();
+  const QString path = ed->filePath();
+  QPointer<MainWindow> self(this);
+  QPointer<EditorWidget> target(ed);
+  QThreadPool::globalInstance()->start([self, target, text, revision, path] {
+    QFile file(path);
+    const bool ok = file.open(QIODevice::ReadOnly);
+    const QDateTime fileTime = QFileInfo(file).lastModified();
+    const QByteArray bytes = ok ? file.readAll() : QByteArray();
+    TextFormat format;
+    const QString after = EncodingDetector::decode(bytes, &format);
+    const QVector<TextEdit> edits =
+        ok ? LineDiff::diff(text.text(), after) : QVector<TextEdit>();
+    postToGui([self, target, revision, path, ok, fileTime,
+               size = bytes.size(), format, edits] {
+      if (!self || !target)
+        return;
+      EditorWidget *ed = target;
+      self->m_reloading.remove(ed);
+      if (!ok || ed->filePath() != path)
+        return;
+      // Typed into meanwhile: the diff is stale, make it again.
+      if (ed->document()->revision() != revision) {
+        self->reloadFromDisk(ed);
+        return;
+      }
+      ed->applyEdits(edits);
+      ed->setTextFormat(format);
+      ed->setFileSize(size);
+      ed->setFileTime(fileTime);
+      ed->document()->setModified(false);
+      if (auto *journal = ed->findChild<Journal *>())
+        journal->markClean();
+      if (ed == self->currentEditor())
+        self->updateStatusBar();
+      self->statusBar()->showMessage(
+          QString("Reloaded %1: %2 changed regions")
+              .arg(QFileInfo(path).fileName())
+              .arg(edits.size()),
+          3000);
+    });
+  });
 }
 
 bool MainWindow::loadFromPath(EditorWidget *ed, const QString &path) {
-  QFile file(path);
-  if (!file.open(QFile::ReadOnly | QFile::Text)) {
+  QSettings s;
+  const qint64 threshold =
+      s.value("viewer/thresholdMB", kDefaultViewerThresholdMB).toLongLong()
+      << 20;
+  if (QFileInfo(path).size() >= threshold)
+    return openInViewer(ed, path);
+
+  const qint64 loadStart = Telemetry::now();
+  // Taken first: a change made while loading is picked up afterwards.
+  const QDateTime fileTime = QFileInfo(path).lastModified();
+  auto *loader = new FileLoader(ed);
+  if (!loader->start(path)) {
+    delete loader;
     QMessageBox::warning(this, "Error", "Cannot open file.");
     return false;
   }
-  QTextStream in(&file);
-  ed->setPlainText(in.readAll());
-  ed->document()->setModified(false);
+
+  // The document fills in as chunks arrive; it can be scrolled right away
+  // but stays read-only until the whole file is in.
+  delete ed->findChild<FileFollower *>();
+  if (ed == currentEditor())
+    m_followAction->setChecked(false);
+  ed->setLoading(true);
+  ed->clear();
+  ed->document()->setUndoRedoEnabled(false);
+  ed->setReadOnly(true);
   ed->setFilePath(path);
+  ed->setTextFormat(TextFormat());
+  if (auto *hl = highlighterOf(ed))
+    hl->setLanguage(Highlighter::languageFor(path));
 
-  if (auto *hl = qobject_cast<Highlighter *>(
-          ed->document()->documentLayout()->parent())) {
-    // Not reliable; better: find child of document
-  }
+  connect(loader, &FileLoader::chunkReady, ed, [ed](const QString &text) {
+    ed->appendLoadedText(text);
+    ed->document()->setModified(false);
+  });
+  connect(loader, &FileLoader::restarted, ed, [ed] {
+    ed->clear();
+    ed->document()->setModified(false);
+  });
+  connect(loader, &FileLoader::progress, this,
+          [this, ed](qint64 done, qint64 total) {
+            if (ed == currentEditor() && total > 0)
+              m_loadProgress->setValue(int(done * 1000 / total));
+          });
+  connect(loader, &FileLoader::finished, this,
+          [this, ed, loader, loadStart, fileTime](bool ok,
+                                                  const QString &error) {
+            loader->deleteLater();
+            ed->setReadOnly(false);
+            ed->document()->setUndoRedoEnabled(true);
+            if (ok) {
+              Telemetry::add(Telemetry::FileLoad, loadStart,
+                             Telemetry::now() - loadStart,
+                             loader->totalBytes());
+              ed->setTextFormat(loader->format());
+              ed->setFileSize(loader->bytesRead());
+              ed->setFileTime(fileTime);
+              watchOpenFiles();
+              statusBar()->showMessage("Opened", 2000);
+            } else {
+              // A partial buffer must never be saved over the original.
+              ed->clear();
+              ed->setFilePath(QString());
+              if (auto *hl = highlighterOf(ed))
+                hl->setLanguage(Highlighter::Lang::None);
+              if (error.isEmpty())
+                statusBar()->showMessage("Loading cancelled", 2000);
+              else
+                QMessageBox::warning(
+                    this, "Error", QString("Cannot read file:\n%1").arg(error));
+            }
+            ed->setLoading(false);
+            ed->document()->setModified(false);
+            if (auto *journal = ed->findChild<Journal *>())
+              journal->markClean();
+            setTabTitle(ed);
+            updateLoadProgress();
+            if (ed == currentEditor())
+              updateStatusBar();
+            m_budgetTimer->start();
+          });
 
-  for (QObject *child : ed->document()->children()) {
-    if (auto *hl = qobject_cast<Highlighter *>(child)) {
-      hl->setLanguage(langForPath(path));
-      break;
-    }
+  m_loadProgress->setValue(0);
+  setTabTitle(ed);
+  updateLoadProgress();
+  statusBar()->showMessage("Opening...");
+  return true;
+}
+
+// Replaces the (empty) placeholder tab with a memory-mapped viewer.
+bool MainWindow::openInViewer(EditorWidget *placeholder, const QString &path) {
+  auto *view = new LargeFileView(this);
+  QString error;
+  if (!view->open(path, &error)) {
+    delete view;
+    QMessageBox::warning(this, "Error",
+                         QString("Cannot open file:\n%1").arg(error));
+    return false;
   }
+  view->setPalette(palette());
 
-  setTabTitle(ed);
-  statusBar()->showMessage("Opened", 2000);
+  connect(view, &LargeFileView::cursorPositionChanged, this,
+          &MainWindow::cursorPositionChanged);
+  connect(view, &LargeFileView::indexChanged, this, [this, view] {
+    if (view == currentViewer())
+      updateStatusBar();
+  });
+  connect(view, &LargeFileView::findFinished, this, [this](bool found) {
+    if (found)
+      statusBar()->clearMessage();
+    else
+      statusBar()->showMessage("Not found", 2000);
+  });
+
+  const int at = m_tabs->indexOf(placeholder);
+  m_tabs->insertTab(at < 0 ? m_tabs->count() : at, view,
+                    QFileInfo(path).fileName() + " [read-only]");
+  if (at >= 0) {
+    m_tabs->removeTab(m_tabs->indexOf(placeholder));
+    placeholder->deleteLater();
+  }
+  m_tabs->setCurrentWidget(view);
+  view->setFocus();
+  statusBar()->showMessage("Opened in read-only viewer", 2000);
   return true;
 }
 
+void MainWindow::updateLoadProgress() {
+  auto *ed = currentEditor();
+  const bool loading = ed && ed->isLoading();
+  m_loadProgress->setVisible(loading);
+  m_loadCancel->setVisible(loading);
+}
+
 bool MainWindow::maybeSave(EditorWidget *ed) {
+  waitForSave(ed); // a failed save marks the document modified again
   if (!ed || !ed->document()->isModified())
     return true;
 
@@ -337,14 +1037,76 @@ bool MainWindow::maybeSave(EditorWidget *ed) {
       QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel);
 
   if (ret == QMessageBox::Save)
-    return saveToPath(ed, ed->filePath().isEmpty()
-                              ? QFileDialog::getSaveFileName(this, "Save File")
-                              : ed->filePath());
+    return saveToPath(ed,
+                      ed->filePath().isEmpty()
+                          ? QFileDialog::getSaveFileName(this, "Save File")
+                          : ed->filePath(),
+                      true);
   if (ret == QMessageBox::Cancel)
     return false;
   return true;
 }
 
+// Offers the unsaved work of a session that ended without closing its tabs.
+void MainWindow::recoverJournals() {
+  const QVector<Journal::Recovery> found = Journal::recover();
+  if (found.isEmpty())
+    return;
+  const auto ret = QMessageBox::question(
+      this, "Recover Unsaved Work",
+      QString("Notepad did not shut down properly.\n"
+              "Recover %1 unsaved document(s)?")
+          .arg(found.size()));
+  for (const Journal::Recovery &r : found) {
+    if (ret == QMessageBox::Yes)
+      restoreJournal(r);
+    Journal::remove(r);
+  }
+}
+
+// Rebuilds a tab from its base and replays the logged edits on top. The
+// edits go through the tab's own journal, which takes over from there.
+void MainWindow::restoreJournal(const Journal::Recovery &r) {
+  auto *ed = currentEditor();
+  if (!ed || !ed->buffer().isEmpty() || !ed->filePath().isEmpty()) {
+    newTab();
+    ed = currentEditor();
+  }
+
+  auto replay = [this, ed, edits = r.edits] {
+    QTextDocument *doc = ed->document();
+    doc->setUndoRedoEnabled(false);
+    QTextCursor cursor(doc);
+    for (const Journal::Edit &e : edits) {
+      const qsizetype length = ed->buffer().length();
+      if (e.pos > length)
+        break;
+      cursor.setPosition(int(e.pos));
+      cursor.setPosition(int(qMin(e.pos + e.removed, length)),
+                         QTextCursor::KeepAnchor);
+      cursor.insertText(e.text);
+    }
+    doc->setUndoRedoEnabled(true);
+    doc->setModified(true);
+    auto *journal = ed->findChild<Journal *>();
+    if (journal && journal->isClean())
+      journal->snapshot();
+    setTabTitle(ed);
+  };
+
+  if (r.fromFile) {
+    if (!loadFromPath(ed, r.filePath) || currentViewer())
+      return; // the read-only viewer takes no edits
+    whenLoaded(ed, replay);
+    return;
+  }
+  ed->setFilePath(r.filePath);
+  if (auto *hl = highlighterOf(ed))
+    hl->setLanguage(Highlighter::languageFor(r.filePath));
+  ed->appendLoadedText(r.text);
+  replay();
+}
+
 void MainWindow::rebuildRecentFilesMenu() {
   m_recentMenu->clear();
   if (m_recentFiles.isEmpty()) {
@@ -378,16 +1140,24 @@ void MainWindow::openRecentFile() {
 
 void MainWindow::goToLine() {
   bool ok;
-  int maxLine = currentEditor()->document()->blockCount();
+  if (auto *view = currentViewer()) {
+    const int maxLine = int(qMin<qint64>(view->lineCount(), INT_MAX));
+    int line = QInputDialog::getInt(
+        this, "Go to Line", QString("Line number (1-%1):").arg(maxLine), 1, 1,
+        maxLine, 1, &ok);
+    if (ok)
+      view->goToLine(line - 1);
+    return;
+  }
+  auto *ed = currentEditor();
+  if (!ed)
+    return;
+  const int maxLine = int(qMin<qint64>(ed->lines().lineCount(), INT_MAX));
   int line = QInputDialog::getInt(this, "Go to Line",
                                   QString("Line number (1-%1):").arg(maxLine),
                                   1, 1, maxLine, 1, &ok);
-  if (ok) {
-    QTextCursor cursor(
-        currentEditor()->document()->findBlockByLineNumber(line - 1));
-    currentEditor()->setTextCursor(cursor);
-    currentEditor()->centerCursor();
-  }
+  if (ok)
+    moveToLine(ed, line - 1);
 }
 
 void MainWindow::find() {
@@ -397,60 +1167,599 @@ void MainWindow::find() {
 
   if (ok && !term.isEmpty()) {
     m_lastSearch = term;
+    // The viewer marks its current match itself.
+    if (auto *ed = currentEditor())
+      ed->search()->setQuery(term, m_searchOptions);
+    const SearchEngine engine(term, m_searchOptions);
+    if (!engine.isValid()) {
+      QMessageBox::warning(this, "Find",
+                           QString("Invalid regular expression:\n%1")
+                               .arg(engine.errorString()));
+      return;
+    }
     findNext();
-    highlightSearch(term);
   }
 }
 
+void MainWindow::setSearchOption(bool SearchOptions::*option, bool on,
+                                 const QString &key) {
+  m_searchOptions.*option = on;
+  QSettings s;
+  s.setValue(key, on);
+  m_findInFiles->setOptions(m_searchOptions);
+  if (auto *ed = currentEditor(); ed && !m_lastSearch.isEmpty())
+    ed->search()->setQuery(m_lastSearch, m_searchOptions);
+}
+
+// Selects `match` in the editor.
+static void selectMatch(EditorWidget *ed, const SearchMatch &match) {
+  QTextCursor cursor(ed->document());
+  cursor.setPosition(int(match.start));
+  cursor.setPosition(int(match.start + match.length), QTextCursor::KeepAnchor);
+  ed->setTextCursor(cursor);
+}
+
+// Steps through the editor's search index; until it is ready, the same
+// engine searches the buffer from the cursor.
+void MainWindow::findInEditor(EditorWidget *ed, bool backward) {
+  Telemetry::Scope timer(Telemetry::Find);
+  SearchIndex *search = ed->search();
+  search->setQuery(m_lastSearch, m_searchOptions); // no-op when unchanged
+  if (!search->engine().isValid())
+    return;
+  timer.setAmount(search->matches().size());
+  const QTextCursor cursor = ed->textCursor();
+
+  if (!search->isScanning()) {
+    const QVector<SearchMatch> &matches = search->matches();
+    if (matches.isEmpty()) {
+      statusBar()->showMessage("Not found", 2000);
+      return;
+    }
+    qsizetype i = backward ? search->previousMatch(cursor.selectionStart())
+                           : search->nextMatch(cursor.selectionEnd());
+    if (i < 0)
+      i = backward ? matches.size() - 1 : 0; // wrap around
+    selectMatch(ed, matches[i]);
+    return;
+  }
+
+  const SearchMatch match =
+      backward ? search->find(cursor.selectionStart(), true)
+               : search->find(cursor.selectionEnd(), false);
+  if (match.start < 0)
+    statusBar()->showMessage("Not found", 2000);
+  else
+    selectMatch(ed, match);
+}
+
+// The viewer searches its map on a worker with the same engine and
+// options as the editor; findFinished() reports the outcome.
+void MainWindow::findInViewer(LargeFileView *view, bool backward) {
+  const SearchEngine engine(m_lastSearch, m_searchOptions);
+  if (!engine.isValid()) {
+    statusBar()->showMessage(
+        QString("Invalid regular expression: %1").arg(engine.errorString()),
+        4000);
+    return;
+  }
+  statusBar()->showMessage("Searching...");
+  view->find(engine, backward);
+}
+
 void MainWindow::findNext() {
   if (m_lastSearch.isEmpty())
     return;
-  if (!currentEditor()->find(m_lastSearch)) {
-    currentEditor()->moveCursor(QTextCursor::Start);
-    currentEditor()->find(m_lastSearch);
+  if (auto *view = currentViewer()) {
+    findInViewer(view, false);
+    return;
   }
+  if (auto *ed = currentEditor())
+    findInEditor(ed, false);
 }
 
 void MainWindow::findPrev() {
   if (m_lastSearch.isEmpty())
     return;
-  if (!currentEditor()->find(m_lastSearch, QTextDocument::FindBackward)) {
-    currentEditor()->moveCursor(QTextCursor::End);
-    currentEditor()->find(m_lastSearch, QTextDocument::FindBackward);
-  }
-}
-
-void MainWindow::highlightSearch(const QString &term) {
-  QList<QTextEdit::ExtraSelection> extraSelections;
-  if (!term.isEmpty()) {
-    QTextCursor cursor(currentEditor()->document());
-    QTextCharFormat fmt;
-    fmt.setBackground(QBrush(Qt::blue).color());
-    while (!cursor.isNull() && !cursor.atEnd()) {
-      cursor = currentEditor()->document()->find(term, cursor);
-      if (!cursor.isNull()) {
-        QTextEdit::ExtraSelection sel;
-        sel.cursor = cursor;
-        sel.format = fmt;
-        extraSelections.append(sel);
+  if (auto *view = currentViewer()) {
+    findInViewer(view, true);
+    return;
+  }
+  if (auto *ed = currentEditor())
+    findInEditor(ed, true);
+}
+
+bool MainWindow::askReplace(const QString &title) {
+  bool ok;
+  const QString term = QInputDialog::getText(
+      this, title, "Text to find:", QLineEdit::Normal, m_lastSearch, &ok);
+  if (!ok || term.isEmpty())
+    return false;
+  const QString with = QInputDialog::getText(
+      this, title, "Replace with:", QLineEdit::Normal, m_lastReplace, &ok);
+  if (!ok)
+    return false;
+  m_lastSearch = term;
+  m_lastReplace = with;
+  return true;
+}
+
+// Replaces the selection if it is a match, then selects the next one.
+void MainWindow::replace() {
+  auto *ed = currentEditor();
+  if (!ed || ed->isReadOnly() || !askReplace("Replace"))
+    return;
+  SearchIndex *search = ed->search();
+  search->setQuery(m_lastSearch, m_searchOptions);
+  const SearchEngine &engine = search->engine();
+  if (!engine.isValid()) {
+    QMessageBox::warning(this, "Replace",
+                         QString("Invalid regular expression:\n%1")
+                             .arg(engine.errorString()));
+    return;
+  }
+
+  QTextCursor cursor = ed->textCursor();
+  if (cursor.hasSelection()) {
+    const LineIndex &lines = ed->lines();
+    const qsizetype start = cursor.selectionStart();
+    const qsizetype line = lines.lineAt(start);
+    const qsizetype lineStart = lines.lineStart(line);
+    const qsizetype lineEnd = line + 1 < lines.lineCount()
+                                  ? lines.lineStart(line + 1)
+                                  : lines.length();
+    const QString text = ed->buffer().mid(lineStart, lineEnd - lineStart);
+    const SearchMatch match = engine.findFirst(text, start - lineStart);
+    if (match.start == start - lineStart &&
+        match.length == cursor.selectionEnd() - start)
+      cursor.insertText(engine.replacementFor(text, match, m_lastReplace));
+  }
+  findInEditor(ed, false);
+}
+
+void MainWindow::replaceAll() {
+  auto *ed = currentEditor();
+  if (!ed || ed->isReadOnly() || !askReplace("Replace All"))
+    return;
+  const SearchEngine engine(m_lastSearch, m_searchOptions);
+  if (!engine.isValid()) {
+    QMessageBox::warning(this, "Replace All",
+                         QString("Invalid regular expression:\n%1")
+                             .arg(engine.errorString()));
+    return;
+  }
+
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  QElapsedTimer clock;
+  clock.start();
+  const qsizetype count = ed->replaceAll(engine, m_lastReplace);
+  const qint64 msecs = clock.elapsed();
+  QApplication::restoreOverrideCursor();
+  statusBar()->showMessage(
+      count ? QString("Replaced %1 occurrences in %2 s")
+                  .arg(count)
+                  .arg(msecs / 1000.0, 0, 'f', 2)
+            : QString("Not found"),
+      4000);
+}
+
+// Checks or reformats the whole buffer on a worker, streaming it piece by
+// piece. A formatted result replaces the text as one undo step; an error
+// puts the cursor on the offending character.
+void MainWindow::runJsonTool(JsonFormatter::Mode mode) {
+  auto *ed = currentEditor();
+  if (!ed || ed->isLoading() || m_jsonJobs.contains(ed) ||
+      (mode != JsonFormatter::Mode::Validate && ed->isReadOnly()))
+    return;
+  m_jsonJobs.insert(ed);
+  statusBar()->showMessage(mode == JsonFormatter::Mode::Validate
+                               ? "Validating JSON..."
+                               : "Formatting JSON...");
+  const PieceTable text = ed->buffer(); // shared, not copied
+  const int revision = ed->document()->revision();
+  QPointer<MainWindow> self(this);
+  QPointer<EditorWidget> target(ed);
+  QThreadPool::globalInstance()->start([self, target, text, revision, mode] {
+    QElapsedTimer clock;
+    clock.start();
+    JsonFormatter json(mode);
+    json.reserve(text.length());
+    text.forEachChunk([&json](QStringView chunk) { json.feed(chunk); });
+    const bool ok = json.finish();
+    const qint64 msecs = clock.elapsed();
+    postToGui([self, target, revision, mode, ok, msecs,
+               length = text.length(), errorPos = json.errorPosition(),
+               error = json.errorString(), out = json.takeOutput()] {
+      if (!self || !target)
+        return;
+      EditorWidget *ed = target;
+      self->m_jsonJobs.remove(ed);
+      const bool stale = ed->document()->revision() != revision;
+      if (!ok) {
+        if (stale) {
+          self->statusBar()->showMessage(
+              "Invalid JSON; the text changed since, check again", 4000);
+          return;
+        }
+        const qsizetype line = ed->lines().lineAt(errorPos);
+        const qsizetype column = errorPos - ed->lines().lineStart(line);
+        QTextCursor cursor(ed->document());
+        cursor.setPosition(int(errorPos));
+        if (errorPos < length)
+          cursor.setPosition(int(errorPos) + 1, QTextCursor::KeepAnchor);
+        if (ed == self->currentEditor()) {
+          ed->setTextCursor(cursor);
+          ed->centerCursor();
+        }
+        self->statusBar()->showMessage(
+            QString("JSON error at line %1, column %2: %3")
+                .arg(line + 1)
+                .arg(column + 1)
+                .arg(error));
+        return;
+      }
+      if (mode == JsonFormatter::Mode::Validate) {
+        self->statusBar()->showMessage(
+            QString("Valid JSON: %1 characters checked in %2 s")
+                .arg(length)
+                .arg(msecs / 1000.0, 0, 'f', 2),
+            4000);
+        return;
+      }
+      if (stale) {
+        self->statusBar()->showMessage(
+            "The text changed while formatting; nothing was replaced", 4000);
+        return;
       }
+      ed->applyEdits({{0, length, out}});
+      self->statusBar()->showMessage(
+          QString("Formatted JSON in %1 s").arg(msecs / 1000.0, 0, 'f', 2),
+          4000);
+    });
+  });
+}
+
+void MainWindow::showFindInFiles() {
+  if (auto *ed = currentEditor()) {
+    const QString selected = ed->textCursor().selectedText();
+    if (!selected.isEmpty() && !selected.contains(QChar::ParagraphSeparator))
+      m_findInFiles->setPattern(selected);
+    else if (!m_lastSearch.isEmpty())
+      m_findInFiles->setPattern(m_lastSearch);
+    if (m_findInFiles->directory().isEmpty() && !ed->filePath().isEmpty())
+      m_findInFiles->setDirectory(QFileInfo(ed->filePath()).absolutePath());
+  }
+  if (m_findInFiles->directory().isEmpty())
+    m_findInFiles->setDirectory(QDir::currentPath());
+  m_findInFilesDock->show();
+  m_findInFilesDock->raise();
+  m_findInFiles->focusPattern();
+}
+
+// Shows `path` at `line` (0-based), reusing its tab when it is already open.
+// A file that is still streaming in is moved to the line once it is loaded.
+void MainWindow::openAtLine(const QString &path, qsizetype line) {
+  const QString canonical = QFileInfo(path).canonicalFilePath();
+  auto samePath = [&](const QString &other) {
+    return !other.isEmpty() &&
+           QFileInfo(other).canonicalFilePath() == canonical;
+  };
+
+  // A session tab that was never opened is opened in place.
+  QWidget *unopened = nullptr;
+  for (auto it = m_placeholders.cbegin(); it != m_placeholders.cend(); ++it) {
+    if (samePath(it->path)) {
+      unopened = it.key();
+      break;
+    }
+  }
+  if (unopened)
+    m_tabs->setCurrentWidget(unopened);
+
+  EditorWidget *ed = nullptr;
+  LargeFileView *view = nullptr;
+  for (int i = 0; i < m_tabs->count() && !ed && !view; ++i) {
+    if (auto *e = qobject_cast<EditorWidget *>(m_tabs->widget(i));
+        e && samePath(e->filePath()))
+      ed = e;
+    else if (auto *v = qobject_cast<LargeFileView *>(m_tabs->widget(i));
+             v && samePath(v->filePath()))
+      view = v;
+  }
+
+  if (!ed && !view) {
+    ed = currentEditor();
+    if (!ed || !ed->buffer().isEmpty() || !ed->filePath().isEmpty()) {
+      newTab();
+      ed = currentEditor();
     }
+    if (!loadFromPath(ed, path))
+      return;
+    view = currentViewer(); // loadFromPath may have swapped in the viewer
+    if (view)
+      ed = nullptr;
+  }
+
+  if (view) {
+    m_tabs->setCurrentWidget(view);
+    view->setFocus();
+    viewerGoToLine(view, line);
+    return;
   }
-  currentEditor()->setExtraSelections(extraSelections);
+
+  m_tabs->setCurrentWidget(ed);
+  ed->setFocus();
+  whenLoaded(ed, [ed, line] { moveToLine(ed, line); });
 }
 
 void MainWindow::closeEvent(QCloseEvent *event) {
-  // Check all tabs
+  // Check all tabs; hibernated ones with changes are woken up to ask.
   for (int i = 0; i < m_tabs->count(); ++i) {
+    if (QWidget *page = m_tabs->widget(i);
+        m_placeholders.value(page).modified)
+      m_tabs->setCurrentWidget(page);
     auto *ed = qobject_cast<EditorWidget *>(m_tabs->widget(i));
     if (!maybeSave(ed)) {
       event->ignore();
       return;
     }
   }
+  saveSession();
   event->accept();
 }
 
+// Saves the open files with their cursor, scroll position and language.
+// Placeholders that were never opened keep what they were restored with.
+void MainWindow::saveSession() {
+  QVariantList tabs;
+  int current = 0;
+  for (int i = 0; i < m_tabs->count(); ++i) {
+    QWidget *page = m_tabs->widget(i);
+    const SessionTab tab = sessionTabOf(page);
+    if (tab.path.isEmpty())
+      continue;
+    if (page == m_tabs->currentWidget())
+      current = int(tabs.size());
+    tabs.push_back(QVariantMap{{"path", tab.path},
+                               {"line", tab.line},
+                               {"column", tab.column},
+                               {"scroll", tab.scroll},
+                               {"lang", tab.lang}});
+  }
+  QSettings s;
+  s.setValue("session/tabs", tabs);
+  s.setValue("session/current", current);
+}
+
+// Where a tab is and how it is shown; placeholders keep what they were
+// created with.
+MainWindow::SessionTab MainWindow::sessionTabOf(QWidget *page) const {
+  if (auto it = m_placeholders.constFind(page);
+      it != m_placeholders.constEnd())
+    return *it;
+  SessionTab tab;
+  if (auto *ed = qobject_cast<EditorWidget *>(page)) {
+    const QTextCursor cursor = ed->textCursor();
+    tab.path = ed->filePath();
+    tab.line = cursor.blockNumber();
+    tab.column = cursor.positionInBlock();
+    tab.scroll = ed->verticalScrollBar()->value();
+    tab.modified = ed->document()->isModified();
+    tab.format = ed->textFormat();
+    const Highlighter *hl = highlighterOf(ed);
+    tab.lang = int(hl ? hl->language() : Highlighter::languageFor(tab.path));
+  } else if (auto *view = qobject_cast<LargeFileView *>(page)) {
+    tab.path = view->filePath();
+    tab.line = view->cursorLine();
+    tab.column = view->cursorColumn();
+  }
+  return tab;
+}
+
+// Restores the saved tabs as placeholders, which cost a QWidget each; only
+// the current one is loaded. Returns false when there is nothing to restore.
+bool MainWindow::restoreSession() {
+  QSettings s;
+  const QVariantList tabs = s.value("session/tabs").toList();
+  const int current = s.value("session/current").toInt();
+
+  QWidget *active = nullptr;
+  {
+    const QSignalBlocker blocker(m_tabs);
+    for (qsizetype i = 0; i < tabs.size(); ++i) {
+      const QVariantMap map = tabs[i].toMap();
+      SessionTab tab;
+      tab.path = map.value("path").toString();
+      if (tab.path.isEmpty())
+        continue; // files are not even stat()ed until opened
+      tab.line = map.value("line").toLongLong();
+      tab.column = map.value("column").toInt();
+      tab.scroll = map.value("scroll").toInt();
+      tab.lang = map.value("lang").toInt();
+
+      auto *page = new QWidget(m_tabs);
+      m_placeholders.insert(page, tab);
+      m_tabs->addTab(page, QFileInfo(tab.path).fileName());
+      m_tabs->setTabToolTip(m_tabs->count() - 1, tab.path);
+      if (!active || i <= current)
+        active = page;
+    }
+  }
+  if (!active)
+    return false;
+  if (m_tabs->currentWidget() == active)
+    currentTabChanged(m_tabs->currentIndex());
+  else
+    m_tabs->setCurrentWidget(active);
+  return true;
+}
+
+// Turns a session or hibernated placeholder into a real tab at the same
+// position. Unsaved text comes back from the snapshot, with the journal that
+// covered it while asleep; the undo history does not survive hibernation.
+void MainWindow::materialize(QWidget *placeholder) {
+  const SessionTab tab = m_placeholders.take(placeholder);
+  EditorWidget *ed = addEditorTab(m_tabs->indexOf(placeholder));
+  if (tab.modified) {
+    ed->setFilePath(tab.path);
+    ed->setTextFormat(tab.format);
+    ed->document()->setUndoRedoEnabled(false);
+    ed->appendLoadedText(QString::fromUtf8(qUncompress(tab.snapshot)));
+    ed->document()->setUndoRedoEnabled(true);
+    if (auto *journal = placeholder->findChild<Journal *>()) {
+      delete ed->findChild<Journal *>();
+      journal->setEditor(ed);
+    }
+    ed->document()->setModified(true);
+  }
+  m_tabs->removeTab(m_tabs->indexOf(placeholder));
+  placeholder->deleteLater();
+
+  if (!tab.modified) {
+    if (!loadFromPath(ed, tab.path))
+      return;
+    if (auto *view = currentViewer()) {
+      viewerGoToLine(view, tab.line);
+      return;
+    }
+  }
+  if (auto *hl = highlighterOf(ed))
+    hl->setLanguage(Highlighter::Lang(tab.lang));
+  whenLoaded(ed, [ed, tab] {
+    moveToLine(ed, tab.line, tab.column);
+    ed->verticalScrollBar()->setValue(tab.scroll);
+  });
+}
+
+// Editors that can be put to sleep without losing anything: not on screen,
+// not busy with a file and not an empty Untitled tab.
+bool MainWindow::canHibernate(EditorWidget *ed) const {
+  if (ed == currentEditor() || ed->isLoading() || m_hibernating.contains(ed))
+    return false;
+  if (auto *saver = ed->findChild<FileSaver *>(); saver && saver->isBusy())
+    return false;
+  if (ed->findChild<FileFollower *>())
+    return false;
+  return !ed->filePath().isEmpty() || ed->document()->isModified();
+}
+
+// Swaps an inactive editor for a placeholder. An unmodified one only keeps
+// its path and view state and is reloaded from disk; a modified one keeps a
+// compressed snapshot of its text, made on a worker from the buffer.
+void MainWindow::hibernate(EditorWidget *ed) {
+  if (!ed->document()->isModified()) {
+    replaceWithPlaceholder(ed, sessionTabOf(ed));
+    return;
+  }
+  m_hibernating.insert(ed);
+  const PieceTable text = ed->buffer(); // shared, not copied
+  const int revision = ed->document()->revision();
+  QPointer<MainWindow> self(this);
+  QPointer<EditorWidget> target(ed);
+  QThreadPool::globalInstance()->start([self, target, text, revision] {
+    QByteArray utf8;
+    utf8.reserve(text.length());
+    text.forEachChunk([&utf8](QStringView chunk) { utf8 += chunk.toUtf8(); });
+    const QByteArray snapshot = qCompress(utf8, 1);
+    postToGui([self, target, snapshot, revision] {
+      if (!self || !target)
+        return;
+      EditorWidget *ed = target;
+      self->m_hibernating.remove(ed);
+      // Edited or brought back to the front since: stay awake.
+      if (!self->canHibernate(ed) || ed->document()->revision() != revision ||
+          !ed->document()->isModified())
+        return;
+      SessionTab tab = self->sessionTabOf(ed);
+      tab.snapshot = snapshot;
+      self->replaceWithPlaceholder(ed, tab);
+    });
+  });
+}
+
+void MainWindow::replaceWithPlaceholder(EditorWidget *ed,
+                                        const SessionTab &tab) {
+  auto *page = new QWidget(m_tabs);
+  // The journal sleeps with the tab, so a crash still recovers its edits.
+  if (auto *journal = ed->findChild<Journal *>(); journal && tab.modified) {
+    journal->setEditor(nullptr);
+    journal->setParent(page);
+  }
+  m_placeholders.insert(page, tab);
+  const int idx = m_tabs->indexOf(ed);
+  {
+    const QSignalBlocker blocker(m_tabs);
+    m_tabs->insertTab(idx, page, m_tabs->tabText(idx));
+    m_tabs->setTabToolTip(idx, tab.path);
+    m_tabs->removeTab(idx + 1);
+  }
+  ed->deleteLater();
+  watchOpenFiles();
+}
+
+// Hibernates the least recently used editors until the estimated total is
+// back within the budget. Read-only viewers are left alone: their pages are
+// mapped from the file and the system can drop them by itself.
+void MainWindow::enforceMemoryBudget() {
+  QSettings s;
+  const qint64 budget =
+      s.value("memory/budgetMB", kDefaultMemoryBudgetMB).toLongLong() << 20;
+  qint64 total = 0;
+  QVector<EditorWidget *> candidates;
+  for (int i = 0; i < m_tabs->count(); ++i) {
+    auto *ed = qobject_cast<EditorWidget *>(m_tabs->widget(i));
+    if (!ed)
+      continue;
+    total += ed->memoryUsage();
+    if (canHibernate(ed))
+      candidates.push_back(ed);
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [this](EditorWidget *a, EditorWidget *b) {
+              return m_lastActive.value(a) < m_lastActive.value(b);
+            });
+  for (EditorWidget *ed : candidates) {
+    if (total <= budget)
+      break;
+    total -= ed->memoryUsage();
+    hibernate(ed);
+  }
+}
+
+void MainWindow::showTabMemory() {
+  auto mb = [](qint64 bytes) {
+    return QString::number(double(bytes) / (1 << 20), 'f', 1) + " MB";
+  };
+  QString text;
+  qint64 total = 0;
+  for (int i = 0; i < m_tabs->count(); ++i) {
+    QWidget *page = m_tabs->widget(i);
+    QString state;
+    qint64 bytes = 0;
+    if (auto it = m_placeholders.constFind(page);
+        it != m_placeholders.constEnd()) {
+      bytes = it->snapshot.size();
+      state = it->modified ? "hibernated, snapshot" : "not loaded";
+    } else if (auto *ed = qobject_cast<EditorWidget *>(page)) {
+      bytes = ed->memoryUsage();
+      state = m_hibernating.contains(ed) ? "hibernating" : "loaded";
+    } else {
+      state = "mapped viewer";
+    }
+    total += bytes;
+    text += QString("%1: %2 (%3)\n")
+                .arg(m_tabs->tabText(i), mb(bytes), state);
+  }
+  const qint64 rss = residentBytes();
+  text += QString("\nTabs (estimated): %1\nProcess resident: %2\n"
+                  "Budget: %3 MB")
+              .arg(mb(total), rss < 0 ? QString("n/a") : mb(rss))
+              .arg(QSettings()
+                       .value("memory/budgetMB", kDefaultMemoryBudgetMB)
+                       .toInt());
+  QMessageBox::information(this, "Tab Memory", text);
+}
+
 void MainWindow::documentModified() {
   auto *ed = qobject_cast<EditorWidget *>(sender());
   if (!ed)
@@ -463,16 +1772,49 @@ void MainWindow::documentModified() {
 void MainWindow::cursorPositionChanged() { updateStatusBar(); }
 
 void MainWindow::updateStatusBar() {
+  Telemetry::Scope timer(Telemetry::StatusBar);
+  if (auto *view = currentViewer()) {
+    QString msg = QString("Ln %1, Col %2 | %3 | Read-only")
+                      .arg(view->cursorLine() + 1)
+                      .arg(view->cursorColumn() + 1)
+                      .arg(view->format().encodingName());
+    if (!view->isIndexed())
+      msg += QString(" | Indexing %1%").arg(view->indexProgress());
+    statusBar()->showMessage(msg);
+    return;
+  }
   auto *ed = currentEditor();
   if (!ed) {
     statusBar()->clearMessage();
     return;
   }
-  auto cursor = ed->textCursor();
-  int line = cursor.blockNumber() + 1;
-  int col = cursor.columnNumber() + 1;
-  statusBar()->showMessage(
-      QString("Ln %1, Col %2 | UTF-8 | LF").arg(line).arg(col));
+  const LineIndex &lines = ed->lines();
+  const int pos = ed->textCursor().position();
+  const qsizetype index = lines.lineAt(pos);
+  const qsizetype line = index + 1;
+  const qsizetype col = pos - lines.lineStart(index) + 1;
+  const TextFormat &format = ed->textFormat();
+  QString msg = QString("Ln %1, Col %2 | %3 | %4")
+                    .arg(line)
+                    .arg(col)
+                    .arg(format.encodingName(), format.lineEndingName());
+
+  const SearchIndex *search = ed->search();
+  if (search->engine().isValid()) {
+    const QTextCursor cursor = ed->textCursor();
+    qsizetype i = search->matchAt(cursor.selectionStart());
+    if (i >= 0 && search->matches()[i].length !=
+                      cursor.selectionEnd() - cursor.selectionStart())
+      i = -1;
+    const qsizetype n = search->matches().size();
+    if (search->isScanning())
+      msg += " | Searching...";
+    else if (i >= 0)
+      msg += QString(" | Match %1 of %2").arg(i + 1).arg(n);
+    else
+      msg += QString(" | %1 matches").arg(n);
+  }
+  statusBar()->showMessage(msg);
 }
 
 bool MainWindow::isDarkTheme() const {
@@ -494,6 +1836,8 @@ void MainWindow::applyTheme(bool dark) {
     p = QApplication::style()->standardPalette();
   }
   QApplication::setPalette(p);
+  if (!m_tabs)
+    return; // start-up: no widgets yet
 
   // Adjust current editors to follow palette (fonts/wrap remain)
   for (int i = 0; i < m_tabs->count(); ++i) {
@@ -503,6 +1847,53 @@ void MainWindow::applyTheme(bool dark) {
   }
 }
 
+// Follow mode: the tab is read-only and new lines are appended as the file
+// grows. It scrolls along only while the view is at the bottom.
+void MainWindow::setFollow(bool on) {
+  auto *ed = currentEditor();
+  auto *follower = ed ? ed->findChild<FileFollower *>() : nullptr;
+  if (!on) {
+    if (follower) {
+      ed->setFileSize(follower->offset());
+      delete follower;
+      ed->setReadOnly(false);
+      ed->document()->setUndoRedoEnabled(true);
+      statusBar()->showMessage("Stopped following", 2000);
+    }
+    return;
+  }
+  if (!ed || follower)
+    return;
+  if (ed->filePath().isEmpty() || ed->isLoading() ||
+      ed->document()->isModified()) {
+    m_followAction->setChecked(false);
+    statusBar()->showMessage("Only a saved, loaded file can be followed",
+                             3000);
+    return;
+  }
+
+  follower =
+      new FileFollower(ed->filePath(), ed->fileSize(), ed->textFormat(), ed);
+  ed->setReadOnly(true);
+  ed->document()->setUndoRedoEnabled(false);
+  connect(follower, &FileFollower::appended, ed, [ed](const QString &text) {
+    QScrollBar *bar = ed->verticalScrollBar();
+    const bool atBottom = bar->value() >= bar->maximum();
+    ed->appendLoadedText(text);
+    ed->document()->setModified(false);
+    if (atBottom)
+      bar->setValue(bar->maximum());
+  });
+  connect(follower, &FileFollower::restarted, this, [this, ed] {
+    ed->clear();
+    ed->document()->setModified(false);
+    statusBar()->showMessage("File truncated or replaced; reading it again",
+                             3000);
+  });
+  follower->start();
+  statusBar()->showMessage("Following " + ed->filePath(), 2000);
+}
+
 void MainWindow::toggleDarkTheme(bool on) {
   applyTheme(on);
   QSettings s;
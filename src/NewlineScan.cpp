@@ -0,0 +1,153 @@
+#include "NewlineScan_p.h"
+
+#ifdef NOTEPAD_X86_64
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+// Positions found per kernel call; the kernels write to a plain buffer.
+constexpr qsizetype kFindChunk = 1024;
+
+#ifdef NOTEPAD_X86_64
+struct Sse2 {
+  static constexpr int kBytes = 16;
+  static std::uint32_t mask(const char *p, char c = '\n') {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    return std::uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+  }
+  static std::uint32_t mask(const char16_t *p, char16_t c = u'\n') {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    return std::uint32_t(_mm_movemask_epi8(
+               _mm_cmpeq_epi16(v, _mm_set1_epi16(short(c))))) &
+           0x5555u;
+  }
+  static std::uint32_t high(const char *p) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    return std::uint32_t(_mm_movemask_epi8(v));
+  }
+};
+
+#ifdef NOTEPAD_HAVE_AVX2
+bool cpuHasAvx2() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  const bool osxsave = info[2] & (1 << 27);
+  if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) // OS saves YMM state
+    return false;
+  __cpuidex(info, 7, 0);
+  return info[1] & (1 << 5);
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+#else
+struct Scalar {
+  static constexpr int kBytes = 8;
+  template <class T> static std::uint32_t mask(const T *p, T c = T('\n')) {
+    std::uint32_t m = 0;
+    for (int i = 0; i < int(kBytes / sizeof(T)); ++i)
+      m |= std::uint32_t(p[i] == c) << (i * sizeof(T));
+    return m;
+  }
+  static std::uint32_t high(const char *p) {
+    std::uint32_t m = 0;
+    for (int i = 0; i < kBytes; ++i)
+      m |= std::uint32_t(uchar(p[i]) >> 7) << i;
+    return m;
+  }
+};
+#endif
+
+struct Kernels {
+  const char *name;
+  qsizetype (*count8)(const char *, qsizetype);
+  qsizetype (*count16)(const char16_t *, qsizetype);
+  qsizetype (*skip8)(const char *, qsizetype, qsizetype &);
+  qsizetype (*find16)(const char16_t *, qsizetype, qsizetype, qsizetype *);
+  void (*endings8)(const char *, qsizetype, NewlineScan::Endings &);
+  void (*endings16)(const char16_t *, qsizetype, NewlineScan::Endings &);
+  qsizetype (*ascii8)(const char *, qsizetype);
+};
+
+const Kernels &kernels() {
+  static const Kernels k = []() -> Kernels {
+#ifdef NOTEPAD_X86_64
+#ifdef NOTEPAD_HAVE_AVX2
+    if (cpuHasAvx2())
+      return {"avx2",
+              newlineCountAvx2,
+              newlineCountAvx2,
+              newlineSkipAvx2,
+              newlineFindAvx2,
+              newlineEndingsAvx2,
+              newlineEndingsAvx2,
+              asciiPrefixAvx2};
+#endif
+    return {"sse2",
+            countImpl<Sse2, char>,
+            countImpl<Sse2, char16_t>,
+            skipImpl<Sse2, char>,
+            findImpl<Sse2, char16_t>,
+            endingsImpl<Sse2, char>,
+            endingsImpl<Sse2, char16_t>,
+            asciiImpl<Sse2>};
+#else
+    return {"scalar",
+            countImpl<Scalar, char>,
+            countImpl<Scalar, char16_t>,
+            skipImpl<Scalar, char>,
+            findImpl<Scalar, char16_t>,
+            endingsImpl<Scalar, char>,
+            endingsImpl<Scalar, char16_t>,
+            asciiImpl<Scalar>};
+#endif
+  }();
+  return k;
+}
+
+} // namespace
+
+qsizetype NewlineScan::count(const char *s, qsizetype n) {
+  return kernels().count8(s, n);
+}
+
+qsizetype NewlineScan::count(const char16_t *s, qsizetype n) {
+  return kernels().count16(s, n);
+}
+
+qsizetype NewlineScan::skip(const char *s, qsizetype n, qsizetype &k) {
+  return kernels().skip8(s, n, k);
+}
+
+void NewlineScan::find(const char16_t *s, qsizetype n, qsizetype base,
+                       QVector<qsizetype> &out) {
+  qsizetype found[kFindChunk];
+  for (qsizetype i = 0; i < n; i += kFindChunk) {
+    const qsizetype k =
+        kernels().find16(s + i, qMin(kFindChunk, n - i), base + i, found);
+    for (qsizetype j = 0; j < k; ++j)
+      out.push_back(found[j]);
+  }
+}
+
+void NewlineScan::endings(const char *s, qsizetype n, Endings &e) {
+  kernels().endings8(s, n, e);
+}
+
+void NewlineScan::endings(const char16_t *s, qsizetype n, Endings &e) {
+  kernels().endings16(s, n, e);
+}
+
+qsizetype NewlineScan::asciiPrefix(const char *s, qsizetype n) {
+  return kernels().ascii8(s, n);
+}
+
+const char *NewlineScan::isa() { return kernels().name; }
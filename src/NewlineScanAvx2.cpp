@@ -0,0 +1,54 @@
+#include "NewlineScan_p.h"
+
+#include <immintrin.h>
+
+namespace {
+struct Avx2 {
+  static constexpr int kBytes = 32;
+  static std::uint32_t mask(const char *p, char c = '\n') {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    return std::uint32_t(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+  }
+  static std::uint32_t mask(const char16_t *p, char16_t c = u'\n') {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    return std::uint32_t(_mm256_movemask_epi8(
+               _mm256_cmpeq_epi16(v, _mm256_set1_epi16(short(c))))) &
+           0x55555555u;
+  }
+  static std::uint32_t high(const char *p) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    return std::uint32_t(_mm256_movemask_epi8(v));
+  }
+};
+} // namespace
+
+qsizetype newlineCountAvx2(const char *s, qsizetype n) {
+  return countImpl<Avx2>(s, n);
+}
+
+qsizetype newlineCountAvx2(const char16_t *s, qsizetype n) {
+  return countImpl<Avx2>(s, n);
+}
+
+qsizetype newlineSkipAvx2(const char *s, qsizetype n, qsizetype &k) {
+  return skipImpl<Avx2>(s, n, k);
+}
+
+qsizetype newlineFindAvx2(const char16_t *s, qsizetype n, qsizetype base,
+                          qsizetype *out) {
+  return findImpl<Avx2>(s, n, base, out);
+}
+
+void newlineEndingsAvx2(const char *s, qsizetype n, NewlineScan::Endings &e) {
+  endingsImpl<Avx2>(s, n, e);
+}
+
+void newlineEndingsAvx2(const char16_t *s, qsizetype n,
+                        NewlineScan::Endings &e) {
+  endingsImpl<Avx2>(s, n, e);
+}
+
+qsizetype asciiPrefixAvx2(const char *s, qsizetype n) {
+  return asciiImpl<Avx2>(s, n);
+}
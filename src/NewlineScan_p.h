@@ -0,0 +1,143 @@
+#pragma once
+#include "NewlineScan.h"
+
+#include <cstdint>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Kernels shared by NewlineScan.cpp and NewlineScanAvx2.cpp. Everything is in
+// an anonymous namespace so each translation unit keeps its own copy built
+// for its own instruction set. For the same reason the kernels use no
+// inline library code (std::popcount, QVector): NewlineScanAvx2.cpp is built
+// with AVX2, and an inline function emitted there with external linkage
+// may be the copy the linker keeps for the whole program.
+namespace {
+
+int bitCount(std::uint32_t m) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  m -= (m >> 1) & 0x55555555u;
+  m = (m & 0x33333333u) + ((m >> 2) & 0x33333333u);
+  return int((((m + (m >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+#else
+  return __builtin_popcount(m);
+#endif
+}
+
+// Index of the lowest set bit of m != 0.
+int lowestBit(std::uint32_t m) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long i;
+  _BitScanForward(&i, m);
+  return int(i);
+#else
+  return __builtin_ctz(m);
+#endif
+}
+
+// Isa::mask(p, c) sets bit b * sizeof(T) when p[b] == c ('\n' by default),
+// for the Isa::kBytes / sizeof(T) code units starting at p. Isa::high(p) sets
+// bit b when byte p[b] is 0x80 or above.
+template <class Isa, class T> qsizetype countImpl(const T *s, qsizetype n) {
+  constexpr qsizetype step = Isa::kBytes / sizeof(T);
+  qsizetype c = 0, i = 0;
+  for (; i + step <= n; i += step)
+    c += bitCount(Isa::mask(s + i));
+  for (; i < n; ++i)
+    c += s[i] == T('\n');
+  return c;
+}
+
+template <class Isa, class T>
+qsizetype skipImpl(const T *s, qsizetype n, qsizetype &k) {
+  if (k <= 0)
+    return 0;
+  constexpr qsizetype step = Isa::kBytes / sizeof(T);
+  qsizetype i = 0;
+  for (; i + step <= n; i += step) {
+    auto m = Isa::mask(s + i);
+    const int c = bitCount(m);
+    if (c < k) {
+      k -= c;
+      continue;
+    }
+    for (; k > 1; --k)
+      m &= m - 1;
+    k = 0;
+    return i + lowestBit(m) / qsizetype(sizeof(T)) + 1;
+  }
+  for (; i < n; ++i)
+    if (s[i] == T('\n') && --k == 0)
+      return i + 1;
+  return -1;
+}
+
+// Writes base + i for every s[i] == '\n' to `out`, which has room for n,
+// and returns how many it wrote.
+template <class Isa, class T>
+qsizetype findImpl(const T *s, qsizetype n, qsizetype base, qsizetype *out) {
+  constexpr qsizetype step = Isa::kBytes / sizeof(T);
+  qsizetype i = 0, found = 0;
+  for (; i + step <= n; i += step) {
+    for (auto m = Isa::mask(s + i); m; m &= m - 1)
+      out[found++] = base + i + lowestBit(m) / qsizetype(sizeof(T));
+  }
+  for (; i < n; ++i)
+    if (s[i] == T('\n'))
+      out[found++] = base + i;
+  return found;
+}
+
+template <class Isa, class T>
+void endingsImpl(const T *s, qsizetype n, NewlineScan::Endings &e) {
+  constexpr qsizetype step = Isa::kBytes / sizeof(T);
+  constexpr int lastBit = int((step - 1) * sizeof(T));
+  // A '\r' in the previous unit, moved onto the bit of the current one.
+  std::uint32_t carry = e.lastCR;
+  qsizetype i = 0;
+  for (; i + step <= n; i += step) {
+    const std::uint32_t lf = Isa::mask(s + i, T('\n'));
+    const std::uint32_t cr = Isa::mask(s + i, T('\r'));
+    e.lf += bitCount(lf);
+    e.cr += bitCount(cr);
+    e.crlf += bitCount((cr << sizeof(T) | carry) & lf);
+    carry = (cr >> lastBit) & 1;
+  }
+  bool prevCR = carry;
+  for (; i < n; ++i) {
+    if (s[i] == T('\n')) {
+      ++e.lf;
+      e.crlf += prevCR;
+    }
+    prevCR = s[i] == T('\r');
+    e.cr += prevCR;
+  }
+  e.lastCR = prevCR;
+}
+
+template <class Isa> qsizetype asciiImpl(const char *s, qsizetype n) {
+  qsizetype i = 0;
+  for (; i + Isa::kBytes <= n; i += Isa::kBytes) {
+    if (const std::uint32_t m = Isa::high(s + i))
+      return i + lowestBit(m);
+  }
+  while (i < n && uchar(s[i]) < 0x80)
+    ++i;
+  return i;
+}
+
+} // namespace
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define NOTEPAD_X86_64 1
+// Built with AVX2 enabled; only called when the CPU reports it.
+qsizetype newlineCountAvx2(const char *s, qsizetype n);
+qsizetype newlineCountAvx2(const char16_t *s, qsizetype n);
+qsizetype newlineSkipAvx2(const char *s, qsizetype n, qsizetype &k);
+qsizetype newlineFindAvx2(const char16_t *s, qsizetype n, qsizetype base,
+                          qsizetype *out);
+void newlineEndingsAvx2(const char *s, qsizetype n, NewlineScan::Endings &e);
+void newlineEndingsAvx2(const char16_t *s, qsizetype n,
+                        NewlineScan::Endings &e);
+qsizetype asciiPrefixAvx2(const char *s, qsizetype n);
+#endif
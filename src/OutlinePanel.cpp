@@ -0,0 +1,85 @@
+#include "OutlinePanel.h"
+#include "EditorWidget.h"
+#include "StructureIndex.h"
+#include <QLabel>
+#include <QTextBlock>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+namespace {
+constexpr int kBlockRole = Qt::UserRole;
+} // namespace
+
+OutlinePanel::OutlinePanel(QWidget *parent) : QWidget(parent) {
+  m_tree = new QTreeWidget(this);
+  m_tree->setHeaderHidden(true);
+  m_tree->setUniformRowHeights(true);
+  connect(m_tree, &QTreeWidget::itemClicked, this,
+          [this](QTreeWidgetItem *item) { activate(item); });
+  connect(m_tree, &QTreeWidget::itemActivated, this,
+          [this](QTreeWidgetItem *item) { activate(item); });
+
+  m_status = new QLabel(this);
+
+  auto *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(0, 0, 0, 0);
+  layout->addWidget(m_tree);
+  layout->addWidget(m_status);
+}
+
+void OutlinePanel::setEditor(EditorWidget *editor) {
+  disconnect(m_changed);
+  m_editor = editor;
+  if (editor && editor->structure())
+    m_changed = connect(editor->structure(), &StructureIndex::changed, this,
+                        &OutlinePanel::refresh);
+  refresh();
+}
+
+void OutlinePanel::showEvent(QShowEvent *event) {
+  QWidget::showEvent(event);
+  refresh();
+}
+
+void OutlinePanel::refresh() {
+  if (!isVisible())
+    return;
+  m_tree->clear();
+  const StructureIndex *structure =
+      m_editor ? m_editor->structure() : nullptr;
+  const QVector<OutlineItem> items =
+      structure ? structure->outline() : QVector<OutlineItem>();
+
+  // Each item goes under the last one of the level above it.
+  QVector<QTreeWidgetItem *> parents;
+  for (const OutlineItem &item : items) {
+    parents.resize(qMin<qsizetype>(parents.size(), item.level));
+    auto *node = parents.isEmpty() ? new QTreeWidgetItem(m_tree)
+                                   : new QTreeWidgetItem(parents.last());
+    node->setText(0, item.title);
+    node->setToolTip(0, QString("Line %1").arg(item.block + 1));
+    node->setData(0, kBlockRole, item.block);
+    parents.append(node);
+  }
+  m_tree->expandAll();
+
+  if (!structure || structure->language() == Lexer::Lang::None)
+    m_status->setText("No outline for this file");
+  else if (items.size() >= StructureIndex::kMaxOutlineItems)
+    m_status->setText(QString("First %1 sections").arg(items.size()));
+  else
+    m_status->setText(QString("%1 sections").arg(items.size()));
+}
+
+void OutlinePanel::activate(QTreeWidgetItem *item) {
+  if (!item || !m_editor)
+    return;
+  const QTextBlock block = m_editor->document()->findBlockByNumber(
+      item->data(0, kBlockRole).toInt());
+  if (!block.isValid())
+    return;
+  QTextCursor cursor(block);
+  m_editor->setTextCursor(cursor);
+  m_editor->centerCursor();
+  m_editor->setFocus();
+}
@@ -0,0 +1,116 @@
+#include "PerformancePanel.h"
+#include "Telemetry.h"
+#include <QFileDialog>
+#include <QGridLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPushButton>
+#include <QTimer>
+#include <QTreeWidget>
+
+namespace {
+constexpr int kRefreshMs = 500;
+
+enum Column { Name, Count, TotalMs, AverageUs, MaxUs, Rate, ColumnCount };
+
+// What the amount of a metric counts, for the rate column.
+QString rateOf(Telemetry::Metric metric, const Telemetry::Totals &t) {
+  const double secs = t.nsecs / 1e9;
+  if (t.count == 0 || secs <= 0)
+    return QString();
+  switch (metric) {
+  case Telemetry::HighlightBlock:
+    return QString("%1 blocks/s").arg(t.count / secs, 0, 'f', 0);
+  case Telemetry::HighlightJob:
+    return QString("%1 blocks/s").arg(t.amount / secs, 0, 'f', 0);
+  case Telemetry::FileLoad:
+  case Telemetry::FileSave:
+  case Telemetry::FindInFiles:
+    return QString("%1 MB/s").arg(t.amount / (1024.0 * 1024.0) / secs, 0,
+                                  'f', 1);
+  case Telemetry::SearchScan:
+  case Telemetry::Find:
+    return QString("%1 matches").arg(t.amount);
+  default:
+    return QString();
+  }
+}
+} // namespace
+
+PerformancePanel::PerformancePanel(QWidget *parent) : QWidget(parent) {
+  m_table = new QTreeWidget(this);
+  m_table->setRootIsDecorated(false);
+  m_table->setUniformRowHeights(true);
+  m_table->setColumnCount(ColumnCount);
+  m_table->setHeaderLabels(
+      {"Metric", "Count", "Total ms", "Avg us", "Max us", "Rate"});
+  m_table->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+  for (int m = 0; m < Telemetry::MetricCount; ++m) {
+    auto *item = new QTreeWidgetItem(m_table);
+    item->setText(Name, Telemetry::name(Telemetry::Metric(m)));
+    for (int c = Count; c < Rate; ++c)
+      item->setTextAlignment(c, Qt::AlignRight | Qt::AlignVCenter);
+  }
+
+  auto *reset = new QPushButton("Reset", this);
+  connect(reset, &QPushButton::clicked, this, [this] {
+    Telemetry::reset();
+    refresh();
+  });
+  auto *exportButton = new QPushButton("Export Trace...", this);
+  connect(exportButton, &QPushButton::clicked, this,
+          &PerformancePanel::exportTrace);
+  m_status = new QLabel(this);
+
+  auto *grid = new QGridLayout(this);
+  grid->addWidget(m_table, 0, 0, 1, 3);
+  grid->addWidget(m_status, 1, 0);
+  grid->addWidget(reset, 1, 1);
+  grid->addWidget(exportButton, 1, 2);
+  grid->setColumnStretch(0, 1);
+
+  m_refresh = new QTimer(this);
+  m_refresh->setInterval(kRefreshMs);
+  connect(m_refresh, &QTimer::timeout, this, &PerformancePanel::refresh);
+}
+
+void PerformancePanel::showEvent(QShowEvent *event) {
+  QWidget::showEvent(event);
+  Telemetry::setEnabled(true);
+  m_status->setText("Recording");
+  refresh();
+  m_refresh->start();
+}
+
+void PerformancePanel::hideEvent(QHideEvent *event) {
+  QWidget::hideEvent(event);
+  Telemetry::setEnabled(false);
+  m_refresh->stop();
+}
+
+void PerformancePanel::refresh() {
+  const auto totals = Telemetry::totals();
+  for (int m = 0; m < Telemetry::MetricCount; ++m) {
+    const Telemetry::Totals &t = totals[m];
+    QTreeWidgetItem *item = m_table->topLevelItem(m);
+    item->setText(Count, QString::number(t.count));
+    item->setText(TotalMs, QString::number(t.nsecs / 1e6, 'f', 1));
+    item->setText(AverageUs, t.count ? QString::number(t.nsecs / 1e3 / t.count,
+                                                       'f', 1)
+                                     : QString());
+    item->setText(MaxUs, QString::number(t.maxNsecs / 1e3, 'f', 1));
+    item->setText(Rate, rateOf(Telemetry::Metric(m), t));
+  }
+}
+
+void PerformancePanel::exportTrace() {
+  const QString path = QFileDialog::getSaveFileName(
+      this, "Export Trace", "notepad-trace.json", "Chrome trace (*.json)");
+  if (path.isEmpty())
+    return;
+  QString error;
+  if (Telemetry::exportTrace(path, &error))
+    m_status->setText("Exported " + path);
+  else
+    m_status->setText("Export failed: " + error);
+}
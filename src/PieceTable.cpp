@@ -0,0 +1,163 @@
+#include "PieceTable.h"
+
+namespace {
+// Append buffers are capped so that detaching one from a snapshot copies a
+// bounded amount of text.
+constexpr qsizetype kAddBufferChars = 64 * 1024;
+} // namespace
+
+void PieceTable::clear() {
+  m_buffers.clear();
+  m_pieces.clear();
+  m_addBuffer = -1;
+  m_length = 0;
+  m_cacheIndex = 0;
+  m_cacheStart = 0;
+}
+
+void PieceTable::appendOriginal(const QString &chunk) {
+  if (chunk.isEmpty())
+    return;
+  m_buffers.push_back(chunk);
+  m_pieces.push_back({int(m_buffers.size()) - 1, 0, chunk.size()});
+  m_length += chunk.size();
+}
+
+// Index of the piece containing `pos` (the next one when `pos` is on a
+// boundary, m_pieces.size() at the end) and its start offset.
+int PieceTable::locate(qsizetype pos, qsizetype *pieceStart) const {
+  int i = m_cacheIndex;
+  qsizetype start = m_cacheStart;
+  if (i > m_pieces.size()) {
+    i = 0;
+    start = 0;
+  }
+  while (i > 0 && pos < start) {
+    --i;
+    start -= m_pieces[i].length;
+  }
+  while (i < m_pieces.size() && start + m_pieces[i].length <= pos) {
+    start += m_pieces[i].length;
+    ++i;
+  }
+  m_cacheIndex = i;
+  m_cacheStart = start;
+  *pieceStart = start;
+  return i;
+}
+
+PieceTable::Piece PieceTable::appendToAddBuffer(QStringView text) {
+  if (m_addBuffer < 0 ||
+      m_buffers[m_addBuffer].size() + text.size() > kAddBufferChars) {
+    m_buffers.push_back(QString());
+    m_addBuffer = int(m_buffers.size()) - 1;
+    m_buffers[m_addBuffer].reserve(qMax(kAddBufferChars, text.size()));
+  }
+  QString &buf = m_buffers[m_addBuffer];
+  const Piece piece{m_addBuffer, buf.size(), text.size()};
+  buf.append(text);
+  return piece;
+}
+
+void PieceTable::insert(qsizetype pos, QStringView text) {
+  if (text.isEmpty())
+    return;
+  pos = qBound<qsizetype>(0, pos, m_length);
+  const Piece piece = appendToAddBuffer(text);
+
+  qsizetype start;
+  int i = locate(pos, &start);
+  if (pos == start && i > 0) {
+    // Typing: grow the previous piece when it ends where this text begins.
+    Piece &prev = m_pieces[i - 1];
+    if (prev.buffer == piece.buffer &&
+        prev.start + prev.length == piece.start) {
+      m_cacheIndex = i - 1;
+      m_cacheStart = start - prev.length;
+      prev.length += piece.length;
+      m_length += piece.length;
+      return;
+    }
+  }
+  if (pos > start) {
+    // Split the piece around the insertion point.
+    Piece right = m_pieces[i];
+    right.start += pos - start;
+    right.length -= pos - start;
+    m_pieces[i].length = pos - start;
+    m_pieces.insert(i + 1, right);
+    ++i;
+    start = pos;
+  }
+  m_pieces.insert(i, piece);
+  m_length += piece.length;
+  m_cacheIndex = i;
+  m_cacheStart = start;
+}
+
+void PieceTable::remove(qsizetype pos, qsizetype length) {
+  pos = qBound<qsizetype>(0, pos, m_length);
+  length = qMin(length, m_length - pos);
+  if (length <= 0)
+    return;
+
+  qsizetype start;
+  int i = locate(pos, &start);
+  if (pos > start) {
+    Piece right = m_pieces[i];
+    right.start += pos - start;
+    right.length -= pos - start;
+    m_pieces[i].length = pos - start;
+    m_pieces.insert(i + 1, right);
+    ++i;
+  }
+
+  const int first = i;
+  qsizetype left = length;
+  while (left > 0 && i < m_pieces.size()) {
+    Piece &p = m_pieces[i];
+    if (p.length > left) {
+      p.start += left;
+      p.length -= left;
+      break;
+    }
+    left -= p.length;
+    ++i;
+  }
+  m_pieces.remove(first, i - first);
+  m_length -= length;
+  m_cacheIndex = first;
+  m_cacheStart = pos;
+}
+
+qint64 PieceTable::memoryUsage() const {
+  qint64 bytes = m_pieces.capacity() * qint64(sizeof(Piece));
+  for (const QString &buffer : m_buffers)
+    bytes += buffer.capacity() * qint64(sizeof(char16_t));
+  return bytes;
+}
+
+QString PieceTable::text() const {
+  QString out;
+  out.reserve(m_length);
+  forEachChunk([&out](QStringView chunk) { out.append(chunk); });
+  return out;
+}
+
+QString PieceTable::mid(qsizetype pos, qsizetype length) const {
+  pos = qBound<qsizetype>(0, pos, m_length);
+  length = qBound<qsizetype>(0, length, m_length - pos);
+  QString out;
+  out.reserve(length);
+  qsizetype start;
+  for (int i = locate(pos, &start); length > 0 && i < m_pieces.size(); ++i) {
+    const Piece &p = m_pieces[i];
+    const qsizetype skip = pos - start;
+    const qsizetype n = qMin(p.length - skip, length);
+    out.append(QStringView(m_buffers[p.buffer]).mid(p.start + skip, n));
+    length -= n;
+    start += p.length;
+    pos = start;
+  }
+  return out;
+}
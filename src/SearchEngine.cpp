@@ -0,0 +1,390 @@
+#include "SearchEngine.h"
+#include <QChar>
+#include <QHash>
+#include <QMutex>
+
+#include <bit>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NOTEPAD_SEARCH_SSE2 1
+#endif
+
+namespace {
+
+char16_t fold(char16_t c) { return char16_t(QChar::toCaseFolded(c)); }
+
+bool isWordChar(char16_t c) {
+  return c == u'_' || QChar::isLetterOrNumber(c);
+}
+
+// Regexes are compiled (and JIT-compiled) once per pattern and reused.
+QRegularExpression cachedRegex(const QString &pattern, bool caseSensitive) {
+  static QMutex mutex;
+  static QHash<QString, QRegularExpression> cache;
+  constexpr qsizetype kMaxCached = 32;
+
+  const QString key = QString::number(int(caseSensitive)) + pattern;
+  QMutexLocker lock(&mutex);
+  auto it = cache.constFind(key);
+  if (it != cache.constEnd())
+    return *it;
+  QRegularExpression re(pattern,
+                        caseSensitive
+                            ? QRegularExpression::NoPatternOption
+                            : QRegularExpression::CaseInsensitiveOption);
+  re.optimize();
+  if (cache.size() >= kMaxCached)
+    cache.clear();
+  cache.insert(key, re);
+  return re;
+}
+
+// A regex replacement split into literal runs and group references.
+struct ReplacementPart {
+  QString text;
+  int group = -1; // or the literal text
+};
+
+// \0-\9 refer to the captured groups and \\ is a backslash; anything else
+// is taken literally.
+QVector<ReplacementPart> parseReplacement(const QString &replacement) {
+  QVector<ReplacementPart> parts;
+  QString run;
+  for (qsizetype i = 0; i < replacement.size(); ++i) {
+    const QChar c = replacement[i];
+    if (c == u'\\' && i + 1 < replacement.size()) {
+      const char16_t next = replacement[i + 1].unicode();
+      if (next >= u'0' && next <= u'9') {
+        if (!run.isEmpty())
+          parts.push_back({std::exchange(run, QString())});
+        parts.push_back({QString(), next - u'0'});
+        ++i;
+        continue;
+      }
+      if (next == u'\\') {
+        run += c;
+        ++i;
+        continue;
+      }
+    }
+    run += c;
+  }
+  if (!run.isEmpty())
+    parts.push_back({run});
+  return parts;
+}
+
+void appendExpanded(QString &out, const QVector<ReplacementPart> &parts,
+                    const QRegularExpressionMatch &match) {
+  for (const ReplacementPart &p : parts) {
+    if (p.group < 0)
+      out += p.text;
+    else
+      out += match.capturedView(p.group);
+  }
+}
+
+// Characters every match of `pattern` starts with; empty when unsure.
+QString literalPrefix(const QString &pattern) {
+  if (pattern.contains(u'|'))
+    return QString();
+  static const QStringView kMeta = u".^$*+?()[]{}|";
+  static const QStringView kQuantifier = u"*?{";
+  QString prefix;
+  qsizetype i = pattern.startsWith(u'^') ? 1 : 0;
+  while (i < pattern.size()) {
+    QChar c = pattern[i];
+    qsizetype next = i + 1;
+    if (c == u'\\') {
+      // Escaped punctuation is literal; \d, \b, \x41 and the like are not.
+      if (next >= pattern.size() || pattern[next].isLetterOrNumber())
+        break;
+      c = pattern[next++];
+    } else if (kMeta.contains(c)) {
+      break;
+    }
+    if (next < pattern.size() && kQuantifier.contains(pattern[next]))
+      break; // optional or repeated
+    prefix += c;
+    if (next < pattern.size() && pattern[next] == u'+')
+      break;
+    i = next;
+  }
+  return prefix;
+}
+
+} // namespace
+
+bool SearchEngine::Probe::has(char16_t c) const {
+  for (int i = 0; i < count; ++i)
+    if (units[i] == c)
+      return true;
+  return false;
+}
+
+SearchEngine::SearchEngine(const QString &pattern, SearchOptions options)
+    : m_pattern(pattern), m_options(options) {
+  if (pattern.isEmpty()) {
+    m_error = QStringLiteral("Empty pattern");
+    return;
+  }
+
+  if (options.regex) {
+    const QString source =
+        options.wholeWord ? QStringLiteral("\\b(?:%1)\\b").arg(pattern)
+                          : pattern;
+    m_regex = cachedRegex(source, options.caseSensitive);
+    if (!m_regex.isValid()) {
+      m_error = m_regex.errorString();
+      return;
+    }
+    const QString prefix = literalPrefix(pattern);
+    if (!prefix.isEmpty())
+      m_prefix = std::make_shared<const SearchEngine>(
+          prefix, SearchOptions{options.caseSensitive, false, false});
+    m_valid = true;
+    return;
+  }
+
+  m_units = pattern;
+  if (!options.caseSensitive)
+    for (QChar &c : m_units)
+      c = QChar(fold(c.unicode()));
+
+  // Case variants of a character: every unit folding to the same value.
+  auto probeFor = [&](char16_t c) {
+    Probe p;
+    if (options.caseSensitive) {
+      p.units[p.count++] = c;
+      return p;
+    }
+    for (char32_t u = 0; u <= 0xFFFF; ++u) {
+      if (fold(char16_t(u)) != c)
+        continue;
+      if (p.count == int(p.units.size()))
+        return Probe{}; // too many to test at once
+      p.units[p.count++] = char16_t(u);
+    }
+    return p;
+  };
+  const qsizetype m = m_units.size();
+  m_first = probeFor(m_units.front().unicode());
+  m_last = probeFor(m_units.back().unicode());
+  m_pairFilter = m_first.count > 0 && m_last.count > 0;
+
+  // Horspool shifts, keyed by the low byte of the (folded) unit.
+  m_skip.fill(quint8(qMin<qsizetype>(m, 255)));
+  for (qsizetype i = 0; i + 1 < m; ++i)
+    m_skip[m_units[i].unicode() & 0xFF] =
+        quint8(qMin<qsizetype>(m - 1 - i, 255));
+  m_valid = true;
+}
+
+bool SearchEngine::isWordAt(const char16_t *s, qsizetype n,
+                            qsizetype at) const {
+  const qsizetype end = at + m_units.size();
+  return (at == 0 || !isWordChar(s[at - 1])) &&
+         (end >= n || !isWordChar(s[end]));
+}
+
+bool SearchEngine::verify(const char16_t *s, qsizetype n, qsizetype at) const {
+  const auto *p = reinterpret_cast<const char16_t *>(m_units.constData());
+  const qsizetype m = m_units.size();
+  if (m_options.caseSensitive) {
+    if (std::char_traits<char16_t>::compare(s + at, p, size_t(m)) != 0)
+      return false;
+  } else {
+    for (qsizetype j = 0; j < m; ++j)
+      if (fold(s[at + j]) != p[j])
+        return false;
+  }
+  return !m_options.wholeWord || isWordAt(s, n, at);
+}
+
+template <typename F>
+void SearchEngine::forEachLiteral(QStringView text, qsizetype from,
+                                  F &&f) const {
+  const auto *s = reinterpret_cast<const char16_t *>(text.data());
+  const qsizetype n = text.size();
+  const qsizetype m = m_units.size();
+  qsizetype i = from;
+
+  if (m_pairFilter) {
+#ifdef NOTEPAD_SEARCH_SSE2
+    // Broadcast each case variant once; unused slots repeat the first.
+    __m128i first[4], last[4];
+    for (int k = 0; k < 4; ++k) {
+      first[k] = _mm_set1_epi16(
+          short(m_first.units[k < m_first.count ? k : 0]));
+      last[k] = _mm_set1_epi16(short(m_last.units[k < m_last.count ? k : 0]));
+    }
+    const bool single = m_first.count == 1 && m_last.count == 1;
+    auto eq = [single](__m128i v, const __m128i *p) {
+      if (single)
+        return _mm_cmpeq_epi16(v, p[0]);
+      return _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi16(v, p[0]), _mm_cmpeq_epi16(v, p[1])),
+          _mm_or_si128(_mm_cmpeq_epi16(v, p[2]), _mm_cmpeq_epi16(v, p[3])));
+    };
+    for (; i + m - 1 + 8 <= n; i += 8) {
+      const __m128i a =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+      const __m128i b =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i + m - 1));
+      unsigned mask = unsigned(_mm_movemask_epi8(
+                          _mm_and_si128(eq(a, first), eq(b, last)))) &
+                      0x5555u;
+      for (; mask; mask &= mask - 1) {
+        const qsizetype at = i + std::countr_zero(mask) / 2;
+        if (verify(s, n, at) && !f(SearchMatch{at, m}))
+          return;
+      }
+    }
+#endif
+    for (; i + m <= n; ++i) {
+      if (m_first.has(s[i]) && m_last.has(s[i + m - 1]) && verify(s, n, i) &&
+          !f(SearchMatch{i, m}))
+        return;
+    }
+    return;
+  }
+
+  // Horspool on the last unit of the window.
+  const bool cs = m_options.caseSensitive;
+  const char16_t lastUnit = m_units.back().unicode();
+  while (i + m <= n) {
+    const char16_t c = cs ? s[i + m - 1] : fold(s[i + m - 1]);
+    if (c == lastUnit && verify(s, n, i)) {
+      if (!f(SearchMatch{i, m}))
+        return;
+      ++i;
+      continue;
+    }
+    i += m_skip[c & 0xFF];
+  }
+}
+
+template <typename F>
+void SearchEngine::forEachRegex(QStringView text, qsizetype from,
+                                F &&f) const {
+  const qsizetype n = text.size();
+  qsizetype lineStart = text.lastIndexOf(u'\n', qMax<qsizetype>(0, from - 1));
+  lineStart = from == 0 || lineStart < 0 ? 0 : lineStart + 1;
+  // A final '\n' ends the last line here; what follows belongs to the
+  // caller's next piece of text.
+  const qsizetype last = n > 0 && text[n - 1] == u'\n' ? n - 1 : n;
+  while (lineStart <= last) {
+    if (m_prefix) {
+      // Jump to the next line holding the literal prefix.
+      const SearchMatch hit = m_prefix->findFirst(text, qMax(lineStart, from));
+      if (hit.start < 0)
+        return;
+      const qsizetype nl = text.lastIndexOf(u'\n', hit.start);
+      lineStart = qMax(lineStart, nl + 1);
+    }
+    qsizetype lineEnd = text.indexOf(u'\n', lineStart);
+    if (lineEnd < 0)
+      lineEnd = n;
+    const QStringView line = text.mid(lineStart, lineEnd - lineStart);
+    for (qsizetype at = qMax<qsizetype>(0, from - lineStart);
+         at <= line.size();) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+      const QRegularExpressionMatch match = m_regex.matchView(line, at);
+#else
+      const QRegularExpressionMatch match = m_regex.match(line, at);
+#endif
+      if (!match.hasMatch())
+        break;
+      const qsizetype start = match.capturedStart();
+      if (!f(SearchMatch{lineStart + start, match.capturedLength()}, match))
+        return;
+      at = start + 1;
+    }
+    lineStart = lineEnd + 1;
+  }
+}
+
+template <typename F>
+void SearchEngine::forEachMatch(QStringView text, qsizetype from,
+                                F &&f) const {
+  if (!m_valid)
+    return;
+  if (m_options.regex)
+    forEachRegex(text, from, std::forward<F>(f));
+  else
+    forEachLiteral(text, from, std::forward<F>(f));
+}
+
+void SearchEngine::findAll(QStringView text, qsizetype base,
+                           QVector<SearchMatch> &out) const {
+  forEachMatch(text, 0, [&](SearchMatch m, const auto &...) {
+    m.start += base;
+    out.push_back(m);
+    return true;
+  });
+}
+
+SearchMatch SearchEngine::findFirst(QStringView text, qsizetype from) const {
+  SearchMatch first;
+  forEachMatch(text, from, [&](SearchMatch m, const auto &...) {
+    first = m;
+    return false;
+  });
+  return first;
+}
+
+QString SearchEngine::replacementFor(QStringView text, SearchMatch match,
+                                     const QString &replacement) const {
+  if (!m_options.regex)
+    return replacement;
+  // Match the line again to get at the groups.
+  const qsizetype lineStart =
+      match.start ? text.lastIndexOf(u'\n', match.start - 1) + 1 : 0;
+  qsizetype lineEnd = text.indexOf(u'\n', match.start);
+  if (lineEnd < 0)
+    lineEnd = text.size();
+  const QStringView line = text.mid(lineStart, lineEnd - lineStart);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+  QRegularExpressionMatch m = m_regex.matchView(line, match.start - lineStart);
+#else
+  QRegularExpressionMatch m = m_regex.match(line, match.start - lineStart);
+#endif
+  if (m.capturedStart() != match.start - lineStart)
+    m = QRegularExpressionMatch();
+  QString out;
+  appendExpanded(out, parseReplacement(replacement), m);
+  return out;
+}
+
+qsizetype SearchEngine::replaceAll(QStringView text,
+                                   const QString &replacement,
+                                   qsizetype mergeGap,
+                                   QVector<TextEdit> &edits) const {
+  const QVector<ReplacementPart> parts = m_options.regex
+                                             ? parseReplacement(replacement)
+                                             : QVector<ReplacementPart>();
+  qsizetype count = 0;
+  qsizetype end = 0; // just past the last replaced match
+  TextEdit *edit = nullptr;
+  forEachMatch(text, 0, [&](SearchMatch m, const auto &...match) {
+    if (m.start < end)
+      return true; // overlaps the previous match
+    if (edit && m.start - end <= mergeGap) {
+      edit->text += text.mid(end, m.start - end);
+    } else {
+      edits.push_back({m.start, 0, QString()});
+      edit = &edits.back();
+    }
+    if constexpr (sizeof...(match) > 0)
+      appendExpanded(edit->text, parts, match...);
+    else
+      edit->text += replacement;
+    end = m.start + m.length;
+    edit->removed = end - edit->start;
+    ++count;
+    return true;
+  });
+  return count;
+}
@@ -0,0 +1,272 @@
+#include "SearchIndex.h"
+#include "LineIndex.h"
+#include "PieceTable.h"
+#include "Telemetry.h"
+#include <QCoreApplication>
+#include <QPointer>
+#include <QThreadPool>
+
+#include <algorithm>
+
+namespace {
+// Larger rescans after an edit go back to a worker.
+constexpr qsizetype kSyncScanChars = 1 << 20;
+// Text searched at a time by SearchIndex::find().
+constexpr qsizetype kFindWindowChars = 1 << 20;
+
+// Feeds text arriving piece by piece to the engine in runs of whole lines,
+// so that matches straddling piece boundaries are found too.
+class Scanner {
+public:
+  Scanner(const SearchEngine &engine, qsizetype base)
+      : m_engine(engine), m_base(base) {}
+
+  void feed(QStringView chunk) {
+    const qsizetype firstBreak = chunk.indexOf(u'\n');
+    if (firstBreak < 0) {
+      m_carry.append(chunk);
+      return;
+    }
+    qsizetype from = 0;
+    if (!m_carry.isEmpty()) {
+      m_carry.append(chunk.left(firstBreak + 1));
+      search(m_carry);
+      from = firstBreak + 1;
+    }
+    const qsizetype lastBreak = chunk.lastIndexOf(u'\n');
+    if (lastBreak >= from)
+      search(chunk.mid(from, lastBreak + 1 - from));
+    m_carry = chunk.mid(lastBreak + 1).toString();
+  }
+
+  // The text ended; searches its last line.
+  void finish() { search(m_carry); }
+
+  QVector<SearchMatch> &matches() { return m_matches; }
+
+private:
+  void search(QStringView lines) {
+    m_engine.findAll(lines, m_base, m_matches);
+    m_base += lines.size();
+  }
+
+  const SearchEngine &m_engine;
+  qsizetype m_base;
+  QString m_carry; // start of a line whose end has not arrived yet
+  QVector<SearchMatch> m_matches;
+};
+
+bool startsBefore(const SearchMatch &m, qsizetype pos) { return m.start < pos; }
+} // namespace
+
+SearchIndex::SearchIndex(const PieceTable *text, const LineIndex *lines,
+                         QObject *parent)
+    : QObject(parent), m_text(text), m_lines(lines) {}
+
+SearchIndex::~SearchIndex() {
+  if (m_cancel)
+    *m_cancel = true;
+}
+
+void SearchIndex::setQuery(const QString &pattern, SearchOptions options) {
+  if (pattern == m_engine.pattern() && options == m_engine.options())
+    return;
+  m_engine = SearchEngine(pattern, options);
+  if (!m_engine.isValid()) {
+    if (m_cancel)
+      *m_cancel = true;
+    ++m_generation;
+    m_scanning = false;
+    m_matches.clear();
+    emit matchesChanged();
+    return;
+  }
+  startScan();
+}
+
+void SearchIndex::startScan() {
+  if (m_cancel)
+    *m_cancel = true;
+  m_cancel = std::make_shared<std::atomic<bool>>(false);
+  m_scanning = true;
+  m_matches.clear();
+  m_front = m_back = m_text->length();
+  emit matchesChanged();
+
+  const quint64 generation = ++m_generation;
+  const PieceTable snapshot = *m_text;
+  const SearchEngine engine = m_engine;
+  std::shared_ptr<std::atomic<bool>> cancel = m_cancel;
+  QPointer<SearchIndex> self(this);
+  QThreadPool::globalInstance()->start([=] {
+    Telemetry::Scope timer(Telemetry::SearchScan);
+    Scanner scanner(engine, 0);
+    snapshot.forEachChunk([&](QStringView chunk) {
+      if (!*cancel)
+        scanner.feed(chunk);
+    });
+    if (*cancel)
+      return;
+    scanner.finish();
+    timer.setAmount(scanner.matches().size());
+    if (auto *app = QCoreApplication::instance()) {
+      QMetaObject::invokeMethod(
+          app,
+          [self, generation, matches = std::move(scanner.matches()),
+           length = snapshot.length()] {
+            if (self)
+              self->scanFinished(generation, matches, length);
+          },
+          Qt::QueuedConnection);
+    }
+  });
+}
+
+void SearchIndex::scanFinished(quint64 generation,
+                               const QVector<SearchMatch> &matches,
+                               qsizetype length) {
+  if (generation != m_generation)
+    return;
+  m_scanning = false;
+  m_matches = matches;
+  m_length = length;
+  if (m_front < length || m_back < length || m_text->length() != length)
+    reconcile(length, m_front, m_back); // catch up with edits made meanwhile
+  emit matchesChanged();
+}
+
+void SearchIndex::textChanged(qsizetype pos, qsizetype removed,
+                              qsizetype added) {
+  if (!m_engine.isValid())
+    return;
+  const qsizetype before = m_text->length() - added + removed;
+  if (m_scanning) {
+    m_front = qMin(m_front, pos);
+    m_back = qMin(m_back, before - pos - removed);
+    return;
+  }
+  reconcile(m_length, pos, before - pos - removed);
+  emit matchesChanged();
+}
+
+void SearchIndex::textReset() {
+  if (m_engine.isValid())
+    startScan();
+}
+
+// Brings m_matches (for a text of `oldLength`) up to date with the current
+// text, of which only the first `front` and last `back` characters are known
+// to be unchanged. Matches never span lines, so those on the lines around
+// the change are searched again and the rest are kept (shifted if after it).
+void SearchIndex::reconcile(qsizetype oldLength, qsizetype front,
+                            qsizetype back) {
+  const qsizetype length = m_text->length();
+  front = qBound<qsizetype>(0, front, qMin(oldLength, length));
+  back = qBound<qsizetype>(0, back, qMin(oldLength, length) - front);
+
+  const qsizetype lastLine = m_lines->lineAt(length - back);
+  const bool toEnd = lastLine + 1 >= m_lines->lineCount();
+  const qsizetype from = m_lines->lineStart(m_lines->lineAt(front));
+  const qsizetype to = toEnd ? length : m_lines->lineStart(lastLine + 1);
+  if (to - from > kSyncScanChars) {
+    startScan();
+    return;
+  }
+
+  const qsizetype delta = length - oldLength;
+  const qsizetype head =
+      std::lower_bound(m_matches.cbegin(), m_matches.cend(), from,
+                       startsBefore) -
+      m_matches.cbegin();
+  const qsizetype tail =
+      std::lower_bound(m_matches.cbegin(), m_matches.cend(), to - delta,
+                       startsBefore) -
+      m_matches.cbegin();
+  m_matches.remove(head, tail - head);
+  if (delta) {
+    for (qsizetype i = head; i < m_matches.size(); ++i)
+      m_matches[i].start += delta;
+  }
+
+  Scanner scanner(m_engine, from);
+  scanner.feed(m_text->mid(from, to - from));
+  if (toEnd)
+    scanner.finish();
+  const QVector<SearchMatch> &found = scanner.matches();
+  if (!found.isEmpty())
+    m_matches = m_matches.first(head) + found + m_matches.sliced(head);
+  m_length = length;
+}
+
+qsizetype SearchIndex::nextMatch(qsizetype pos) const {
+  const auto it = std::lower_bound(m_matches.cbegin(), m_matches.cend(), pos,
+                                   startsBefore);
+  return it == m_matches.cend() ? -1 : it - m_matches.cbegin();
+}
+
+qsizetype SearchIndex::previousMatch(qsizetype pos) const {
+  const auto it = std::lower_bound(m_matches.cbegin(), m_matches.cend(), pos,
+                                   startsBefore);
+  return it == m_matches.cbegin() ? -1 : (it - m_matches.cbegin()) - 1;
+}
+
+qsizetype SearchIndex::matchAt(qsizetype pos) const {
+  const qsizetype i = nextMatch(pos);
+  return i >= 0 && m_matches[i].start == pos ? i : -1;
+}
+
+SearchMatch SearchIndex::find(qsizetype pos, bool backward) const {
+  if (!m_engine.isValid())
+    return {};
+  const qsizetype length = m_text->length();
+  pos = qBound<qsizetype>(0, pos, length);
+  // Windows start and end on line boundaries, as matches never span lines.
+  auto lineEnd = [this, length](qsizetype at) {
+    const qsizetype line = m_lines->lineAt(at);
+    return line + 1 < m_lines->lineCount() ? m_lines->lineStart(line + 1)
+                                            : length;
+  };
+  auto lineBegin = [this](qsizetype at) {
+    return m_lines->lineStart(m_lines->lineAt(at));
+  };
+  const qsizetype posLineBegin = lineBegin(pos);
+  const qsizetype posLineEnd = lineEnd(pos);
+
+  // First match starting at or after `at` in [begin, end).
+  auto first = [&](qsizetype begin, qsizetype end, qsizetype at) {
+    while (begin < end) {
+      const qsizetype to =
+          qMin(end, lineEnd(qMin(begin + kFindWindowChars, length - 1)));
+      const QString text = m_text->mid(begin, to - begin);
+      const SearchMatch m =
+          m_engine.findFirst(text, qMax<qsizetype>(0, at - begin));
+      if (m.start >= 0)
+        return SearchMatch{begin + m.start, m.length};
+      begin = to;
+    }
+    return SearchMatch{};
+  };
+  // Last match starting before `before` in [begin, end).
+  auto last = [&](qsizetype begin, qsizetype end, qsizetype before) {
+    QVector<SearchMatch> found;
+    while (end > begin) {
+      const qsizetype from =
+          qMax(begin, lineBegin(qMax<qsizetype>(0, end - kFindWindowChars)));
+      found.clear();
+      m_engine.findAll(m_text->mid(from, end - from), from, found);
+      for (qsizetype i = found.size() - 1; i >= 0; --i) {
+        if (found[i].start < before)
+          return found[i];
+      }
+      end = from;
+    }
+    return SearchMatch{};
+  };
+
+  if (!backward) {
+    const SearchMatch m = first(posLineBegin, length, pos);
+    return m.start >= 0 ? m : first(0, posLineEnd, 0);
+  }
+  const SearchMatch m = last(0, posLineEnd, pos);
+  return m.start >= 0 ? m : last(posLineBegin, length, length + 1);
+}
@@ -0,0 +1,93 @@
+#include "StartupTrace.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QVector>
+
+namespace {
+struct Event {
+  const char *name;
+  qint64 start;    // us
+  qint64 duration; // us; -1 for an instant
+};
+
+struct Trace {
+  bool enabled = false;
+  bool finished = false;
+  QString path;
+  QElapsedTimer clock;
+  QVector<Event> events;
+};
+
+Trace &trace() {
+  static Trace t;
+  return t;
+}
+} // namespace
+
+void StartupTrace::enable(const QString &path) {
+  Trace &t = trace();
+  t.enabled = true;
+  t.path = path;
+  t.clock.start();
+  t.events.reserve(64);
+}
+
+bool StartupTrace::isEnabled() { return trace().enabled; }
+
+qint64 StartupTrace::now() {
+  const Trace &t = trace();
+  return t.enabled ? t.clock.nsecsElapsed() / 1000 : 0;
+}
+
+void StartupTrace::record(const char *name, qint64 start) {
+  Trace &t = trace();
+  if (t.enabled && !t.finished)
+    t.events.push_back({name, start, now() - start});
+}
+
+void StartupTrace::mark(const char *name) {
+  Trace &t = trace();
+  if (t.enabled && !t.finished)
+    t.events.push_back({name, now(), -1});
+}
+
+void StartupTrace::finish() {
+  Trace &t = trace();
+  if (!t.enabled || t.finished)
+    return;
+  t.finished = true;
+
+  QJsonArray events;
+  for (const Event &e : t.events) {
+    QJsonObject o{{"name", QString::fromUtf8(e.name)},
+                  {"cat", "startup"},
+                  {"ts", e.start},
+                  {"pid", 1},
+                  {"tid", 1}};
+    if (e.duration < 0) {
+      o["ph"] = "i";
+      o["s"] = "g";
+    } else {
+      o["ph"] = "X";
+      o["dur"] = e.duration;
+    }
+    events.append(o);
+  }
+  QFile file(t.path);
+  if (!file.open(QIODevice::WriteOnly)) {
+    qWarning("startup trace: cannot write %s: %s", qPrintable(t.path),
+             qPrintable(file.errorString()));
+    return;
+  }
+  file.write(QJsonDocument(QJsonObject{{"traceEvents", events},
+                                       {"displayTimeUnit", "ms"}})
+                 .toJson(QJsonDocument::Compact));
+
+  for (const Event &e : t.events) {
+    if (e.duration < 0)
+      qInfo("startup trace: %s at %.1f ms", e.name, e.start / 1000.0);
+  }
+}
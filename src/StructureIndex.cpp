@@ -0,0 +1,222 @@
+#include "StructureIndex.h"
+#include <QTextDocument>
+#include <QTimer>
+
+namespace {
+// Changes are batched: a whole-file highlighting pass reports a few times a
+// second, not once per line.
+constexpr int kNotifyMs = 300;
+// An outline title is the line that opens the section, cut to this length.
+constexpr int kMaxTitleChars = 80;
+
+class StructureData : public QTextBlockUserData {
+public:
+  explicit StructureData(const BlockStructure &s) : structure(s) {}
+  BlockStructure structure;
+};
+
+bool isBraceLang(Lexer::Lang lang) {
+  return lang == Lexer::Lang::Cpp || lang == Lexer::Lang::Json;
+}
+
+// The line with its brackets and trailing punctuation trimmed off; a line
+// holding only a brace borrows the one above, as in K&R vs Allman style.
+QString titleOf(const QTextBlock &block) {
+  QString title = block.text().trimmed();
+  while (!title.isEmpty() &&
+         QStringView(u"{[(:=,").contains(title.back()))
+    title.chop(1);
+  title = title.trimmed();
+  if (title.isEmpty()) {
+    for (QTextBlock b = block.previous(); b.isValid(); b = b.previous()) {
+      if (!b.text().trimmed().isEmpty()) {
+        title = b.text().trimmed();
+        break;
+      }
+    }
+  }
+  if (title.size() > kMaxTitleChars)
+    title = title.left(kMaxTitleChars - 3) + "...";
+  return title;
+}
+} // namespace
+
+StructureIndex::StructureIndex(QTextDocument *document, QObject *parent)
+    : QObject(parent), m_document(document) {
+  m_notify = new QTimer(this);
+  m_notify->setSingleShot(true);
+  m_notify->setInterval(kNotifyMs);
+  connect(m_notify, &QTimer::timeout, this, &StructureIndex::changed);
+  // Deleted lines take their summaries with them without an update(), and
+  // inserted ones move every section below them.
+  if (m_document) {
+    connect(m_document, &QTextDocument::blockCountChanged, this, [this] {
+      if (!m_notify->isActive())
+        m_notify->start();
+    });
+  }
+}
+
+void StructureIndex::setLanguage(Lexer::Lang lang) {
+  m_lang = lang;
+  m_notify->start();
+}
+
+BlockStructure StructureIndex::summarize(Lexer::Lang lang, QStringView text,
+                                         const Token *tokens,
+                                         qsizetype count) {
+  BlockStructure s;
+  if (lang == Lexer::Lang::Markdown) {
+    // The Highlighter's ATX header rule: one Header token for the line.
+    if (count > 0 && tokens[0].kind == TokenKind::Header) {
+      qsizetype i = 0;
+      while (i < text.size() && text[i] == u' ')
+        ++i;
+      while (i < text.size() && text[i] == u'#' && s.heading < 6)
+        ++i, ++s.heading;
+    }
+    return s;
+  }
+  if (!isBraceLang(lang))
+    return s;
+
+  // Tokens are in order and never overlap; skip over strings and comments.
+  qsizetype next = 0;
+  for (qsizetype i = 0; i < text.size(); ++i) {
+    while (next < count && tokens[next].start + tokens[next].length <= i)
+      ++next;
+    if (next < count && tokens[next].start <= i &&
+        (tokens[next].kind == TokenKind::String ||
+         tokens[next].kind == TokenKind::Comment ||
+         tokens[next].kind == TokenKind::Header)) {
+      i = tokens[next].start + tokens[next].length - 1;
+      continue;
+    }
+    switch (text[i].unicode()) {
+    case u'{':
+    case u'[':
+      ++s.opens;
+      break;
+    case u'}':
+    case u']':
+      if (s.opens)
+        --s.opens;
+      else
+        ++s.closes;
+      break;
+    default:
+      break;
+    }
+  }
+  return s;
+}
+
+BlockStructure StructureIndex::of(const QTextBlock &block) {
+  const auto *data = static_cast<const StructureData *>(block.userData());
+  return data ? data->structure : BlockStructure();
+}
+
+void StructureIndex::update(QTextBlock block, const BlockStructure &structure) {
+  auto *data = static_cast<StructureData *>(block.userData());
+  if (data ? data->structure == structure : structure.isEmpty())
+    return;
+  if (data)
+    data->structure = structure;
+  else
+    block.setUserData(new StructureData(structure));
+  if (!m_notify->isActive())
+    m_notify->start();
+}
+
+QTextBlock StructureIndex::foldEnd(const QTextBlock &start) const {
+  const BlockStructure first = of(start);
+  if (m_lang == Lexer::Lang::Markdown) {
+    if (!first.heading)
+      return QTextBlock();
+    QTextBlock end = start;
+    for (QTextBlock b = start.next(); b.isValid(); b = b.next()) {
+      const int heading = of(b).heading;
+      if (heading && heading <= first.heading)
+        break;
+      end = b;
+    }
+    return end;
+  }
+  if (!isBraceLang(m_lang) || !first.opens)
+    return QTextBlock();
+  int depth = first.opens;
+  QTextBlock last = start;
+  for (QTextBlock b = start.next(); b.isValid(); b = b.next()) {
+    const BlockStructure s = of(b);
+    if (s.closes >= depth) {
+      // "} else {" starts the next section; keep it visible.
+      return s.opens ? last : b;
+    }
+    depth += s.opens - s.closes;
+    last = b;
+  }
+  return last; // unbalanced: runs to the end
+}
+
+QTextBlock StructureIndex::enclosing(const QTextBlock &block) const {
+  if (m_lang == Lexer::Lang::Markdown) {
+    for (QTextBlock b = block; b.isValid(); b = b.previous()) {
+      if (of(b).heading)
+        return b;
+    }
+    return QTextBlock();
+  }
+  if (!isBraceLang(m_lang))
+    return QTextBlock();
+  if (of(block).opens)
+    return block;
+  // Walking up, `pending` counts sections that close between here and
+  // `block`; the first line opening more than that holds `block`.
+  int pending = 0;
+  for (QTextBlock b = block.previous(); b.isValid(); b = b.previous()) {
+    const BlockStructure s = of(b);
+    if (s.opens > pending)
+      return b;
+    pending += s.closes - s.opens;
+  }
+  return QTextBlock();
+}
+
+QVector<OutlineItem> StructureIndex::outline() const {
+  QVector<OutlineItem> items;
+  if (!m_document)
+    return items;
+  if (m_lang == Lexer::Lang::Markdown) {
+    // Levels are made relative to the headings actually used, so a
+    // document starting at "##" is not indented under nothing.
+    QVector<int> open; // heading levels of the enclosing sections
+    for (QTextBlock b = m_document->begin();
+         b.isValid() && items.size() < kMaxOutlineItems; b = b.next()) {
+      const int heading = of(b).heading;
+      if (!heading)
+        continue;
+      while (!open.isEmpty() && open.last() >= heading)
+        open.removeLast();
+      if (open.size() < kOutlineDepth) {
+        QString title = b.text().trimmed();
+        while (title.startsWith(u'#'))
+          title.remove(0, 1);
+        items.append({b.blockNumber(), int(open.size()), title.trimmed()});
+      }
+      open.append(heading);
+    }
+    return items;
+  }
+  if (!isBraceLang(m_lang))
+    return items;
+  int depth = 0;
+  for (QTextBlock b = m_document->begin();
+       b.isValid() && items.size() < kMaxOutlineItems; b = b.next()) {
+    const BlockStructure s = of(b);
+    depth = qMax(0, depth - s.closes);
+    if (s.opens && depth < kOutlineDepth)
+      items.append({b.blockNumber(), depth, titleOf(b)});
+    depth += s.opens;
+  }
+  return items;
+}
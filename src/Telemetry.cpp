@@ -0,0 +1,280 @@
+#include "Telemetry.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QVector>
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+constexpr quint64 kRingSize = 4096;          // samples kept per thread
+constexpr qsizetype kRetiredSamples = 16384; // kept from exited threads
+
+struct Counter {
+  std::atomic<qint64> count{0};
+  std::atomic<qint64> nsecs{0};
+  std::atomic<qint64> maxNsecs{0};
+  std::atomic<qint64> amount{0};
+};
+
+struct Slot {
+  std::atomic<int> metric{0};
+  std::atomic<qint64> start{0};
+  std::atomic<qint64> nsecs{0};
+  std::atomic<qint64> amount{0};
+};
+
+struct Sample {
+  int metric;
+  int tid;
+  qint64 start;
+  qint64 nsecs;
+  qint64 amount;
+};
+
+// Written only by its own thread. A reset bumps the global epoch; the owner
+// zeroes its counters the next time it records, and readers ignore a buffer
+// that has not caught up yet.
+struct Buffer {
+  int tid = 0;
+  std::atomic<int> epoch{-1};
+  std::array<Counter, Telemetry::MetricCount> counters;
+  std::array<Slot, kRingSize> ring;
+  std::atomic<quint64> head{0}; // samples written so far
+};
+
+std::atomic<int> g_epoch{0};
+std::atomic<qint64> g_resetAt{0};
+
+struct Registry {
+  QMutex mutex;
+  QVector<Buffer *> live;
+  std::array<Telemetry::Totals, Telemetry::MetricCount> retired;
+  QVector<Sample> retiredSamples;
+  int nextTid = 1;
+};
+
+Registry &registry() {
+  static Registry r;
+  return r;
+}
+
+// Single writer, so a plain load and store is enough and cheaper than a
+// read-modify-write.
+void bump(std::atomic<qint64> &a, qint64 by) {
+  a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+void addTotals(Telemetry::Totals &t, const Buffer &b, int metric) {
+  const Counter &c = b.counters[metric];
+  t.count += c.count.load(std::memory_order_relaxed);
+  t.nsecs += c.nsecs.load(std::memory_order_relaxed);
+  t.amount += c.amount.load(std::memory_order_relaxed);
+  t.maxNsecs = qMax(t.maxNsecs, c.maxNsecs.load(std::memory_order_relaxed));
+}
+
+// The samples still in the ring that were recorded since the last reset.
+// Slots the owner may have overwritten while they were read are dropped.
+void collect(const Buffer &b, QVector<Sample> &out) {
+  const quint64 end = b.head.load(std::memory_order_acquire);
+  const quint64 begin = end > kRingSize ? end - kRingSize : 0;
+  const qsizetype first = out.size();
+  QVector<quint64> indices;
+  for (quint64 i = begin; i < end; ++i) {
+    const Slot &s = b.ring[i % kRingSize];
+    out.push_back({s.metric.load(std::memory_order_relaxed), b.tid,
+                   s.start.load(std::memory_order_relaxed),
+                   s.nsecs.load(std::memory_order_relaxed),
+                   s.amount.load(std::memory_order_relaxed)});
+    indices.push_back(i);
+  }
+  const quint64 now = b.head.load(std::memory_order_acquire);
+  const quint64 safe = now >= kRingSize ? now - kRingSize + 1 : 0;
+  const qint64 resetAt = g_resetAt.load(std::memory_order_relaxed);
+  qsizetype kept = first;
+  for (qsizetype i = first; i < out.size(); ++i) {
+    if (indices[i - first] >= safe && out[i].start >= resetAt)
+      out[kept++] = out[i];
+  }
+  out.resize(kept);
+}
+
+Buffer *registerBuffer() {
+  auto *b = new Buffer;
+  Registry &r = registry();
+  QMutexLocker lock(&r.mutex);
+  b->tid = r.nextTid++;
+  r.live.push_back(b);
+  return b;
+}
+
+// Folds an exiting thread's buffer into the retired totals.
+void retire(Buffer *b) {
+  Registry &r = registry();
+  QMutexLocker lock(&r.mutex);
+  if (b->epoch.load(std::memory_order_acquire) ==
+      g_epoch.load(std::memory_order_relaxed)) {
+    for (int m = 0; m < Telemetry::MetricCount; ++m)
+      addTotals(r.retired[m], *b, m);
+    collect(*b, r.retiredSamples);
+    if (r.retiredSamples.size() > kRetiredSamples)
+      r.retiredSamples.remove(0, r.retiredSamples.size() - kRetiredSamples);
+  }
+  r.live.removeOne(b);
+  delete b;
+}
+
+struct Local {
+  Buffer *buffer = nullptr;
+  ~Local() {
+    if (buffer)
+      retire(buffer);
+  }
+};
+
+thread_local Local t_local;
+
+Buffer *localBuffer() {
+  if (!t_local.buffer)
+    t_local.buffer = registerBuffer();
+  return t_local.buffer;
+}
+} // namespace
+
+std::atomic<bool> Telemetry::s_enabled{false};
+
+void Telemetry::setEnabled(bool on) {
+  s_enabled.store(on, std::memory_order_relaxed);
+}
+
+qint64 Telemetry::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Telemetry::add(Metric metric, qint64 start, qint64 nsecs,
+                    qint64 amount) {
+  if (!isEnabled())
+    return;
+  Buffer *b = localBuffer();
+  const int epoch = g_epoch.load(std::memory_order_relaxed);
+  if (b->epoch.load(std::memory_order_relaxed) != epoch) {
+    for (Counter &c : b->counters) {
+      c.count.store(0, std::memory_order_relaxed);
+      c.nsecs.store(0, std::memory_order_relaxed);
+      c.maxNsecs.store(0, std::memory_order_relaxed);
+      c.amount.store(0, std::memory_order_relaxed);
+    }
+    b->epoch.store(epoch, std::memory_order_release);
+  }
+
+  Counter &c = b->counters[metric];
+  bump(c.count, 1);
+  bump(c.nsecs, nsecs);
+  bump(c.amount, amount);
+  if (nsecs > c.maxNsecs.load(std::memory_order_relaxed))
+    c.maxNsecs.store(nsecs, std::memory_order_relaxed);
+
+  const quint64 head = b->head.load(std::memory_order_relaxed);
+  Slot &s = b->ring[head % kRingSize];
+  s.metric.store(metric, std::memory_order_relaxed);
+  s.start.store(start, std::memory_order_relaxed);
+  s.nsecs.store(nsecs, std::memory_order_relaxed);
+  s.amount.store(amount, std::memory_order_relaxed);
+  b->head.store(head + 1, std::memory_order_release);
+}
+
+const char *Telemetry::name(Metric metric) {
+  switch (metric) {
+  case HighlightBlock:
+    return "Highlight block";
+  case HighlightJob:
+    return "Highlight job";
+  case FileLoad:
+    return "Load";
+  case FileSave:
+    return "Save";
+  case SearchScan:
+    return "Search scan";
+  case Find:
+    return "Find";
+  case FindInFiles:
+    return "Find in Files";
+  case StatusBar:
+    return "Status bar";
+  case MetricCount:
+    break;
+  }
+  return "";
+}
+
+std::array<Telemetry::Totals, Telemetry::MetricCount> Telemetry::totals() {
+  Registry &r = registry();
+  QMutexLocker lock(&r.mutex);
+  std::array<Totals, MetricCount> t = r.retired;
+  const int epoch = g_epoch.load(std::memory_order_relaxed);
+  for (const Buffer *b : std::as_const(r.live)) {
+    if (b->epoch.load(std::memory_order_acquire) != epoch)
+      continue;
+    for (int m = 0; m < MetricCount; ++m)
+      addTotals(t[m], *b, m);
+  }
+  return t;
+}
+
+void Telemetry::reset() {
+  Registry &r = registry();
+  QMutexLocker lock(&r.mutex);
+  g_epoch.fetch_add(1, std::memory_order_relaxed);
+  g_resetAt.store(now(), std::memory_order_relaxed);
+  r.retired = {};
+  r.retiredSamples.clear();
+}
+
+bool Telemetry::exportTrace(const QString &path, QString *error) {
+  QVector<Sample> samples;
+  {
+    Registry &r = registry();
+    QMutexLocker lock(&r.mutex);
+    samples = r.retiredSamples;
+    for (const Buffer *b : std::as_const(r.live))
+      collect(*b, samples);
+  }
+  std::sort(samples.begin(), samples.end(),
+            [](const Sample &a, const Sample &b) { return a.start < b.start; });
+
+  const qint64 origin = samples.isEmpty() ? 0 : samples.first().start;
+  QJsonArray events;
+  for (const Sample &s : std::as_const(samples)) {
+    events.append(QJsonObject{
+        {"name", QString::fromUtf8(name(Metric(s.metric)))},
+        {"cat", "notepad"},
+        {"ph", "X"},
+        {"ts", double(s.start - origin) / 1000.0},
+        {"dur", double(s.nsecs) / 1000.0},
+        {"pid", 1},
+        {"tid", s.tid},
+        {"args", QJsonObject{{"amount", s.amount}}}});
+  }
+
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) {
+    if (error)
+      *error = file.errorString();
+    return false;
+  }
+  const QByteArray json = QJsonDocument(QJsonObject{
+                                            {"traceEvents", events},
+                                            {"displayTimeUnit", "ms"}})
+                              .toJson(QJsonDocument::Compact);
+  if (file.write(json) != json.size()) {
+    if (error)
+      *error = file.errorString();
+    return false;
+  }
+  return true;
+}
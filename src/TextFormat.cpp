@@ -0,0 +1,212 @@
+#include "TextFormat.h"
+#include <QStringDecoder>
+
+namespace {
+// A UTF-16 file without BOM: most of its ASCII has a zero high byte.
+constexpr qsizetype kSniffBytes = 4096;
+constexpr int kZeroPercent = 40; // of the code units in the sniffed head
+} // namespace
+
+QStringConverter::Encoding TextFormat::converter() const {
+  switch (encoding) {
+  case Encoding::Utf16LE:
+    return QStringConverter::Utf16LE;
+  case Encoding::Utf16BE:
+    return QStringConverter::Utf16BE;
+  case Encoding::Latin1:
+    return QStringConverter::Latin1;
+  case Encoding::Utf8:
+    break;
+  }
+  return QStringConverter::Utf8;
+}
+
+QString TextFormat::encodingName() const {
+  QString name;
+  switch (encoding) {
+  case Encoding::Utf8:
+    name = QStringLiteral("UTF-8");
+    break;
+  case Encoding::Utf16LE:
+    name = QStringLiteral("UTF-16 LE");
+    break;
+  case Encoding::Utf16BE:
+    name = QStringLiteral("UTF-16 BE");
+    break;
+  case Encoding::Latin1:
+    name = QStringLiteral("ISO-8859-1");
+    break;
+  }
+  if (bom)
+    name += QStringLiteral(" BOM");
+  return name;
+}
+
+QString TextFormat::lineEndingName() const {
+  switch (lineEnding) {
+  case LineEnding::CRLF:
+    return QStringLiteral("CRLF");
+  case LineEnding::CR:
+    return QStringLiteral("CR");
+  case LineEnding::LF:
+    break;
+  }
+  return QStringLiteral("LF");
+}
+
+QString TextFormat::newline() const {
+  switch (lineEnding) {
+  case LineEnding::CRLF:
+    return QStringLiteral("\r\n");
+  case LineEnding::CR:
+    return QStringLiteral("\r");
+  case LineEnding::LF:
+    break;
+  }
+  return QStringLiteral("\n");
+}
+
+void TextFormat::normalizeLineEndings(QString &text, bool &pendingCR) {
+  if (pendingCR && !text.startsWith('\n'))
+    text.prepend('\n');
+  pendingCR = text.endsWith('\r');
+  if (pendingCR)
+    text.chop(1);
+  if (!text.contains('\r'))
+    return;
+  text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+  text.replace('\r', '\n');
+}
+
+qsizetype EncodingDetector::begin(QByteArrayView head) {
+  m_format = TextFormat();
+  m_endings = {};
+  m_need = 0;
+
+  if (head.startsWith("\xef\xbb\xbf")) {
+    m_format.bom = true;
+    return 3;
+  }
+  if (head.startsWith("\xff\xfe") || head.startsWith("\xfe\xff")) {
+    m_format.encoding = head[0] == '\xff' ? TextFormat::Encoding::Utf16LE
+                                          : TextFormat::Encoding::Utf16BE;
+    m_format.bom = true;
+    return 2;
+  }
+
+  const qsizetype units = qMin(head.size(), kSniffBytes) / 2;
+  qsizetype evenZeros = 0, oddZeros = 0;
+  for (qsizetype i = 0; i < units; ++i) {
+    evenZeros += head[2 * i] == 0;
+    oddZeros += head[2 * i + 1] == 0;
+  }
+  if (units && oddZeros * 100 >= units * kZeroPercent && evenZeros == 0)
+    m_format.encoding = TextFormat::Encoding::Utf16LE;
+  else if (units && evenZeros * 100 >= units * kZeroPercent && oddZeros == 0)
+    m_format.encoding = TextFormat::Encoding::Utf16BE;
+  return 0;
+}
+
+bool EncodingDetector::feed(QByteArrayView bytes) {
+  const char *s = bytes.data();
+  const qsizetype n = bytes.size();
+  switch (m_format.encoding) {
+  case TextFormat::Encoding::Utf16LE:
+  case TextFormat::Encoding::Utf16BE:
+    return true;
+  case TextFormat::Encoding::Latin1:
+    NewlineScan::endings(s, n, m_endings);
+    return true;
+  case TextFormat::Encoding::Utf8:
+    break;
+  }
+
+  // Multi-byte sequences are checked one byte at a time, everything between
+  // them is skipped a vector at a time.
+  for (qsizetype i = 0; i < n;) {
+    if (m_need == 0) {
+      i += NewlineScan::asciiPrefix(s + i, n - i);
+      if (i == n)
+        break;
+      const uchar c = uchar(s[i++]);
+      if (c < 0xc2 || c > 0xf4)
+        return false;
+      m_low = 0x80;
+      m_high = 0xbf;
+      if (c < 0xe0) {
+        m_need = 1;
+      } else if (c < 0xf0) {
+        m_need = 2;
+        if (c == 0xe0)
+          m_low = 0xa0; // overlong
+        else if (c == 0xed)
+          m_high = 0x9f; // surrogate
+      } else {
+        m_need = 3;
+        if (c == 0xf0)
+          m_low = 0x90; // overlong
+        else if (c == 0xf4)
+          m_high = 0x8f; // above U+10FFFF
+      }
+      continue;
+    }
+    const uchar c = uchar(s[i++]);
+    if (c < m_low || c > m_high)
+      return false;
+    m_low = 0x80;
+    m_high = 0xbf;
+    --m_need;
+  }
+  NewlineScan::endings(s, n, m_endings);
+  return true;
+}
+
+void EncodingDetector::feedDecoded(QStringView text) {
+  if (m_format.encoding == TextFormat::Encoding::Utf16LE ||
+      m_format.encoding == TextFormat::Encoding::Utf16BE)
+    NewlineScan::endings(reinterpret_cast<const char16_t *>(text.utf16()),
+                         text.size(), m_endings);
+}
+
+void EncodingDetector::fallBackToLatin1() {
+  m_format.encoding = TextFormat::Encoding::Latin1;
+  m_format.bom = false;
+  m_endings = {};
+  m_need = 0;
+}
+
+// The most frequent terminator wins; a file without any keeps LF.
+TextFormat EncodingDetector::format() const {
+  TextFormat f = m_format;
+  const qsizetype lf = m_endings.lf - m_endings.crlf;
+  const qsizetype cr = m_endings.cr - m_endings.crlf;
+  const qsizetype crlf = m_endings.crlf;
+  if (crlf > lf && crlf >= cr)
+    f.lineEnding = TextFormat::LineEnding::CRLF;
+  else if (cr > lf && cr > crlf)
+    f.lineEnding = TextFormat::LineEnding::CR;
+  else
+    f.lineEnding = TextFormat::LineEnding::LF;
+  return f;
+}
+
+QString EncodingDetector::decode(QByteArrayView bytes, TextFormat *format) {
+  EncodingDetector detector;
+  QByteArrayView body = bytes.sliced(detector.begin(bytes));
+  if (!detector.feed(body) || !detector.finish()) {
+    detector.fallBackToLatin1();
+    body = bytes;
+    detector.feed(body);
+  }
+  QStringDecoder decoder(detector.m_format.converter(),
+                         QStringConverter::Flag::ConvertInitialBom);
+  QString text = decoder.decode(body);
+  detector.feedDecoded(text);
+  if (format)
+    *format = detector.format();
+  bool pendingCR = false;
+  TextFormat::normalizeLineEndings(text, pendingCR);
+  if (pendingCR)
+    text += '\n';
+  return text;
+}
@@ -1,9 +1,74 @@
 #include "App.h"
+#include "Exporter.h"
 #include "MainWindow.h"
+#include "StartupTrace.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include <cstring>
+
+// `notepad --export ...`: highlights files without a window. Only
+// QCoreApplication is created, so no widget or platform plugin is loaded.
+static int exportMain(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("Notepad");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Writes files or directories as syntax-highlighted HTML or ANSI text.");
+  parser.addHelpOption();
+  parser.addOption({"export", "Run headless and export instead of editing."});
+  parser.addOption({"format", "html (default) or ansi.", "format", "html"});
+  parser.addOption({{"o", "output"},
+                    "Write one file per input under <dir> instead of "
+                    "streaming to stdout.",
+                    "dir"});
+  parser.addOption(
+      {{"j", "jobs"}, "Worker threads (default: one per core).", "n", "0"});
+  parser.addPositionalArgument("paths", "Files or directories to export.",
+                               "paths...");
+  parser.process(app);
+
+  const QString format = parser.value("format").toLower();
+  if (format != "html" && format != "ansi")
+    parser.showHelp(2);
+  const QStringList paths = parser.positionalArguments();
+  if (paths.isEmpty())
+    parser.showHelp(2);
+
+  Exporter::Options options;
+  options.format =
+      format == "ansi" ? Exporter::Format::Ansi : Exporter::Format::Html;
+  options.outputDir = parser.value("output");
+  options.jobs = parser.value("jobs").toInt();
+  return Exporter::run(paths, options) ? 1 : 0;
+}
 
 int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--export") == 0)
+      return exportMain(argc, argv);
+  }
+
+  // Before anything else, so that the trace covers QApplication too.
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--startup-trace") == 0)
+      StartupTrace::enable(QStringLiteral("startup-trace.json"));
+    else if (std::strncmp(argv[i], "--startup-trace=", 16) == 0)
+      StartupTrace::enable(QString::fromLocal8Bit(argv[i] + 16));
+  }
+
+  qint64 start = StartupTrace::now();
   App app(argc, argv);
+  StartupTrace::record("App", start);
+
+  start = StartupTrace::now();
   MainWindow w;
+  StartupTrace::record("MainWindow", start);
+
+  start = StartupTrace::now();
   w.show();
+  StartupTrace::record("show", start);
   return app.exec();
 }